@@ -0,0 +1,50 @@
+/*
+    Reads the main view G-buffer in either GBufferProfile. Bound by GBufferProfile::setDecodeArgs().
+
+    PACKED_GBUFFER == 0: WS_POSITION and WS_NORMAL are raw RGBA32F textures.
+    PACKED_GBUFFER == 1: there is no WS_POSITION, positions are reconstructed from depth, and
+                         WS_NORMAL holds n * 0.5 + 0.5 in RGB10A2.
+*/
+
+#ifndef GBufferDecode_glsl
+#define GBufferDecode_glsl
+
+#include <g3dmath.glsl>
+#include <reconstructFromDepth.glsl>
+
+#expect PACKED_GBUFFER "1 if positions are reconstructed from depth and normals are unorm-encoded"
+
+uniform sampler2D   depthTexture;
+uniform sampler2D   ws_normalTexture;
+
+#if PACKED_GBUFFER
+    /** Camera the G-buffer was rendered from */
+    uniform mat4x3  gbufferCameraFrame;
+    uniform vec3    gbufferClipInfo;
+    uniform vec4    gbufferProjInfo;
+#else
+    uniform sampler2D ws_positionTexture;
+#endif
+
+Point3 readWSPosition(ivec2 C) {
+#if PACKED_GBUFFER
+    float z = reconstructCSZ(texelFetch(depthTexture, C, 0).r, gbufferClipInfo);
+    return gbufferCameraFrame * vec4(reconstructCSPosition(vec2(C) + vec2(0.5), z, gbufferProjInfo), 1.0);
+#else
+    return texelFetch(ws_positionTexture, C, 0).xyz;
+#endif
+}
+
+/** Zero where nothing was rasterized */
+Vector3 readWSNormal(ivec2 C) {
+#if PACKED_GBUFFER
+    if (texelFetch(depthTexture, C, 0).r >= 1.0) {
+        return Vector3(0);
+    }
+    return normalize(texelFetch(ws_normalTexture, C, 0).xyz * 2.0 - 1.0);
+#else
+    return texelFetch(ws_normalTexture, C, 0).xyz;
+#endif
+}
+
+#endif
@@ -91,6 +91,11 @@ const float minProgressDistance = 0.01;
 
 struct IrradianceField {
     Vector3int32            probeCounts;
+    /** MagicDivisor of probeCounts.x and of probeCounts.x * probeCounts.y, see magicDivide() */
+    uint                    probeCountXMultiplier;
+    int                     probeCountXShift;
+    uint                    probeCountXYMultiplier;
+    int                     probeCountXYShift;
     Point3                  probeStartPosition;
     Vector3                 probeStep;
     int                     lowResolutionDownsampleFactor;
@@ -148,21 +153,22 @@ Color3 gridCoordToColor(GridCoord gridCoord) {
 }
 
 
-GridCoord probeIndexToGridCoord(in IrradianceField L, ProbeIndex index) {    
-    /* Works for any # of probes */
-    /*
-    iPos.x = index % L.probeCounts.x;
-    iPos.y = (index % (L.probeCounts.x * L.probeCounts.y)) / L.probeCounts.x;
-    iPos.z = index / (L.probeCounts.x * L.probeCounts.y);
-    */
+/** n / d for 0 <= n < 2^31, from the multiplier and shift of MagicDivisor(d) in MagicDivisor.h */
+int magicDivide(int n, uint multiplier, int shift) {
+    uint hi, lo;
+    umulExtended(uint(n), multiplier, hi, lo);
+    return int((hi + uint(n)) >> uint(shift));
+}
+
 
-    // Assumes probeCounts are powers of two.
-    // Saves ~10ms compared to the divisions above
-    // Precomputing the MSB actually slows this code down substantially
+/** Works for any probe counts. Two multiply-highs instead of the integer division sequence
+    that % and / by the uniform counts compile to. */
+GridCoord probeIndexToGridCoord(in IrradianceField L, ProbeIndex index) {
     ivec3 iPos;
-    iPos.x = index & (L.probeCounts.x - 1);
-    iPos.y = (index & ((L.probeCounts.x * L.probeCounts.y) - 1)) >> findMSB(L.probeCounts.x);
-    iPos.z = index >> findMSB(L.probeCounts.x * L.probeCounts.y);
+    iPos.z = magicDivide(index, L.probeCountXYMultiplier, L.probeCountXYShift);
+    int slice = index - iPos.z * L.probeCounts.x * L.probeCounts.y;
+    iPos.y = magicDivide(slice, L.probeCountXMultiplier, L.probeCountXShift);
+    iPos.x = slice - iPos.y * L.probeCounts.x;
 
     return iPos;
 }
@@ -222,38 +228,7 @@ int idot(ivec3 a, ivec3 b) {
     return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-/**
-   \param baseProbeIndex Index into L.radianceProbeGrid's TEXTURE_2D_ARRAY. This is the probe
-   at the floor of the current ray sampling position.
-
-   \param relativeIndex on [0, 7]. This is used as a set of three 1-bit offsets
-
-   Returns a probe index into L.radianceProbeGrid. It may be the *same* index as 
-   baseProbeIndex.
-
-   This will wrap in crazy ways when the camera is outside of the bounding box
-   of the probes...but that's ok. If that case arises, then the trace is likely to 
-   be poor quality anyway. Regardless, this function will still return the index 
-   of some valid probe, and that probe can either be used or fail because it does not 
-   have visibility to the location desired.
-
-   \see nextCycleIndex, baseProbeIndex
- */
-ProbeIndex relativeProbeIndex(in IrradianceField L, ProbeIndex baseProbeIndex, CycleIndex relativeIndex) {
-    // Guaranteed to be a power of 2
-    ProbeIndex numProbes = L.probeCounts.x * L.probeCounts.y * L.probeCounts.z;
-
-    ivec3 offset = ivec3(relativeIndex & 1, (relativeIndex >> 1) & 1, (relativeIndex >> 2) & 1);
-    ivec3 stride = ivec3(1, L.probeCounts.x, L.probeCounts.x * L.probeCounts.y);
-
-    return (baseProbeIndex + idot(offset, stride)) & (numProbes - 1);
-}
-
-
-/** Given a CycleIndex [0, 7] on a cube of probes, returns the next CycleIndex to use. 
-
-    \see relativeProbeIndex
-*/
+/** Given a CycleIndex [0, 7] on a cube of probes, returns the next CycleIndex to use. */
 CycleIndex nextCycleIndex(CycleIndex cycleIndex) {
     return (cycleIndex + 3) & 7;
 }
@@ -0,0 +1,129 @@
+/*
+    Lookup of world-space grid probes in the bricks resident in a ProbeVolumePager.
+*/
+
+#ifndef PagedProbeVolume_glsl
+#define PagedProbeVolume_glsl
+
+#include <g3dmath.glsl>
+#include <octahedral.glsl>
+
+struct PagedProbeVolume {
+    /** One texel per brick of the grid: the layer of the brick arrays holding it, or -1 */
+    isampler3D              pageTable;
+
+    /** One brick atlas per layer, same tile layout as IrradianceField::bakeGridRegion() */
+    sampler2DArray          irradianceBricks;
+    sampler2DArray          meanDistBricks;
+
+    int                     brickSize;
+    int                     irradianceProbeSideLength;
+    int                     depthProbeSideLength;
+
+    /** Grid geometry, see IrradianceField::probeIndexToPosition() */
+    Point3                  probeStartPosition;
+    Vector3                 probeStep;
+    ivec3                   probeCounts;
+    float                   normalBias;
+};
+
+
+/** Layer holding grid probe \a gridCoord, or -1 if its brick is not resident. \a slot is the atlas
+    slot of the probe within its brick. */
+int pagedProbeLayer(in PagedProbeVolume V, ivec3 gridCoord, out int slot) {
+    ivec3 brick = gridCoord / V.brickSize;
+    ivec3 local = gridCoord - brick * V.brickSize;
+    slot = local.x + V.brickSize * (local.y + V.brickSize * local.z);
+    return texelFetch(V.pageTable, brick, 0).r;
+}
+
+
+/** Texture coordinate (xy) and layer (z) of direction \a dir of grid probe \a gridCoord in the
+    brick arrays of side length \a probeSideLength. Returns false if the brick is not resident. */
+bool pagedProbeCoord(in PagedProbeVolume V, ivec3 gridCoord, Vector3 dir, int probeSideLength, out vec3 coord) {
+    int slot;
+    int layer = pagedProbeLayer(V, gridCoord, slot);
+    if (layer < 0) {
+        return false;
+    }
+
+    vec2 normalizedOctCoordZeroOne = (octEncode(normalize(dir)) + vec2(1.0f)) * 0.5f;
+    float probeWithBorderSide = float(probeSideLength) + 2.0f;
+    int probesPerRow = V.brickSize * V.brickSize;
+    vec2 atlasSize = vec2(probesPerRow, V.brickSize) * probeWithBorderSide + vec2(2.0f);
+
+    // Same (2,2) offset as radianceCacheAtlasCoord()
+    vec2 probeTopLeftPosition = vec2(float(slot % probesPerRow), float(slot / probesPerRow)) * probeWithBorderSide + vec2(2.0f, 2.0f);
+
+    coord = vec3((probeTopLeftPosition + normalizedOctCoordZeroOne * float(probeSideLength)) / atlasSize, float(layer));
+    return true;
+}
+
+
+/** Irradiance at \a X with normal \a n from the cage of eight grid probes around it, with the
+    trilinear, wrap-shaded backface and Chebyshev visibility weights of SampleIrradianceField.pix.
+    Probes whose brick is not resident are skipped. Returns false if none of them is. */
+bool samplePagedIrradiance(in PagedProbeVolume V, Point3 X, Vector3 n, out Irradiance3 E) {
+    Vector3 step = max(V.probeStep, Vector3(1e-6));
+    ivec3 baseGridCoord = clamp(ivec3((X - V.probeStartPosition) / step), ivec3(0), V.probeCounts - 1);
+    Point3 baseProbePos = V.probeStartPosition + V.probeStep * Vector3(baseGridCoord);
+
+    // On [0, 1] for each axis
+    Vector3 alpha = clamp((X - baseProbePos) / step, Vector3(0), Vector3(1));
+
+    Irradiance3 sumIrradiance = Irradiance3(0);
+    float sumWeight = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        ivec3 offset = ivec3(i, i >> 1, i >> 2) & ivec3(1);
+        ivec3 probeGridCoord = clamp(baseGridCoord + offset, ivec3(0), V.probeCounts - 1);
+        Point3 probePos = V.probeStartPosition + V.probeStep * Vector3(probeGridCoord);
+
+        vec3 irradianceCoord;
+        if (! pagedProbeCoord(V, probeGridCoord, n, V.irradianceProbeSideLength, irradianceCoord)) {
+            continue;
+        }
+
+        // Biased off the surface, so that the visibility test is not made exactly at the occluder
+        Vector3 probeToPoint = X - probePos + n * V.normalBias;
+        vec3 meanDistCoord;
+        pagedProbeCoord(V, probeGridCoord, probeToPoint, V.depthProbeSideLength, meanDistCoord);
+
+        // Wrap-shaded backface test, never quite zero
+        Vector3 pointToProbe = probePos - X;
+        float weight = (dot(pointToProbe, pointToProbe) > 1e-8) ?
+            square(max(0.0001, (dot(normalize(pointToProbe), n) + 1.0) * 0.5)) + 0.2 : 1.0;
+
+        // Moment visibility test, http://www.punkuser.net/vsm/vsm_paper.pdf; equation 5
+        vec2 temp = textureLod(V.meanDistBricks, meanDistCoord, 0).rg;
+        float mean = temp.x;
+        float variance = abs(square(temp.x) - temp.y);
+        float distToProbe = length(probeToPoint);
+        float chebyshevWeight = variance / (variance + square(max(distToProbe - mean, 0.0)));
+        weight *= (distToProbe <= mean) ? 1.0 : max(pow3(chebyshevWeight), 0.0);
+
+        weight = max(0.000001, weight);
+
+        // Crush tiny weights but keep the curve continuous
+        const float crushThreshold = 0.2;
+        if (weight < crushThreshold) {
+            weight *= weight * weight * (1.0 / square(crushThreshold));
+        }
+
+        Vector3 trilinear = mix(1.0 - alpha, alpha, Vector3(offset));
+        weight *= trilinear.x * trilinear.y * trilinear.z;
+
+        // Blended in a perceptual space, which softens transitions between probes
+        sumIrradiance += weight * sqrt(textureLod(V.irradianceBricks, irradianceCoord, 0).rgb);
+        sumWeight += weight;
+    }
+
+    if (sumWeight <= 0.0) {
+        E = Irradiance3(0);
+        return false;
+    }
+
+    E = square(sumIrradiance / sumWeight);
+    return true;
+}
+
+#endif
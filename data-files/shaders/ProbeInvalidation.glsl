@@ -0,0 +1,48 @@
+/*
+    Per-probe hysteresis near lights and geometry that changed recently, see ProbeInvalidation.h.
+*/
+
+#ifndef ProbeInvalidation_glsl
+#define ProbeInvalidation_glsl
+
+#include <g3dmath.glsl>
+
+#ifndef PROBE_INVALIDATION_MAX_REGIONS
+#define PROBE_INVALIDATION_MAX_REGIONS 8
+#endif
+
+struct ProbeInvalidation {
+    int                     numRegions;
+
+    /** xyz = center, w = radius of a changed light's influence volume or a moved entity's bounds; inf for directional lights */
+    vec4                    regionBounds[PROBE_INVALIDATION_MAX_REGIONS];
+
+    /** Hysteresis of the probes inside each region, ramping back up as updates accumulate */
+    float                   regionHysteresis[PROBE_INVALIDATION_MAX_REGIONS];
+};
+
+
+/** True if X lies in a region that changed recently */
+bool probeInvalidated(in ProbeInvalidation L, Point3 X) {
+    for (int i = 0; i < L.numRegions; ++i) {
+        Vector3 d = X - L.regionBounds[i].xyz;
+        if (dot(d, d) <= square(L.regionBounds[i].w)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** \a hysteresis lowered to that of every region containing X */
+float probeInvalidationHysteresis(in ProbeInvalidation L, Point3 X, float hysteresis) {
+    for (int i = 0; i < L.numRegions; ++i) {
+        Vector3 d = X - L.regionBounds[i].xyz;
+        if (dot(d, d) <= square(L.regionBounds[i].w)) {
+            hysteresis = min(hysteresis, L.regionHysteresis[i]);
+        }
+    }
+    return hysteresis;
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+    Helper functions for looking up the world-space radiance cache clipmaps.
+    Mirrors the clipmap math in RadianceCache::UpdateRadianceCacheState().
+*/
+
+#ifndef RadianceCacheHelpers_glsl
+#define RadianceCacheHelpers_glsl
+
+#include <g3dmath.glsl>
+#include <octahedral.glsl>
+
+#ifndef USED_PROBE_INDEX
+#define USED_PROBE_INDEX 0xFFFFFFFE
+#endif
+#ifndef RADIANCE_PROBE_MAX_CLIPMAPS
+#define RADIANCE_PROBE_MAX_CLIPMAPS 6
+#endif
+#ifndef INVALID_PROBE_INDEX
+#define INVALID_PROBE_INDEX 0xFFFFFFFF
+#endif
+
+struct RadianceCache {
+    /** xyz = bias, w = scale. Matches RadianceCacheClipmap::WorldPositionToProbeCoord* */
+    vec4                    worldPositionToProbeCoord[RADIANCE_PROBE_MAX_CLIPMAPS];
+    int                     numClipmaps;
+    int                     clipmapResolution;
+
+    /** Clipmaps laid out along x. Texels hold the atlas slot of the probe, or INVALID/USED_PROBE_INDEX */
+    usampler3D              probeIndirectionTexture;
+
+    /** Octahedral probes with a 1-pixel border, same layout as IrradianceField::m_irradianceProbes */
+    sampler2D               probeAtlas;
+    int                     probeAtlasWidth;
+    int                     probeAtlasHeight;
+    int                     probeSideLength;
+};
+
+
+vec2 radianceCacheAtlasCoord(in RadianceCache C, Vector3 dir, int probeIndex) {
+    vec2 normalizedOctCoordZeroOne = (octEncode(normalize(dir)) + vec2(1.0f)) * 0.5f;
+
+    float probeWithBorderSide = float(C.probeSideLength) + 2.0f;
+    int probesPerRow = (C.probeAtlasWidth - 2) / int(probeWithBorderSide);
+
+    // Add (2,2) back to texCoord within larger texture. Compensates for 1 pix
+    // border around texture and further 1 pix border around top left probe.
+    vec2 probeTopLeftPosition = vec2(float(probeIndex % probesPerRow), float(probeIndex / probesPerRow)) * probeWithBorderSide + vec2(2.0f, 2.0f);
+
+    return (probeTopLeftPosition + normalizedOctCoordZeroOne * float(C.probeSideLength)) / vec2(C.probeAtlasWidth, C.probeAtlasHeight);
+}
+
+
+/** Trilinearly interpolates the radiance seen from X when looking along w, using the finest clipmap
+    that has traced probes around X. Returns false if no clipmap covers X. */
+bool sampleRadianceCache(in RadianceCache C, Point3 X, Vector3 w, out Radiance3 L) {
+    for (int clipmapIndex = 0; clipmapIndex < C.numClipmaps; ++clipmapIndex) {
+        vec3 probeCoordFloat = X * C.worldPositionToProbeCoord[clipmapIndex].w + C.worldPositionToProbeCoord[clipmapIndex].xyz;
+        vec3 bottomCorner = floor(probeCoordFloat - 0.5);
+
+        if (any(lessThan(bottomCorner, vec3(0))) || any(greaterThanEqual(bottomCorner + 1.0, vec3(C.clipmapResolution)))) {
+            continue;
+        }
+
+        // On [0, 1] for each axis, same convention as the irradiance field probe cage
+        vec3 alpha = probeCoordFloat - 0.5 - bottomCorner;
+
+        Radiance3 sumRadiance = Radiance3(0);
+        float sumWeight = 0.0;
+        for (int i = 0; i < 8; ++i) {
+            ivec3 offset = ivec3(i, i >> 1, i >> 2) & ivec3(1);
+            ivec3 probeCoord = ivec3(bottomCorner) + offset + ivec3(clipmapIndex * C.clipmapResolution, 0, 0);
+
+            uint probeIndex = texelFetch(C.probeIndirectionTexture, probeCoord, 0).r;
+            if (probeIndex >= uint(USED_PROBE_INDEX)) {
+                // Not traced this frame
+                continue;
+            }
+
+            vec3 trilinear = mix(1.0 - alpha, alpha, vec3(offset));
+            float weight = trilinear.x * trilinear.y * trilinear.z;
+
+            sumRadiance += weight * textureLod(C.probeAtlas, radianceCacheAtlasCoord(C, w, int(probeIndex)), 0).rgb;
+            sumWeight += weight;
+        }
+
+        if (sumWeight > 1e-4) {
+            L = sumRadiance / sumWeight;
+            return true;
+        }
+    }
+
+    L = Radiance3(0);
+    return false;
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+    Screen probe interpolation weights shared by ScreenProbeAdaptivePlacement.glc and the
+    indirect gather. Reads the per-tile candidate table written by ScreenProbeTileTable_Build.glc.
+
+    The includer must declare
+        uniform int   screenProbeDownsampleFactor;
+        uniform float viewport_width;
+        uniform float viewport_height;
+    and define
+        vec4 screenTileTableFetch(ivec2 screenTileCoord00, int cornerIndex, int slot);
+    which returns entry `slot` of tile screenTileCoord00 + (cornerIndex % 2, cornerIndex / 2).
+    Define SCREEN_TILE_TABLE_LAYOUT_ONLY to get the table layout without the interpolation.
+*/
+
+#ifndef ScreenProbeInterpolation_glsl
+#define ScreenProbeInterpolation_glsl
+
+#include <g3dmath.glsl>
+#include <octahedral.glsl>
+
+// A screen tile holds at most (screenProbeDownsampleFactor / 4)^2 - 1 adaptive probes,
+// see App::screenProbeAdaptivePlacement(). Keep in sync with SCREEN_TILE_TABLE_STRIDE in App.h
+#define SCREEN_TILE_TABLE_MAX_ADAPTIVE_PROBES   15
+
+// Table layout, in RGBA32F texels per tile:
+//   0        uniform probe world position, depth
+//   1        number of adaptive probes, 0, 0, 0
+//   2 + 2i   adaptive probe i world position, adaptive probe index
+//   3 + 2i   adaptive probe i screen position, 0, 0
+#define SCREEN_TILE_TABLE_STRIDE                (2 + 2 * SCREEN_TILE_TABLE_MAX_ADAPTIVE_PROBES)
+#define SCREEN_TILE_TABLE_UNIFORM_PROBE         0
+#define SCREEN_TILE_TABLE_HEADER                1
+#define SCREEN_TILE_TABLE_ADAPTIVE_PROBE(i)     (2 + 2 * (i))
+
+ivec2 screenProbeViewSize() {
+    return ivec2((int) viewport_width / screenProbeDownsampleFactor, (int) viewport_height / screenProbeDownsampleFactor);
+}
+
+#ifndef SCREEN_TILE_TABLE_LAYOUT_ONLY
+
+vec4 screenTileTableFetch(ivec2 screenTileCoord00, int cornerIndex, int slot);
+
+struct FScreenProbeSample
+{
+	ivec2 AltasCoord[4];
+	vec4 weights;
+};
+
+// Top-left tile of the 2x2 uniform probes surrounding screenCoord
+ivec2 screenTileCoord00(ivec2 screenCoord) {
+	ivec2 screenProbeFullResScreenCoord = ivec2(clamp(screenCoord.x, 0.0f, viewport_width - 1.0f), clamp(screenCoord.y, 0.0f, viewport_height - 1.0f));
+    return min(screenProbeFullResScreenCoord / screenProbeDownsampleFactor, screenProbeViewSize() - 2);
+}
+
+// 找到该点对应的4个uniform probe
+void CalculateUniformUpsampleInterpolationWeights(ivec2 screenCoord, vec3 wsPosition, float sceneDepth, vec3 worldNormal, ivec2 tile00, out vec4 interpolationWeights){
+
+	ivec2 screenProbeFullResScreenCoord = ivec2(clamp(screenCoord.x, 0.0f, viewport_width - 1.0f), clamp(screenCoord.y, 0.0f, viewport_height - 1.0f));
+    int tileSize = screenProbeDownsampleFactor;
+
+	int bilinearExpand = 1;
+	vec2 bilinearWeights = (screenProbeFullResScreenCoord - tile00 * tileSize + bilinearExpand) / (float)(tileSize + 2 * bilinearExpand);
+
+	interpolationWeights = vec4(
+		(1 - bilinearWeights.y) * (1 - bilinearWeights.x),
+		(1 - bilinearWeights.y) * bilinearWeights.x,
+		bilinearWeights.y * (1 - bilinearWeights.x),
+		bilinearWeights.y * bilinearWeights.x);
+
+    vec4 scenePlane = vec4(worldNormal, dot(wsPosition, worldNormal));
+
+    vec4 corner00 = screenTileTableFetch(tile00, 0, SCREEN_TILE_TABLE_UNIFORM_PROBE);
+    vec4 corner10 = screenTileTableFetch(tile00, 1, SCREEN_TILE_TABLE_UNIFORM_PROBE);
+    vec4 corner01 = screenTileTableFetch(tile00, 2, SCREEN_TILE_TABLE_UNIFORM_PROBE);
+    vec4 corner11 = screenTileTableFetch(tile00, 3, SCREEN_TILE_TABLE_UNIFORM_PROBE);
+
+    vec4 cornerDepths = vec4(corner00.w, corner10.w, corner01.w, corner11.w);
+
+    vec4 planeDistances;
+    planeDistances.x = abs(dot(vec4(corner00.xyz, -1), scenePlane)); // 法线上投影的距离
+    planeDistances.y = abs(dot(vec4(corner10.xyz, -1), scenePlane));
+    planeDistances.z = abs(dot(vec4(corner01.xyz, -1), scenePlane));
+    planeDistances.w = abs(dot(vec4(corner11.xyz, -1), scenePlane));
+
+    vec4 relativeDepthDifference = planeDistances / sceneDepth;
+
+    // cornerDepths 没有实际贡献，因为均匀采样各点距shading point距离相同
+    vec4 depthWeights = all(greaterThan(cornerDepths, vec4(0))) ? exp2(-10000.0f * (relativeDepthDifference * relativeDepthDifference)) : vec4(0,0,0,0);
+
+    interpolationWeights *= depthWeights;
+}
+
+
+void CalculateUpsampleInterpolationWeights(ivec2 screenCoord, vec3 wsPosition, float sceneDepth, vec3 worldNormal, out FScreenProbeSample screenProbeSample){
+
+    ivec2 tile00 = screenTileCoord00(screenCoord);
+    CalculateUniformUpsampleInterpolationWeights(screenCoord, wsPosition, sceneDepth, worldNormal, tile00, screenProbeSample.weights);
+    screenProbeSample.AltasCoord[0] = tile00;
+	screenProbeSample.AltasCoord[1] = tile00 + ivec2(1, 0);
+	screenProbeSample.AltasCoord[2] = tile00 + ivec2(0, 1);
+	screenProbeSample.AltasCoord[3] = tile00 + ivec2(1, 1);
+
+    float epsilon = .01f;
+    vec4 scenePlane = vec4(worldNormal, dot(wsPosition, worldNormal));
+
+    int uniformProbeCountX = screenProbeViewSize().x;
+    int uniformProbeCount = uniformProbeCountX * screenProbeViewSize().y;
+
+    // 上面拿到了均匀的probe的weight下面看看用adaptive的probe会不会更好
+    // 替换掉4个均匀probe的其中一个
+    for (int cornerIndex = 0; cornerIndex < 4; cornerIndex++)
+    {
+        // 如果四个中的其中一个权重太小，则由adaptive替换
+        if (screenProbeSample.weights[cornerIndex] <= epsilon)
+        {
+            // 这个被替换的tile中有多少个adaptive probe
+            int numAdaptiveProbes = int(screenTileTableFetch(tile00, cornerIndex, SCREEN_TILE_TABLE_HEADER).r);
+
+            // 之前已经计算过均匀的probe带来的weight，下面试试取Adaptive probe插值
+            for (int adaptiveProbeListIndex = 0; adaptiveProbeListIndex < numAdaptiveProbes; adaptiveProbeListIndex++)
+            {
+                vec4 probePositionAndIndex = screenTileTableFetch(tile00, cornerIndex, SCREEN_TILE_TABLE_ADAPTIVE_PROBE(adaptiveProbeListIndex));
+                ivec2 screenProbeScreenPosition = ivec2(screenTileTableFetch(tile00, cornerIndex, SCREEN_TILE_TABLE_ADAPTIVE_PROBE(adaptiveProbeListIndex) + 1).xy);
+                int adaptiveProbeIndex = int(probePositionAndIndex.w);
+
+                ivec2 screenProbeAltasCoord = ivec2((adaptiveProbeIndex + uniformProbeCount) % uniformProbeCountX,
+                                                    (adaptiveProbeIndex + uniformProbeCount) / uniformProbeCountX);
+
+                float planeDistance = abs(dot(vec4(probePositionAndIndex.xyz, -1), scenePlane)); // 投影到平面法向量上的长度 scenePlane.w = wsposition . wsnormal
+                float relativeDepthDifference = planeDistance / sceneDepth;
+                float newDepthWeight = exp2(-10000.0f * (relativeDepthDifference * relativeDepthDifference));
+
+                vec2 distanceToScreenProbe = abs(screenProbeScreenPosition - screenCoord); // 屏幕空间上的距离
+                float newCornerWeight = 1.0f - clamp(min(distanceToScreenProbe.x, distanceToScreenProbe.y) / (float) screenProbeDownsampleFactor, 0,1);
+                float newInterpolationWeight = newDepthWeight * newCornerWeight;
+
+                if (newInterpolationWeight > screenProbeSample.weights[cornerIndex])
+                {
+                    screenProbeSample.weights[cornerIndex] = newInterpolationWeight;
+                    screenProbeSample.AltasCoord[cornerIndex] = screenProbeAltasCoord;
+                }
+            }
+        }
+    }
+}
+
+Irradiance3 GetScreenProbeIrradiance(sampler2D screenProbeIrradiance, ivec2 screenProbeAltasCoord, float2 IrradianceProbeUV)
+{
+    float probeSideWithBorder = 10.0f;
+    float probeSide = 8.0f;
+    float2 screenProbeAtlasBufferSize = float2(viewport_width/screenProbeDownsampleFactor,
+                                                viewport_height/screenProbeDownsampleFactor);
+    float2 IrradianceProbeUVCoord = IrradianceProbeUV * probeSide + 1.0f;
+	float2 AtlasUV = (screenProbeAltasCoord * probeSideWithBorder + IrradianceProbeUVCoord) /
+                     (screenProbeAtlasBufferSize * probeSideWithBorder);
+    return texture(screenProbeIrradiance, AtlasUV).rgb;
+}
+
+/** Interpolated screen probe irradiance at a G-buffer sample */
+Irradiance3 gatherScreenProbeIrradiance(sampler2D screenProbeIrradiance, ivec2 screenCoord, vec3 wsPos, float depth, vec3 wsNormal)
+{
+    FScreenProbeSample screenProbeSample;
+    CalculateUpsampleInterpolationWeights(screenCoord, wsPos, depth, wsNormal, screenProbeSample);
+    float epsilon = .01f;
+    screenProbeSample.weights /= max(dot(screenProbeSample.weights, vec4(1,1,1,1)), epsilon);
+
+    vec2 normalizedOctCoord = octEncode(normalize(wsNormal));
+    vec2 irradianceProbeUV = (normalizedOctCoord + vec2(1.0f)) * 0.5f; // 0-1
+
+    Irradiance3 irradiance = GetScreenProbeIrradiance(screenProbeIrradiance, screenProbeSample.AltasCoord[0], irradianceProbeUV) * screenProbeSample.weights.x;
+    irradiance += GetScreenProbeIrradiance(screenProbeIrradiance, screenProbeSample.AltasCoord[1], irradianceProbeUV) * screenProbeSample.weights.y;
+	irradiance += GetScreenProbeIrradiance(screenProbeIrradiance, screenProbeSample.AltasCoord[2], irradianceProbeUV) * screenProbeSample.weights.z;
+	irradiance += GetScreenProbeIrradiance(screenProbeIrradiance, screenProbeSample.AltasCoord[3], irradianceProbeUV) * screenProbeSample.weights.w;
+    return irradiance;
+}
+
+#endif
+
+#endif
@@ -4,15 +4,33 @@ G3D_START_AT_MAIN();
 
 int main(int argc, const char* argv[])
 {
+	const GridBaker::Specification& bake = GridBaker::Specification::fromCommandLine(argc, argv);
+	if (bake.enabled && !bake.isWorker()) {
+		// The coordinator only starts the workers and merges their output
+		return GridBaker::run(bake, argc, argv);
+	}
+
+	// Before anything loads the GL driver
+	ShaderCache::configure(ShaderCache::Specification::fromCommandLine(argc, argv));
+
 	initGLG3D(G3DSpecification());
 
 	GApp::Settings settings(argc, argv);
+	const AutoTuner::Specification& tuning = AutoTuner::Specification::fromCommandLine(argc, argv);
+	// Tuning runs are benchmark runs
+	const Benchmark::Specification& benchmark = tuning.benchmark;
+	Telemetry::configure(Telemetry::Specification::fromCommandLine(argc, argv));
+	const ProbeCache::Specification& probeCache = ProbeCache::Specification::fromCommandLine(argc, argv);
+	const BatchRenderer::Specification& batch = BatchRenderer::Specification::fromCommandLine(argc, argv);
+	alwaysAssertM(!(batch.enabled && benchmark.enabled), "--batch and --benchmark are exclusive");
 
 	settings.window.caption = argv[0];
 
 	settings.window.fullScreen = false;
-	settings.window.width = 1600;
-	settings.window.height = 960;
+	settings.window.width = benchmark.enabled ? benchmark.width : batch.enabled ? batch.width : 1600;
+	settings.window.height = benchmark.enabled ? benchmark.height : batch.enabled ? batch.height : 960;
+	// Headless runs only need the GL context
+	settings.window.visible = !benchmark.enabled && !batch.enabled && !bake.enabled;
 	settings.window.resizable = !settings.window.fullScreen;
 	settings.window.framed = !settings.window.fullScreen;
 	settings.window.defaultIconFilename = "icon.png";
@@ -31,12 +49,29 @@ int main(int argc, const char* argv[])
 	settings.screenCapture.includeG3DRevision = false;
 	settings.screenCapture.filenamePrefix = "_";
 
-	return App(settings).run();
+	return App(settings, benchmark, probeCache, tuning, batch, bake).run();
 }
 
 
-App::App(const GApp::Settings& settings) : GApp(settings)
+App::App(const GApp::Settings& settings, const Benchmark::Specification& benchmark, const ProbeCache::Specification& probeCache, const AutoTuner::Specification& tuning, const BatchRenderer::Specification& batch, const GridBaker::Specification& bake) :
+	GApp(settings), m_probeCacheSpecification(probeCache)
 {
+	if (tuning.enabled) {
+		m_autoTuner = AutoTuner::create(tuning);
+		m_benchmark = Benchmark::create(m_autoTuner->benchmarkSpecification());
+		m_probeCacheSpecification.enabled = false;
+	} else if (benchmark.enabled) {
+		m_benchmark = Benchmark::create(benchmark);
+		// Every run must start from the same unconverged state
+		m_probeCacheSpecification.enabled = false;
+	} else if (batch.enabled) {
+		m_batchRenderer = BatchRenderer::create(batch);
+		// Converge frames replace the cache, and a sequence must not depend on an earlier run
+		m_probeCacheSpecification.enabled = false;
+	} else if (bake.enabled) {
+		m_gridBaker = GridBaker::create(bake);
+		m_probeCacheSpecification.enabled = false;
+	}
 }
 
 void App::onInit()
@@ -44,71 +79,246 @@ void App::onInit()
 	GApp::onInit();
 
 	setFrameDuration(1.0f / 240.0f);
+	if (notNull(m_batchRenderer)) {
+		// Render as fast as the hardware allows; scene time still advances at the sequence rate
+		setFrameDuration(0.0f, m_batchRenderer->simulationTimeStep());
+		setSubmitToDisplayMode(SubmitToDisplayMode::MAXIMIZE_THROUGHPUT);
+	}
+
+	GBufferProfile::applyToMainView(m_gbufferSpecification, m_gbufferProfile);
+	// Motion vectors in pixels for the indirect temporal accumulation
+	m_gbufferSpecification.encoding[GBuffer::Field::SS_POSITION_CHANGE] = Texture::Encoding(ImageFormat::RG16F(), FrameName::SCREEN, 1.0f, 0.0f);
 
-	m_gbufferSpecification.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA32F();
-	m_gbufferSpecification.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA32F();
-	m_gbufferSpecification.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::RGBA32F();
-	m_gbufferSpecification.encoding[GBuffer::Field::WS_POSITION].format = ImageFormat::RGBA32F();
-	m_gbufferSpecification.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA32F(), FrameName::CAMERA, 1.0f, 0.0f);
+	GBufferProfile::logMemoryComparison(m_gbufferSpecification);
 
 	m_pGIRenderer = dynamic_pointer_cast<CGIRenderer>(CGIRenderer::create());
 	m_pGIRenderer->setDeferredShading(true);
 	m_pGIRenderer->setOrderIndependentTransparency(true);
 
+	m_pProbeDebugRenderer = ProbeDebugRenderer::create();
+	m_views.append(ScreenProbeView::create("Main", activeCamera(), m_gbuffer));
+
 	//String SceneName = "Dragon (Dynamic Light Source)";
 	//String SceneName = "G3D Breakfast Room";
 	String SceneName = "G3D Living Room (Area Lights)";
 	//String SceneName = "G3D Living Room";
 	//String SceneName = "BathRoom";
 	//String SceneName = "Living Room (Screen Probe)";
+	if (notNull(m_benchmark)) {
+		SceneName = m_benchmark->specification().sceneName;
+	} else if (notNull(m_batchRenderer)) {
+		SceneName = m_batchRenderer->specification().sceneName;
+	} else if (notNull(m_gridBaker)) {
+		SceneName = m_gridBaker->specification().sceneName;
+	}
 	loadScene(SceneName);
 	//m_activeCamera = m_debugCamera;
 
 	m_renderer = m_pGIRenderer;
 	
 	makeGUI();
+
+	if (notNull(m_benchmark)) {
+		debugWindow->setVisible(false);
+		developerWindow->setVisible(false);
+		showRenderingStats = false;
+		m_benchmark->begin(activeCamera()->frame());
+	}
+
+	if (notNull(m_batchRenderer)) {
+		debugWindow->setVisible(false);
+		developerWindow->setVisible(false);
+		showRenderingStats = false;
+		m_batchRenderer->begin(activeCamera()->frame());
+	}
+}
+
+void App::onAfterSimulation(RealTime rdt, SimTime sdt, SimTime idt)
+{
+	GApp::onAfterSimulation(rdt, sdt, idt);
+
+	// Same frame boundary as the benchmark: the profiler has just resolved the last frame
+	ResourceTracker::endFrame();
+	Telemetry::endFrame();
+
+	if (notNull(m_batchRenderer)) {
+		if (m_batchRenderer->done()) {
+			m_batchRenderer->finish();
+			setExitCode(0);
+			return;
+		}
+		activeCamera()->setFrame(m_batchRenderer->cameraFrame());
+	}
+
+	if (isNull(m_benchmark)) {
+		return;
+	}
+
+	// The profiler events available now belong to the frame that produced m_benchmarkCounters
+	if (!m_firstFrame) {
+		m_benchmark->endFrame(m_benchmarkCounters);
+	}
+
+	if (m_benchmark->done() && notNull(m_autoTuner)) {
+		m_autoTuner->endTrial(*m_benchmark);
+		if (m_autoTuner->done()) {
+			m_autoTuner->writeResults();
+			setExitCode(0);
+		} else {
+			startTuningRun();
+		}
+		return;
+	}
+
+	if (m_benchmark->done()) {
+		m_benchmark->writeResults();
+		setExitCode(m_benchmark->passed() ? 0 : 1);
+		return;
+	}
+
+	// Keeps previousFrame() so the motion vectors see the spline motion
+	activeCamera()->setFrame(m_benchmark->cameraFrame());
+}
+
+void App::startTuningRun()
+{
+	m_benchmark = Benchmark::create(m_autoTuner->benchmarkSpecification());
+	// Restores the default camera and fresh GI state; the TriTree is reused
+	loadScene(m_benchmark->specification().sceneName);
+	m_firstFrame = true;
+	m_benchmark->begin(activeCamera()->frame());
+}
+
+void App::warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surface3D, const Array<shared_ptr<ScreenProbeView>>& views)
+{
+	if (views.size() == 0) {
+		return;
+	}
+
+	const RealTime start = System::time();
+	bool launched = m_pIrradianceField->warmUpShaders(rd, surface3D);
+	launched = m_pRadianceCache->warmUpShaders(rd, surface3D) || launched;
+	launched = m_pGIRenderer->warmUpShaders(rd, views[0]) || launched;
+
+	if (launched) {
+		const RealTime duration = System::time() - start;
+		Telemetry::set("shaders.warmUpMs", duration * 1000.0);
+		debugPrintf("App: warmed up shader variants in %.1f ms\n", duration * 1000.0);
+	}
 }
 
 void App::onGraphics3D(RenderDevice * rd, Array<shared_ptr<Surface>>& surface3D)
 {
+	if (notNull(m_gridBaker)) {
+		// A bake worker renders nothing; it bakes its shard on the first frame and exits
+		m_gridBaker->bakeShard(rd, *m_pIrradianceField, surface3D);
+		setExitCode(0);
+		return;
+	}
+
 	if (m_pIrradianceField)
 	{
 
 		
 		if (!m_firstFrame) {
 
-			if (activeCamera()->lastChangeTime() != last_view) {
+			// The active camera may have been switched
+			m_views[0]->camera = activeCamera();
+			m_views[0]->gbuffer = m_gbuffer;
+
+			// A view joins once its G-buffer holds a frame to place probes from
+			Array<shared_ptr<ScreenProbeView>> views;
+			for (const shared_ptr<ScreenProbeView>& view : m_views)
+			{
+				if (!view->hasGBuffer()) {
+					continue;
+				}
+				if (view->camera->lastChangeTime() != view->lastPlacementTime) {
+					view->lastPlacementTime = view->camera->lastChangeTime();
+					view->clear();
+					view->adaptivePlacement();
+				}
+				views.append(view);
+			}
 
-				last_view = activeCamera()->lastChangeTime();
-				cleanScreenProbe();
-				screenProbeAdaptivePlacement();
-				//screenProbeDebugDraw();
+			// One ray batch for the screen probes of all views
+			m_pIrradianceField->onGraphics3D(rd, surface3D, views);
 
+			// Also needed by the warm-up while the tree is built
+			if (views.size() > 0) {
+				m_pRadianceCache->setupInputs(views);
 			}
 
-			m_pIrradianceField->onGraphics3D(rd, surface3D, 
-				screenProbeWSAdaptivePositionTexture, 
-				screenProbeWSUniformPositionTexture, 
-				screenProbeSSAdaptivePositionTexture,
-				numAdaptiveScreenProbesTexture, 
-				screenTileAdaptiveProbeHeaderTexture, 
-				screenTileAdaptiveProbeIndicesTexture, 
-				m_gbuffer);
-
-			m_pRadianceCache->setupInputs(activeCamera(),
-				screenProbeWSAdaptivePositionTexture,
-				screenProbeSSAdaptivePositionTexture,
-				numAdaptiveScreenProbesTexture,
-				m_gbuffer);
-			m_pRadianceCache->onGraphics3D(rd, surface3D);
-			m_pRadianceCache->debugDraw();
+			// The radiance cache traces against the same tree
+			if ((m_pIrradianceField->lightingMode() != LightingMode::DIRECT_ONLY) && (views.size() > 0)) {
+				m_pRadianceCache->onGraphics3D(rd, surface3D);
+			}
+
+			// Last, so that the variants the radiance cache and the pager enable this frame are
+			// compiled before the next one uses them
+			warmUpShaders(rd, surface3D, views);
 		}
 
 		
 	}
 
+	renderExtraViews(rd, surface3D);
+
+	const bool captureIndirect = notNull(m_benchmark) && m_benchmark->wantsIndirectCapture();
+	m_pGIRenderer->setCaptureIndirect(captureIndirect);
+
 	GApp::onGraphics3D(rd, surface3D);
 
+	if (captureIndirect && notNull(m_pGIRenderer->capturedIndirect())) {
+		m_benchmark->onIndirectCaptured(rd, m_pGIRenderer->capturedIndirect());
+	}
+
+	// The first frame has no GI and does not count as a converge frame
+	if (notNull(m_batchRenderer) && !m_firstFrame) {
+		m_batchRenderer->endFrame(m_framebuffer->texture(0));
+	}
+
+	if (notNull(m_pIrradianceField) && notNull(m_views[0]->screenProbeWSUniformPositionTexture)) {
+		// Summed over all views, which share the ray batch
+		m_benchmarkCounters.uniformProbes = 0;
+		m_benchmarkCounters.adaptiveProbes = 0;
+		for (const shared_ptr<ScreenProbeView>& view : m_views) {
+			m_benchmarkCounters.uniformProbes += view->uniformProbeCount();
+			m_benchmarkCounters.adaptiveProbes += view->adaptiveProbeCount;
+		}
+		m_benchmarkCounters.irradianceRays = notNull(m_pIrradianceField->m_screenProbeRays.origins) ?
+			int64(m_pIrradianceField->m_screenProbeRays.origins->width()) * m_pIrradianceField->m_screenProbeRays.origins->height() : 0;
+		m_benchmarkCounters.radianceCacheRays = notNull(m_pRadianceCache->m_radianceRayOrigins) ?
+			int64(m_pRadianceCache->m_radianceRayOrigins->width()) * m_pRadianceCache->m_radianceRayOrigins->height() : 0;
+
+		Telemetry::set("screenProbes.uniform", m_benchmarkCounters.uniformProbes);
+		Telemetry::set("screenProbes.adaptive", m_benchmarkCounters.adaptiveProbes);
+		Telemetry::set("screenProbes.views", m_views.size());
+		Telemetry::set("rays.total", double(m_benchmarkCounters.irradianceRays + m_benchmarkCounters.radianceCacheRays));
+	}
+
+	if (m_showTelemetry) {
+		Telemetry::printSummaries();
+	}
+
+	if (m_showMemory) {
+		// GApp reallocates the main G-buffer on resize
+		ResourceTracker::trackGBuffer("GBuffer", m_gbuffer);
+		for (int i = 1; i < m_views.size(); ++i) {
+			ResourceTracker::trackGBuffer("GBuffer", m_views[i]->gbuffer);
+		}
+		ResourceTracker::printUsage();
+	}
+
+	if (m_probeCacheSpecification.enabled && (m_probeCacheSpecification.autosaveInterval > 0) && notNull(m_pIrradianceField) &&
+		(System::time() - m_lastProbeCacheSave > m_probeCacheSpecification.autosaveInterval)) {
+		// The first pass only starts the clock, so the unconverged startup state is never saved
+		if (m_lastProbeCacheSave > 0) {
+			m_pIrradianceField->saveProbeCache(activeCamera()->frame());
+		}
+		m_lastProbeCacheSave = System::time();
+	}
+
 	if (m_firstFrame) {
 		m_firstFrame = false;
 		
@@ -116,8 +326,44 @@ void App::onGraphics3D(RenderDevice * rd, Array<shared_ptr<Surface>>& surface3D)
 	}
 }
 
+void App::onPostProcessHDR3DEffects(RenderDevice* rd)
+{
+	GApp::onPostProcessHDR3DEffects(rd);
+
+	// Extra views as insets along the bottom right, before tone mapping
+	if (m_extraViewFramebuffers.size() > 0) {
+		rd->push2D(m_framebuffer); {
+			Point2 corner(rd->viewport().width(), rd->viewport().height());
+			for (const shared_ptr<Framebuffer>& framebuffer : m_extraViewFramebuffers) {
+				corner.x -= framebuffer->width();
+				Draw::rect2D(Rect2D::xywh(corner - Vector2(0.0f, float(framebuffer->height())), Vector2(float(framebuffer->width()), float(framebuffer->height()))), rd, Color3::white(), framebuffer->texture(0));
+			}
+		} rd->pop2D();
+	}
+
+	if (!m_pProbeDebugRenderer->enabled()) {
+		return;
+	}
+
+	const ScreenProbeView& view = *m_views[0];
+	rd->pushState(m_framebuffer); {
+		rd->setProjectionAndCameraMatrix(activeCamera()->projection(), activeCamera()->frame());
+		m_pProbeDebugRenderer->render(rd,
+			view.screenProbeWSUniformPositionTexture,
+			view.screenProbeWSAdaptivePositionTexture,
+			view.numAdaptiveScreenProbesTexture,
+			notNull(m_pRadianceCache) ? m_pRadianceCache->RadianceProbeWorldPosition : nullptr,
+			notNull(m_pRadianceCache) ? m_pRadianceCache->NumRadianceProbe : nullptr);
+	} rd->popState();
+}
+
+/** CPU reference for ProbeDebugRenderer. Reads every probe back, so only call it while debugging. */
 void App::screenProbeDebugDraw() {
 
+	const shared_ptr<Texture>& screenProbeWSUniformPositionTexture = m_views[0]->screenProbeWSUniformPositionTexture;
+	const shared_ptr<Texture>& screenProbeWSAdaptivePositionTexture = m_views[0]->screenProbeWSAdaptivePositionTexture;
+	const shared_ptr<Texture>& numAdaptiveScreenProbesTexture = m_views[0]->numAdaptiveScreenProbesTexture;
+
 	int probeCountX = screenProbeWSUniformPositionTexture->width();
 	int probeCountY = screenProbeWSUniformPositionTexture->height();
 	shared_ptr<Image> screenProbeWSPositionImg = screenProbeWSUniformPositionTexture->toImage();
@@ -137,11 +383,11 @@ void App::screenProbeDebugDraw() {
 		}
 	}
 
-	shared_ptr<GLPixelTransferBuffer> numAdaptiveScreenProbesImg = numAdaptiveScreenProbesTexture->toPixelTransferBuffer();
+	shared_ptr<GLPixelTransferBuffer> numAdaptiveScreenProbesImg = ResourceTracker::readback("App", numAdaptiveScreenProbesTexture);
 	int *adaptiveProbeCount = (int*)numAdaptiveScreenProbesImg->mapRead();
 	numAdaptiveScreenProbesImg->unmap();
 
-	shared_ptr<GLPixelTransferBuffer> screenProbeWSAdaptivePositionImg = screenProbeWSAdaptivePositionTexture->toPixelTransferBuffer();
+	shared_ptr<GLPixelTransferBuffer> screenProbeWSAdaptivePositionImg = ResourceTracker::readback("App", screenProbeWSAdaptivePositionTexture);
 	float* adaptiveProbeList = (float*)screenProbeWSAdaptivePositionImg->mapRead();
 	//Vector4unorm8 * adaptiveProbeList = (Vector4unorm8*)screenProbeWSAdaptivePositionImg->mapRead();
 	screenProbeWSAdaptivePositionImg->unmap();
@@ -161,10 +407,58 @@ void App::screenProbeDebugDraw() {
 
 void App::onAfterLoadScene(const Any & any, const String & sceneName)
 {
+	// The scene Any names every model and its initial frame, which is all the TriTree holds. The
+	// model files themselves may be re-exported while the scene text stays the same.
+	const uint64 sceneHash = ProbeCache::sceneHash(any);
+
 	m_pIrradianceField = IrradianceField::create(sceneName, scene());
-	m_pIrradianceField->onSceneChanged(scene());
+	if (notNull(m_autoTuner)) {
+		m_autoTuner->configure(*m_pIrradianceField);
+	}
+	// Benchmark timings and batch frames must not depend on when a background build finishes
+	m_pIrradianceField->setBackgroundBuild(isNull(m_benchmark) && isNull(m_batchRenderer) && isNull(m_gridBaker));
+	m_pIrradianceField->onSceneChanged(scene(), sceneHash);
 	m_pGIRenderer->setIrradianceField(m_pIrradianceField);
+	for (const shared_ptr<ScreenProbeView>& view : m_views) {
+		view->giHistoryValid = false;
+	}
 	m_pRadianceCache = std::make_shared<RadianceCache>();
+	m_pIrradianceField->setRadianceCache(m_pRadianceCache);
+	m_pRadianceCache->setIrradianceField(m_pIrradianceField);
+	m_pIrradianceField->setGBufferProfile(m_gbufferProfile);
+	m_pRadianceCache->setGBufferProfile(m_gbufferProfile);
+
+	// Paged probe volumes stream their bricks through the same directory
+	m_pIrradianceField->setBrickCacheDirectory(m_probeCacheSpecification.enabled ? FilePath::concat(m_probeCacheSpecification.directory, "bricks") : "");
+
+	if (m_probeCacheSpecification.enabled) {
+		const uint64 key = m_pIrradianceField->probeCacheKey(sceneHash);
+		m_pIrradianceField->requestProbeCacheRestore(ProbeCache::filename(m_probeCacheSpecification.directory, sceneName, key), key);
+	}
+}
+
+void App::onCleanup()
+{
+	if (m_probeCacheSpecification.enabled && notNull(m_pIrradianceField)) {
+		m_pIrradianceField->saveProbeCache(activeCamera()->frame());
+	}
+	// Static, so it would otherwise outlive the GL context
+	IrradianceField::clearTriTreeCache();
+	GApp::onCleanup();
+}
+
+void App::setGBufferProfile(GBufferProfile::Value profile)
+{
+	m_gbufferProfile = profile;
+	GBufferProfile::applyToMainView(m_gbufferSpecification, profile);
+	m_gbuffer->setSpecification(m_gbufferSpecification);
+
+	if (notNull(m_pIrradianceField)) {
+		m_pIrradianceField->setGBufferProfile(profile);
+	}
+	if (notNull(m_pRadianceCache)) {
+		m_pRadianceCache->setGBufferProfile(profile);
+	}
 }
 
 void App::makeGUI()
@@ -172,130 +466,109 @@ void App::makeGUI()
 	debugWindow->setVisible(true);
 	developerWindow->videoRecordDialog->setEnabled(true);
 
+	// The irradiance field is recreated on every scene load, so go through m_pIrradianceField each time
+	debugPane->addCheckBox("Short-range probe rays",
+		Pointer<bool>([this]() { return notNull(m_pIrradianceField) && m_pIrradianceField->m_specification.shortRangeTrace; },
+			[this](bool b) { if (notNull(m_pIrradianceField)) { m_pIrradianceField->m_specification.shortRangeTrace = b; } }));
+	debugPane->addCheckBox("Light-change invalidation",
+		Pointer<bool>([this]() { return notNull(m_pIrradianceField) && m_pIrradianceField->m_specification.lightChangeInvalidation; },
+			[this](bool b) { if (notNull(m_pIrradianceField)) { m_pIrradianceField->m_specification.lightChangeInvalidation = b; } }));
+	debugPane->addCheckBox("Geometry-change invalidation",
+		Pointer<bool>([this]() { return notNull(m_pIrradianceField) && m_pIrradianceField->m_specification.geometryChangeInvalidation; },
+			[this](bool b) { if (notNull(m_pIrradianceField)) { m_pIrradianceField->m_specification.geometryChangeInvalidation = b; } }));
+	debugPane->addCheckBox("Importance-sampled probe rays",
+		Pointer<bool>([this]() { return notNull(m_pIrradianceField) && m_pIrradianceField->m_specification.importanceSampling; },
+			[this](bool b) { if (notNull(m_pIrradianceField)) { m_pIrradianceField->m_specification.importanceSampling = b; } }));
+
+	debugPane->addCheckBox("Show uniform probes", &m_pProbeDebugRenderer->showUniformProbes);
+	debugPane->addCheckBox("Show adaptive probes", &m_pProbeDebugRenderer->showAdaptiveProbes);
+	debugPane->addCheckBox("Show world probes", &m_pProbeDebugRenderer->showWorldProbes);
+	debugPane->addNumberBox("Extra views",
+		Pointer<int>([this]() { return m_views.size() - 1; },
+			[this](int n) { setExtraViewCount(n); }), "", GuiTheme::LINEAR_SLIDER, 0, 3);
+
+	// Index i gathers at 1 / 2^i resolution
+	debugPane->addDropDownList("Indirect gather", Array<String>("Full", "Half", "Quarter"),
+		Pointer<int>([this]() { return highestBit(uint32(m_pGIRenderer->gatherDownsampleFactor())); },
+			[this](int i) { m_pGIRenderer->setGatherDownsampleFactor(1 << i); }));
+	debugPane->addCheckBox("Measure gather error",
+		Pointer<bool>([this]() { return m_pGIRenderer->measureGatherError(); },
+			[this](bool b) { m_pGIRenderer->setMeasureGatherError(b); }));
+
+	debugPane->addDropDownList("G-buffer", Array<String>("Full precision", "Packed"),
+		Pointer<int>([this]() { return int(m_gbufferProfile); },
+			[this](int i) { setGBufferProfile(GBufferProfile::Value(i)); }));
+
+	debugPane->addCheckBox("Temporal accumulation",
+		Pointer<bool>([this]() { return m_pGIRenderer->temporalAccumulation(); },
+			[this](bool b) { m_pGIRenderer->setTemporalAccumulation(b); }));
+	debugPane->addNumberBox("Temporal alpha",
+		Pointer<float>([this]() { return m_pGIRenderer->temporalAlpha(); },
+			[this](float a) { m_pGIRenderer->setTemporalAlpha(a); }), "", GuiTheme::LINEAR_SLIDER, 0.02f, 1.0f);
+	debugPane->addNumberBox("Spatial filter passes",
+		Pointer<int>([this]() { return m_pGIRenderer->spatialFilterIterations(); },
+			[this](int n) { m_pGIRenderer->setSpatialFilterIterations(n); }), "", GuiTheme::LINEAR_SLIDER, 0, 4);
+	debugPane->addCheckBox("Render graph stats",
+		Pointer<bool>([this]() { return m_pGIRenderer->showRenderGraphStats(); },
+			[this](bool b) { m_pGIRenderer->setShowRenderGraphStats(b); }));
+	// Collection stays on while exporting even if the overlay is hidden
+	debugPane->addCheckBox("GI telemetry",
+		Pointer<bool>([this]() { return m_showTelemetry; },
+			[this](bool b) { m_showTelemetry = b; if (b) { Telemetry::setEnabled(true); } }));
+	debugPane->addCheckBox("GI memory", &m_showMemory);
+	debugPane->addButton("Log GI resources", []() { ResourceTracker::logResources(); });
+
 	debugWindow->pack();
 	debugWindow->setRect(Rect2D::xywh(0, 0, (float)window()->width(), debugWindow->rect().height()));
 }
 
-void App::screenProbeAdaptivePlacement() {
-
-	//if (m_staticProbe) {
-		int placementDownsampleFactor = 16;
-		int screenProbeDownsampleFactor = placementDownsampleFactor;
-		screenProbeUniformPlacement(placementDownsampleFactor);
-
-		int minDownsampleFactor = 4;
-		// float maxAdaptiveFactor = 0.5f; // adaptiveΪuniform0.5
-
-		// TODO View Change Clean
-
-		// RW Buffer
-		// World position
-		screenProbeWSAdaptivePositionTexture = Texture::createEmpty("AdaptiveProbeWsPosition", m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor * maxAdaptiveFactor, ImageFormat::RGBA32F());
-		shared_ptr<GLPixelTransferBuffer>& adaptiveProbeWSPosBuffer = GLPixelTransferBuffer::create(m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor * maxAdaptiveFactor, ImageFormat::RGBA32F());
-		// Screen position
-		screenProbeSSAdaptivePositionTexture = Texture::createEmpty("AdaptiveProbeSsPosition", m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor * maxAdaptiveFactor, ImageFormat::RGBA32F());
-		shared_ptr<GLPixelTransferBuffer>& adaptiveProbeSSPosBuffer = GLPixelTransferBuffer::create(m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor * maxAdaptiveFactor, ImageFormat::RGBA32F());
-		// Header
-		screenTileAdaptiveProbeHeaderTexture = Texture::createEmpty("ScreenTileAdaptiveProbeHeader", m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor, ImageFormat::R32UI());
-		shared_ptr<GLPixelTransferBuffer>& screenTileAdaptiveProbeHeaderBuffer = GLPixelTransferBuffer::create(m_settings.window.width / placementDownsampleFactor, m_settings.window.height / placementDownsampleFactor, ImageFormat::R32UI());
-		// Index
-		screenTileAdaptiveProbeIndicesTexture = Texture::createEmpty("ScreenTileAdaptiveProbeIndices", m_settings.window.width, m_settings.window.height, ImageFormat::R32UI());
-		shared_ptr<GLPixelTransferBuffer>& screenTileAdaptiveProbeIndicesBuffer = GLPixelTransferBuffer::create(m_settings.window.width, m_settings.window.height, ImageFormat::R32UI());
-		// Num
-		numAdaptiveScreenProbesTexture = Texture::createEmpty("NumAdaptiveScreenProbes", 1, 1, ImageFormat::R32UI());
-		shared_ptr<GLPixelTransferBuffer>& numAdaptiveScreenProbesBuffer = GLPixelTransferBuffer::create(1, 1, ImageFormat::R32UI());
-		
-		do {
-			placementDownsampleFactor /= 2;
-			Args args;
-
-			// GroupSize & GroupNum
-			const Vector3int32 blockSize(16, 16, 1);
-			args.setComputeGridDim(Vector3int32(iCeil(m_settings.window.width / (float(blockSize.x) * placementDownsampleFactor)),
-				iCeil(m_settings.window.height / (float(blockSize.y) * placementDownsampleFactor)), 1));
-			args.setComputeGroupSize(blockSize);
-
-			adaptiveProbeWSPosBuffer->bindAsShaderStorageBuffer(0);
-			adaptiveProbeSSPosBuffer->bindAsShaderStorageBuffer(1);
-			screenTileAdaptiveProbeHeaderBuffer->bindAsShaderStorageBuffer(2);
-			screenTileAdaptiveProbeIndicesBuffer->bindAsShaderStorageBuffer(3);
-			numAdaptiveScreenProbesBuffer->bindAsShaderStorageBuffer(4);
-
-			args.setUniform("placementDownsampleFactor", placementDownsampleFactor);
-			args.setUniform("screenProbeDownsampleFactor", screenProbeDownsampleFactor);
-			args.setUniform("viewport_width", (float)m_settings.window.width);
-			args.setUniform("viewport_height", (float)m_settings.window.height);
-			args.setUniform("ws_positionTexture", m_gbuffer->texture(GBuffer::Field::WS_POSITION), Sampler::buffer());
-			args.setUniform("depthTexture", m_gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
-			args.setUniform("ws_normalTexture", m_gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
-
-			LAUNCH_SHADER("shaders/ScreenProbeAdaptivePlacement.glc", args);
-
-			screenProbeWSAdaptivePositionTexture->update(adaptiveProbeWSPosBuffer);
-			screenProbeSSAdaptivePositionTexture->update(adaptiveProbeSSPosBuffer);
-			screenTileAdaptiveProbeHeaderTexture->update(screenTileAdaptiveProbeHeaderBuffer);
-			screenTileAdaptiveProbeIndicesTexture->update(screenTileAdaptiveProbeIndicesBuffer);
-			numAdaptiveScreenProbesTexture->update(numAdaptiveScreenProbesBuffer);
-			
-		} while (placementDownsampleFactor > minDownsampleFactor);
-			
+void App::setExtraViewCount(int count)
+{
+	count = iClamp(count, 0, 3);
+	while (m_views.size() - 1 > count) {
+		m_views.pop();
+		m_extraViewFramebuffers.pop();
+	}
 
-		m_staticProbe = false;
-	//}
+	while (m_views.size() - 1 < count) {
+		const String& name = format("View%d", m_views.size());
+		const int width = m_settings.window.width / ExtraViewDownscale;
+		const int height = m_settings.window.height / ExtraViewDownscale;
 
-	
+		const shared_ptr<Camera>& camera = Camera::create(name);
+		camera->copyParametersFrom(activeCamera());
+		// Also resets previousFrame(), which placement reads
+		camera->setFrame(activeCamera()->frame());
 
-}
+		m_views.append(ScreenProbeView::create(name, camera, GBuffer::create(m_gbufferSpecification, "App::" + name + "::GBuffer")));
 
-void App::screenProbeUniformPlacement(int downsampleFactor) {
+		const shared_ptr<Framebuffer>& framebuffer = Framebuffer::create(ResourceTracker::createTexture("App", "App::" + name + "::Color", width, height, ImageFormat::RGBA16F()));
+		framebuffer->set(Framebuffer::DEPTH, ResourceTracker::createTexture("App", "App::" + name + "::Depth", width, height, ImageFormat::DEPTH32()));
+		m_extraViewFramebuffers.append(framebuffer);
+	}
+}
 
-	//m_gbuffer_ws_position = m_gbuffer->texture(GBuffer::Field::WS_POSITION);
-	Args args;
+void App::renderExtraViews(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaces)
+{
+	// Screen-space AO needs a depth peel buffer per view
+	LightingEnvironment environment = scene()->lightingEnvironment();
+	environment.ambientOcclusionSettings.enabled = false;
 
-	// GroupSize & GroupNum
-	const Vector3int32 blockSize(16, 16, 1);
-	args.setComputeGridDim(Vector3int32(iCeil(m_settings.window.width / (float(blockSize.x) * downsampleFactor)),
-		iCeil(m_settings.window.height / (float(blockSize.y) * downsampleFactor)), 1));
-	args.setComputeGroupSize(blockSize);
+	// Only the main view is captured for the benchmark
+	m_pGIRenderer->setCaptureIndirect(false);
 
-	// IO Variable
-	screenProbeWSUniformPositionTexture = Texture::createEmpty("UniformProbeWsPosition", m_settings.window.width / downsampleFactor, m_settings.window.height / downsampleFactor, ImageFormat::RGBA32F());
-	const shared_ptr<GLPixelTransferBuffer>& outputBuffer = GLPixelTransferBuffer::create(m_settings.window.width / downsampleFactor, m_settings.window.height / downsampleFactor, ImageFormat::RGBA32F());
+	for (int i = 1; i < m_views.size(); ++i)
+	{
+		const shared_ptr<ScreenProbeView>& view = m_views[i];
+		const shared_ptr<Framebuffer>& framebuffer = m_extraViewFramebuffers[i - 1];
 
-	outputBuffer->bindAsShaderStorageBuffer(0);
-	args.setUniform("placementDownsampleFactor", downsampleFactor);
-	args.setUniform("viewport_width", (float)m_settings.window.width);
-	args.setUniform("viewport_height", (float)m_settings.window.height);
-	args.setUniform("ws_positionTexture", m_gbuffer->texture(GBuffer::Field::WS_POSITION), Sampler::buffer());
-	args.setUniform("depthTexture", m_gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
-	args.setUniform("ws_normalTexture", m_gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
+		view->gbuffer->setSpecification(m_gbufferSpecification);
+		view->gbuffer->resize(framebuffer->width(), framebuffer->height());
+		view->gbuffer->prepare(rd, view->camera, 0, -(float)previousSimTimeStep(), Vector2int16(0, 0), Vector2int16(0, 0));
 
-	// Run the uniform shader
-	LAUNCH_SHADER("shaders/ScreenProbeUniformPlacement.glc", args);
+		m_pGIRenderer->setView(view);
+		m_renderer->render(rd, view->camera, framebuffer, nullptr, environment, view->gbuffer, surfaces);
+	}
 
-	screenProbeWSUniformPositionTexture->update(outputBuffer);
+	m_pGIRenderer->setView(m_views[0]);
 }
-
-
-void App::cleanScreenProbe() {
-
-	if (screenProbeWSUniformPositionTexture) {
-		screenProbeWSUniformPositionTexture->clear();
-	}
-	if (screenProbeWSAdaptivePositionTexture) {
-		screenProbeWSAdaptivePositionTexture->clear();
-	}
-	if (screenProbeSSAdaptivePositionTexture) {
-		screenProbeSSAdaptivePositionTexture->clear();
-	}
-	if (screenTileAdaptiveProbeHeaderTexture) {
-		screenTileAdaptiveProbeHeaderTexture->clear();
-	}
-	if (screenTileAdaptiveProbeIndicesTexture) {
-		screenTileAdaptiveProbeIndicesTexture->clear();
-	}
-	if (numAdaptiveScreenProbesTexture) {
-		numAdaptiveScreenProbesTexture->clear();
-	}
-	
-}
\ No newline at end of file
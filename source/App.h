@@ -3,38 +3,80 @@
 #include "IrradianceField.h"
 #include "GIRenderer.h"
 #include "RadianceCache.h"
+#include "ProbeDebugRenderer.h"
+#include "Benchmark.h"
+#include "Telemetry.h"
+#include "ResourceTracker.h"
+#include "ProbeCache.h"
+#include "ShaderCache.h"
+#include "AutoTuner.h"
+#include "BatchRenderer.h"
+#include "GridBaker.h"
 
 class App : public GApp
 {
 	shared_ptr<CGIRenderer>     m_pGIRenderer;
 	shared_ptr<IrradianceField> m_pIrradianceField;
 	shared_ptr<RadianceCache> m_pRadianceCache;
+	shared_ptr<ProbeDebugRenderer> m_pProbeDebugRenderer;
 	bool m_firstFrame = true;
-	bool m_staticProbe = true;
-	float maxAdaptiveFactor = 0.5f; // adaptiveΪuniform0.5
+	GBufferProfile::Value m_gbufferProfile = GBufferProfile::FULL_PRECISION;
+
+	/** Null unless started with --benchmark */
+	shared_ptr<Benchmark> m_benchmark;
+	Benchmark::Counters m_benchmarkCounters;
+	/** Null unless started with --tune. Drives one m_benchmark per candidate. */
+	shared_ptr<AutoTuner> m_autoTuner;
+	/** Null unless started with --batch */
+	shared_ptr<BatchRenderer> m_batchRenderer;
+	/** Null unless this process is a --bake-grid worker */
+	shared_ptr<GridBaker> m_gridBaker;
+	/** Prints the Telemetry percentiles on screen */
+	bool m_showTelemetry = false;
+	/** Prints the ResourceTracker totals on screen */
+	bool m_showMemory = false;
+
+	ProbeCache::Specification m_probeCacheSpecification;
+	RealTime m_lastProbeCacheSave = 0;
 
 	//shared_ptr<Texture> m_gbuffer_depth;
 	//shared_ptr<Texture> m_gbuffer_ws_normal;
 	//shared_ptr<Texture> m_gbuffer_ws_position;
-	shared_ptr<Texture> screenProbeWSUniformPositionTexture;
-	shared_ptr<Texture> screenProbeWSAdaptivePositionTexture;
-	shared_ptr<Texture> screenProbeSSAdaptivePositionTexture;
-	shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture;
-	shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture;
-	shared_ptr<Texture> numAdaptiveScreenProbesTexture;
-
-	RealTime last_view;
+
+	/** m_views[0] renders activeCamera() into m_gbuffer. The others share its probe field and
+		radiance cache and are drawn as insets, see renderExtraViews(). */
+	Array<shared_ptr<ScreenProbeView>> m_views;
+	/** HDR target of m_views[i + 1] */
+	Array<shared_ptr<Framebuffer>> m_extraViewFramebuffers;
+	/** Size of an extra view relative to the window */
+	static const int ExtraViewDownscale = 4;
 protected:
 	void makeGUI();
 
+	/** Adds or removes extra views. New views start from the current camera and stay there. */
+	void setExtraViewCount(int count);
+
+	/** Renders m_views[1...] into m_extraViewFramebuffers, before the main view */
+	void renderExtraViews(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaces);
+
+	/** Reloads the scene for the next AutoTuner candidate and restarts the benchmark */
+	void startTuningRun();
+
+	/** Compiles the programs of every GI pass that the next frames can launch, see ShaderWarmUp.
+		Runs every frame after the GI update, including while the scene tree is built; each
+		component only launches anything when its variants changed. */
+	void warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surface3D, const Array<shared_ptr<ScreenProbeView>>& views);
+
 public:
-	App(const GApp::Settings& settings = GApp::Settings());
+	App(const GApp::Settings& settings = GApp::Settings(), const Benchmark::Specification& benchmark = Benchmark::Specification(), const ProbeCache::Specification& probeCache = ProbeCache::Specification(), const AutoTuner::Specification& tuning = AutoTuner::Specification(), const BatchRenderer::Specification& batch = BatchRenderer::Specification(), const GridBaker::Specification& bake = GridBaker::Specification());
 
 	virtual void onInit() override;
+	virtual void onAfterSimulation(RealTime rdt, SimTime sdt, SimTime idt) override;
 	virtual void onGraphics3D(RenderDevice* rd, Array<shared_ptr<Surface>>& surface3D) override;
 	virtual void onAfterLoadScene(const Any& any, const String& sceneName) override;
-	void screenProbeAdaptivePlacement();
+	virtual void onPostProcessHDR3DEffects(RenderDevice* rd) override;
+	virtual void onCleanup() override;
 	void screenProbeDebugDraw();
-	void cleanScreenProbe();
-	void screenProbeUniformPlacement(int downsampleFactor);
+	/** Reallocates the main view and probe ray G-buffers with the given layout */
+	void setGBufferProfile(GBufferProfile::Value profile);
 };
@@ -0,0 +1,221 @@
+#include "AutoTuner.h"
+
+/** Swept values, cheapest first */
+static const Array<int> s_raysPerProbe = { 32, 64, 128, 256 };
+static const Array<int> s_irradianceOctResolutions = { 6, 8, 12 };
+static const Array<int> s_depthOctResolutions = { 8, 16 };
+/** R11G11B10F and RGB16F; see IrradianceField::s_irradianceFormats */
+static const Array<int> s_irradianceFormatIndices = { 3, 4 };
+static const Array<int> s_probeCountScales = { 1, 2 };
+
+AutoTuner::Specification AutoTuner::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	s.benchmark = Benchmark::Specification::fromCommandLine(argc, argv);
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == "--tune") {
+			s.enabled = true;
+		} else if ((arg == "--tune-budget") && hasValue) {
+			s.budgetMs = float(atof(argv[++i]));
+		} else if ((arg == "--tune-out") && hasValue) {
+			s.outputFilename = argv[++i];
+		} else if ((arg == "--tune-report") && hasValue) {
+			s.reportFilename = argv[++i];
+		} else if ((arg == "--tune-reference-dir") && hasValue) {
+			s.referenceDirectory = argv[++i];
+		} else if ((arg == "--tune-reference-rays") && hasValue) {
+			s.referenceRaysPerProbe = atoi(argv[++i]);
+		}
+	}
+
+	alwaysAssertM(s.budgetMs > 0.0f, "AutoTuner: --tune-budget must be positive");
+	alwaysAssertM(s.referenceRaysPerProbe > 0, "AutoTuner: --tune-reference-rays must be positive");
+	s.benchmark.enabled = s.benchmark.enabled || s.enabled;
+	return s;
+}
+
+String AutoTuner::Candidate::toString() const
+{
+	return format("%d rays, irradiance %d^2 %s, depth %d^2, probes x%d", raysPerProbe, irradianceOctResolution,
+		IrradianceField::s_irradianceFormats[irradianceFormatIndex]->name().c_str(), depthOctResolution, probeCountScale);
+}
+
+AutoTuner::AutoTuner(const Specification& specification) : m_specification(specification)
+{
+	Candidate& reference = m_candidates.next();
+	reference.raysPerProbe = specification.referenceRaysPerProbe;
+	reference.irradianceOctResolution = s_irradianceOctResolutions.last();
+	reference.depthOctResolution = s_depthOctResolutions.last();
+	reference.irradianceFormatIndex = IrradianceField::s_irradianceFormats.size() - 1;
+	reference.probeCountScale = s_probeCountScales.last();
+
+	for (const int rays : s_raysPerProbe) {
+		for (const int irradianceSide : s_irradianceOctResolutions) {
+			for (const int depthSide : s_depthOctResolutions) {
+				for (const int formatIndex : s_irradianceFormatIndices) {
+					for (const int scale : s_probeCountScales) {
+						Candidate& c = m_candidates.next();
+						c.raysPerProbe = rays;
+						c.irradianceOctResolution = irradianceSide;
+						c.depthOctResolution = depthSide;
+						c.irradianceFormatIndex = formatIndex;
+						c.probeCountScale = scale;
+					}
+				}
+			}
+		}
+	}
+
+	logPrintf("AutoTuner: %d candidates for %s within %.2f ms\n", m_candidates.size() - 1, specification.benchmark.sceneName.c_str(), specification.budgetMs);
+}
+
+Benchmark::Specification AutoTuner::benchmarkSpecification() const
+{
+	Benchmark::Specification s = m_specification.benchmark;
+	s.enabled = true;
+	s.referenceDirectory = m_specification.referenceDirectory;
+	s.captureReferences = (m_current == 0);
+	if (m_current == 0) {
+		// Only the quality phase of the reference run matters
+		s.frameCount = 1;
+	}
+	return s;
+}
+
+IrradianceField::Specification AutoTuner::apply(const Candidate& candidate) const
+{
+	IrradianceField::Specification spec = m_baseSpecification;
+	spec.irradianceRaysPerProbe = candidate.raysPerProbe;
+	spec.irradianceOctResolution = candidate.irradianceOctResolution;
+	spec.depthOctResolution = candidate.depthOctResolution;
+	spec.irradianceFormatIndex = candidate.irradianceFormatIndex;
+	spec.probeCounts.x *= candidate.probeCountScale;
+	spec.probeCounts.z *= candidate.probeCountScale;
+	// After scaling, and for the oct resolutions of this candidate, which the base grid was not clamped for
+	IrradianceField::clampProbeCounts(spec);
+	return spec;
+}
+
+void AutoTuner::configure(IrradianceField& field)
+{
+	if (done()) {
+		return;
+	}
+
+	if (!m_hasBaseSpecification) {
+		m_baseSpecification = field.m_specification;
+		m_hasBaseSpecification = true;
+	}
+
+	field.setSpecification(apply(m_candidates[m_current]));
+	logPrintf("AutoTuner: run %d/%d, %s%s\n", m_current, m_candidates.size() - 1,
+		m_candidates[m_current].toString().c_str(), (m_current == 0) ? " (reference)" : "");
+}
+
+void AutoTuner::endTrial(const Benchmark& benchmark)
+{
+	if (m_current > 0)
+	{
+		Trial& trial = m_trials.next();
+		trial.candidate = m_candidates[m_current];
+		trial.gpuTime = benchmark.meanFrameGPUTime();
+		trial.error = benchmark.meanRelativeRMSE();
+		logPrintf("AutoTuner: %s: %.3f ms, relative RMSE %.4f\n", trial.candidate.toString().c_str(), trial.gpuTime * 1000.0, trial.error);
+	}
+	++m_current;
+}
+
+void AutoTuner::markParetoFront()
+{
+	for (Trial& trial : m_trials)
+	{
+		trial.paretoOptimal = (trial.error < finf());
+		for (const Trial& other : m_trials)
+		{
+			const bool noWorse = (other.gpuTime <= trial.gpuTime) && (other.error <= trial.error);
+			const bool better = (other.gpuTime < trial.gpuTime) || (other.error < trial.error);
+			if (noWorse && better) {
+				trial.paretoOptimal = false;
+				break;
+			}
+		}
+	}
+}
+
+int AutoTuner::bestTrial() const
+{
+	const RealTime budget = RealTime(m_specification.budgetMs) / 1000.0;
+
+	// The most accurate configuration on the front that fits the budget...
+	int best = -1;
+	for (int t = 0; t < m_trials.size(); ++t)
+	{
+		const Trial& trial = m_trials[t];
+		if (trial.paretoOptimal && (trial.gpuTime <= budget) && ((best == -1) || (trial.error < m_trials[best].error))) {
+			best = t;
+		}
+	}
+
+	// ...or, if none does, the cheapest one that produced an image
+	if (best == -1) {
+		for (int t = 0; t < m_trials.size(); ++t) {
+			if (isFinite(m_trials[t].error) && ((best == -1) || (m_trials[t].gpuTime < m_trials[best].gpuTime))) {
+				best = t;
+			}
+		}
+	}
+	return best;
+}
+
+String AutoTuner::specificationFilename() const
+{
+	if (!m_specification.outputFilename.empty()) {
+		return m_specification.outputFilename;
+	}
+
+	const String& name = IrradianceField::specificationFilename(m_specification.benchmark.sceneName);
+	const String& existing = System::findDataFile(name, false);
+	return existing.empty() ? name : existing;
+}
+
+void AutoTuner::writeReport() const
+{
+	String csv = "rays_per_probe,irradiance_oct_resolution,depth_oct_resolution,irradiance_format,probe_count_scale,gpu_ms,relative_rmse,pareto_optimal\n";
+	for (const Trial& trial : m_trials)
+	{
+		const Candidate& c = trial.candidate;
+		csv += format("%d,%d,%d,%s,%d,%.4f,%.6f,%d\n", c.raysPerProbe, c.irradianceOctResolution, c.depthOctResolution,
+			IrradianceField::s_irradianceFormats[c.irradianceFormatIndex]->name().c_str(), c.probeCountScale,
+			trial.gpuTime * 1000.0, trial.error, trial.paretoOptimal ? 1 : 0);
+	}
+	writeWholeFile(m_specification.reportFilename, csv);
+}
+
+void AutoTuner::writeResults()
+{
+	markParetoFront();
+	writeReport();
+
+	const int best = bestTrial();
+	if (best == -1) {
+		logPrintf("AutoTuner: no trial with a finite error, %s left unchanged\n", specificationFilename().c_str());
+		// A broken reference or benchmark, not a slow scene; see the report
+		alwaysAssertM(m_trials.size() == 0, format("AutoTuner: none of the %d candidates has a finite error, see %s",
+			m_trials.size(), m_specification.reportFilename.c_str()));
+		return;
+	}
+
+	const Trial& trial = m_trials[best];
+	if (trial.gpuTime * 1000.0 > m_specification.budgetMs) {
+		logPrintf("AutoTuner: no configuration fits %.2f ms, writing the cheapest\n", m_specification.budgetMs);
+	}
+
+	const String& filename = specificationFilename();
+	apply(trial.candidate).toAny().save(filename);
+	logPrintf("AutoTuner: wrote %s (%s: %.3f ms, relative RMSE %.4f) and %s\n", filename.c_str(),
+		trial.candidate.toString().c_str(), trial.gpuTime * 1000.0, trial.error, m_specification.reportFilename.c_str());
+}
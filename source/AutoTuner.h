@@ -0,0 +1,114 @@
+#pragma once
+#include <G3D/G3D.h>
+#include "Benchmark.h"
+#include "IrradianceField.h"
+
+/** Offline search for the IrradianceField::Specification of a scene.
+
+	Runs one Benchmark per candidate configuration on the same scene and camera spline. The first
+	run uses a high-ray reference configuration and captures its matte indirect at every viewpoint
+	into Specification::referenceDirectory. Every candidate is then timed and compared against
+	that reference. The Pareto front of mean GPU frame time against mean relative RMSE is written
+	to the report, and the most accurate front configuration within the budget is written as the
+	scene's .LightFieldModelSpecification.Any, which IrradianceField::loadNewScene() reads.
+
+	\code
+	main --tune --scene BathRoom --tune-budget 4 --frames 120
+	\endcode
+	All --benchmark options apply to every run. */
+class AutoTuner : public ReferenceCountedObject
+{
+public:
+	class Specification
+	{
+	public:
+		bool                        enabled = false;
+
+		/** Scene, resolution, frames and viewpoints of every run */
+		Benchmark::Specification    benchmark;
+
+		/** GPU milliseconds per frame the chosen configuration may take */
+		float                       budgetMs = 4.0f;
+
+		/** Empty writes next to the existing spec file of the scene, or to the current directory */
+		String                      outputFilename;
+		String                      reportFilename = "tuning.csv";
+		String                      referenceDirectory = "tuning-reference";
+
+		/** Rays per probe of the reference run; the other parameters take their largest candidate */
+		int                         referenceRaysPerProbe = 1024;
+
+		/** Reads --tune, --tune-budget, --tune-out, --tune-report, --tune-reference-dir and
+			--tune-reference-rays in addition to the Benchmark options */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+protected:
+	/** The swept parameters. Everything else keeps the value the scene loaded with. */
+	class Candidate
+	{
+	public:
+		int         raysPerProbe = 64;
+		int         irradianceOctResolution = 8;
+		int         depthOctResolution = 8;
+		int         irradianceFormatIndex = 4;
+		/** Multiplies the x and z probe counts before IrradianceField::clampProbeCounts() */
+		int         probeCountScale = 1;
+
+		String toString() const;
+	};
+
+	class Trial
+	{
+	public:
+		Candidate   candidate;
+		RealTime    gpuTime = 0;
+		float       error = finf();
+		bool        paretoOptimal = false;
+	};
+
+	Specification                       m_specification;
+
+	/** Element 0 is the reference */
+	Array<Candidate>                    m_candidates;
+	int                                 m_current = 0;
+	Array<Trial>                        m_trials;
+
+	/** As loaded from the spec file or the heuristics of loadNewScene(), before any candidate */
+	IrradianceField::Specification      m_baseSpecification;
+	bool                                m_hasBaseSpecification = false;
+
+	AutoTuner(const Specification& specification);
+
+	IrradianceField::Specification apply(const Candidate& candidate) const;
+
+	void markParetoFront();
+
+	/** Index into m_trials of the configuration to write, -1 if no trial has a finite error */
+	int bestTrial() const;
+
+	String specificationFilename() const;
+
+	void writeReport() const;
+
+public:
+	static shared_ptr<AutoTuner> create(const Specification& specification) {
+		return createShared<AutoTuner>(specification);
+	}
+
+	/** For the run about to start. The reference run captures, the others compare. */
+	Benchmark::Specification benchmarkSpecification() const;
+
+	/** Applies the current candidate to a freshly loaded field */
+	void configure(IrradianceField& field);
+
+	/** Records the results of the run of the current candidate and advances to the next */
+	void endTrial(const Benchmark& benchmark);
+
+	bool done() const {
+		return m_current >= m_candidates.size();
+	}
+
+	/** Writes the report and the chosen specification */
+	void writeResults();
+};
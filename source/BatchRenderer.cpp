@@ -0,0 +1,137 @@
+#include "BatchRenderer.h"
+#include "Benchmark.h"
+#include "Telemetry.h"
+
+BatchRenderer::Specification BatchRenderer::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == "--batch") {
+			s.enabled = true;
+		} else if ((arg == "--scene") && hasValue) {
+			s.sceneName = argv[++i];
+		} else if ((arg == "--width") && hasValue) {
+			s.width = atoi(argv[++i]);
+		} else if ((arg == "--height") && hasValue) {
+			s.height = atoi(argv[++i]);
+		} else if ((arg == "--camera-path") && hasValue) {
+			s.cameraPathFilename = argv[++i];
+		} else if ((arg == "--fps") && hasValue) {
+			s.fps = float(atof(argv[++i]));
+		} else if ((arg == "--frames") && hasValue) {
+			s.frameCount = atoi(argv[++i]);
+		} else if ((arg == "--converge") && hasValue) {
+			s.convergeFrames = max(1, atoi(argv[++i]));
+		} else if ((arg == "--batch-dir") && hasValue) {
+			s.outputDirectory = argv[++i];
+		}
+	}
+	return s;
+}
+
+String BatchRenderer::outputFilename(int outputFrame) const
+{
+	return FilePath::concat(m_specification.outputDirectory,
+		format("%s_%05d.exr", FilePath::makeLegalFilename(m_specification.sceneName).c_str(), outputFrame));
+}
+
+void BatchRenderer::begin(const CoordinateFrame& initialCameraFrame)
+{
+	m_cameraSpline = m_specification.cameraPathFilename.empty() ?
+		Benchmark::defaultSpline(initialCameraFrame) :
+		PhysicsFrameSpline(Any::fromFile(m_specification.cameraPathFilename));
+
+	// Both ends of the path are rendered
+	m_outputFrameCount = (m_specification.frameCount > 0) ? m_specification.frameCount :
+		iFloor(m_cameraSpline.duration() * m_specification.fps) + 1;
+
+	if (!FileSystem::exists(m_specification.outputDirectory)) {
+		FileSystem::createDirectory(m_specification.outputDirectory);
+	}
+
+	m_frame = 0;
+	m_startTime = System::time();
+	logPrintf("BatchRenderer: %d frames of %s, %d converge frames each, to %s\n", m_outputFrameCount,
+		m_specification.sceneName.c_str(), m_specification.convergeFrames, m_specification.outputDirectory.c_str());
+}
+
+CoordinateFrame BatchRenderer::cameraFrame() const
+{
+	const float t0 = m_cameraSpline.time[0];
+	const float duration = m_cameraSpline.duration();
+	const float alpha = (m_outputFrameCount > 1) ? float(min(outputFrame(), m_outputFrameCount - 1)) / float(m_outputFrameCount - 1) : 0.0f;
+	return m_cameraSpline.evaluate(t0 + duration * alpha).toCoordinateFrame();
+}
+
+void BatchRenderer::flushReadbacks()
+{
+	for (const PendingReadback& readback : m_pendingReadbacks)
+	{
+		// The copy was issued at least a frame ago, so mapping no longer waits on the GPU
+		const shared_ptr<Image>& image = Image::fromPixelTransferBuffer(readback.buffer);
+		const String filename = readback.filename;
+
+		throttleWrites();
+		m_pendingWrites.append(std::async(std::launch::async, [image, filename]() {
+			// OpenGL rows start at the bottom
+			image->flipVertical();
+			image->save(filename);
+		}).share());
+	}
+	m_pendingReadbacks.fastClear();
+}
+
+void BatchRenderer::throttleWrites()
+{
+	for (int i = 0; i < m_pendingWrites.size(); ++i) {
+		if (m_pendingWrites[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			m_pendingWrites[i].get();
+			m_pendingWrites.remove(i);
+			--i;
+		}
+	}
+
+	while (m_pendingWrites.size() >= max(1, System::numCores())) {
+		m_pendingWrites[0].get();
+		m_pendingWrites.remove(0);
+	}
+}
+
+void BatchRenderer::endFrame(const shared_ptr<Texture>& hdrColor)
+{
+	flushReadbacks();
+
+	if (done()) {
+		return;
+	}
+
+	if ((m_frame % m_specification.convergeFrames) == m_specification.convergeFrames - 1) {
+		PendingReadback readback;
+		readback.buffer = hdrColor->toPixelTransferBuffer(ImageFormat::RGB32F());
+		readback.filename = outputFilename(outputFrame());
+		m_pendingReadbacks.append(readback);
+
+		const RealTime elapsed = System::time() - m_startTime;
+		Telemetry::set("batch.framesPerMinute", 60.0 * (outputFrame() + 1) / max(elapsed, 1e-3));
+		logPrintf("BatchRenderer: frame %d/%d\n", outputFrame() + 1, m_outputFrameCount);
+	}
+
+	++m_frame;
+}
+
+void BatchRenderer::finish()
+{
+	flushReadbacks();
+	for (const std::shared_future<void>& write : m_pendingWrites) {
+		write.get();
+	}
+	m_pendingWrites.fastClear();
+
+	const RealTime elapsed = System::time() - m_startTime;
+	logPrintf("BatchRenderer: wrote %d frames in %.1f s (%.2f frames per minute)\n",
+		m_outputFrameCount, elapsed, 60.0 * m_outputFrameCount / max(elapsed, 1e-3));
+}
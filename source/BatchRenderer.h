@@ -0,0 +1,115 @@
+#pragma once
+#include <G3D/G3D.h>
+#include <future>
+
+/** Non-interactive rendering of a camera path to an EXR sequence, for review fly-throughs.
+
+	Started from the command line, e.g.
+	\code
+	main --batch --scene BathRoom --camera-path flythrough.Spline.Any --converge 16 --batch-dir render
+	\endcode
+	writes render/BathRoom_00000.exr, render/BathRoom_00001.exr, ... and exits.
+
+	The camera holds at each output frame for convergeFrames rendered frames so that the probes
+	and the indirect history settle, and only the last of them is written. The HDR framebuffer is
+	written before tone mapping.
+
+	Nothing waits on the display or the GUI: the window is hidden, the frame limiter is off and
+	buffer swaps do not block. The framebuffer is copied into a pixel transfer buffer when it is
+	captured and only mapped one frame later, and the EXR encoding runs on worker threads, so
+	neither the GPU nor the tracer stalls on the disk. */
+class BatchRenderer : public ReferenceCountedObject
+{
+public:
+	class Specification
+	{
+	public:
+		bool        enabled = false;
+		String      sceneName = "BathRoom";
+		int         width = 1920;
+		int         height = 1080;
+
+		/** PhysicsFrameSpline Any file. Empty orbits the scene's default camera. */
+		String      cameraPathFilename;
+
+		/** Output frames per second of spline time. Sets the frame count unless frameCount > 0. */
+		float       fps = 30.0f;
+		int         frameCount = 0;
+
+		/** Rendered frames per output frame */
+		int         convergeFrames = 16;
+
+		String      outputDirectory = "batch";
+
+		/** Reads --batch, --scene, --width, --height, --camera-path, --fps, --frames, --converge
+			and --batch-dir. enabled is false unless --batch is present. */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+protected:
+	/** A capture whose readback has been issued but not mapped yet */
+	class PendingReadback
+	{
+	public:
+		shared_ptr<PixelTransferBuffer> buffer;
+		String                          filename;
+	};
+
+	Specification           m_specification;
+	PhysicsFrameSpline      m_cameraSpline;
+	int                     m_outputFrameCount = 0;
+
+	/** Rendered frames since begin() */
+	int                     m_frame = 0;
+
+	Array<PendingReadback>  m_pendingReadbacks;
+	/** Shared so that they fit in an Array */
+	Array<std::shared_future<void>> m_pendingWrites;
+
+	RealTime                m_startTime = 0;
+
+	BatchRenderer(const Specification& specification) : m_specification(specification) {}
+
+	int outputFrame() const {
+		return m_frame / m_specification.convergeFrames;
+	}
+
+	String outputFilename(int outputFrame) const;
+
+	/** Maps the readbacks issued on earlier frames and hands them to the writer threads */
+	void flushReadbacks();
+
+	/** Blocks while more than one EXR per core is being written */
+	void throttleWrites();
+
+public:
+	static shared_ptr<BatchRenderer> create(const Specification& specification) {
+		return createShared<BatchRenderer>(specification);
+	}
+
+	const Specification& specification() const {
+		return m_specification;
+	}
+
+	/** Builds the camera path and creates the output directory. Call after the scene is loaded. */
+	void begin(const CoordinateFrame& initialCameraFrame);
+
+	/** Where the camera should be for the frame about to be simulated */
+	CoordinateFrame cameraFrame() const;
+
+	/** Scene time step per rendered frame, so animations advance at fps over the output frames */
+	SimTime simulationTimeStep() const {
+		return SimTime(1.0 / (double(m_specification.fps) * m_specification.convergeFrames));
+	}
+
+	/** Call once the HDR framebuffer of a frame is complete. Captures it on the last converge frame
+		of an output frame. */
+	void endFrame(const shared_ptr<Texture>& hdrColor);
+
+	bool done() const {
+		return outputFrame() >= m_outputFrameCount;
+	}
+
+	/** Waits for the outstanding readbacks and writes and logs the throughput */
+	void finish();
+};
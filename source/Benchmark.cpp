@@ -0,0 +1,357 @@
+#include "Benchmark.h"
+
+Benchmark::Specification Benchmark::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == "--benchmark") {
+			s.enabled = true;
+		} else if ((arg == "--scene") && hasValue) {
+			s.sceneName = argv[++i];
+		} else if ((arg == "--width") && hasValue) {
+			s.width = atoi(argv[++i]);
+		} else if ((arg == "--height") && hasValue) {
+			s.height = atoi(argv[++i]);
+		} else if ((arg == "--frames") && hasValue) {
+			s.frameCount = atoi(argv[++i]);
+		} else if ((arg == "--warmup") && hasValue) {
+			s.warmupFrames = atoi(argv[++i]);
+		} else if ((arg == "--seed") && hasValue) {
+			s.seed = uint32(strtoul(argv[++i], nullptr, 10));
+		} else if ((arg == "--out") && hasValue) {
+			s.outputFilename = argv[++i];
+		} else if ((arg == "--spline") && hasValue) {
+			s.splineFilename = argv[++i];
+		} else if ((arg == "--reference-dir") && hasValue) {
+			s.referenceDirectory = argv[++i];
+		} else if (arg == "--capture-references") {
+			s.captureReferences = true;
+		} else if ((arg == "--settle") && hasValue) {
+			s.settleFrames = atoi(argv[++i]);
+		} else if ((arg == "--max-rmse") && hasValue) {
+			s.maxRelativeRMSE = float(atof(argv[++i]));
+		} else if ((arg == "--max-flip") && hasValue) {
+			s.maxFLIP = float(atof(argv[++i]));
+		} else if ((arg == "--max-flicker") && hasValue) {
+			s.maxFlicker = float(atof(argv[++i]));
+		}
+	}
+
+	alwaysAssertM((s.width > 0) && (s.height > 0) && (s.frameCount > 0) && (s.warmupFrames >= 0), "Benchmark: invalid resolution or frame count");
+	alwaysAssertM(s.settleFrames > s.flickerFrames, "Benchmark: --settle must exceed the flicker window");
+	return s;
+}
+
+PhysicsFrameSpline Benchmark::defaultSpline(const CoordinateFrame& cameraFrame)
+{
+	const Point3 target = cameraFrame.translation + cameraFrame.lookVector() * 2.0f;
+	const Vector3 offset = cameraFrame.translation - target;
+
+	PhysicsFrameSpline spline;
+	const float angles[] = { 0.0f, 30.0f, 0.0f, -30.0f };
+	for (int i = 0; i < 4; ++i)
+	{
+		CoordinateFrame frame(target + Matrix3::fromAxisAngle(Vector3::unitY(), toRadians(angles[i])) * offset);
+		frame.lookAt(target);
+		spline.append(float(i), PhysicsFrame(frame));
+	}
+	spline.extrapolationMode = SplineExtrapolationMode::CYCLIC;
+	spline.finalInterval = 1.0f;
+
+	return spline;
+}
+
+void Benchmark::begin(const CoordinateFrame& initialCameraFrame)
+{
+	Random::common().reset(m_specification.seed);
+
+	m_cameraSpline = m_specification.splineFilename.empty() ?
+		defaultSpline(initialCameraFrame) :
+		PhysicsFrameSpline(Any::fromFile(m_specification.splineFilename));
+
+	m_frame = 0;
+	m_records.fastClear();
+	m_records.reserve(m_specification.frameCount);
+	m_qualityRecords.fastClear();
+	m_imageQuality = ImageQuality::create();
+
+	Profiler::setEnabled(true);
+}
+
+CoordinateFrame Benchmark::cameraFrame() const
+{
+	if (qualityFrame() >= 0) {
+		const int view = min(qualityFrame() / m_specification.settleFrames, m_cameraSpline.control.size() - 1);
+		return m_cameraSpline.control[view].toCoordinateFrame();
+	}
+
+	// The spline is traversed once over the recorded frames, independent of wall-clock time
+	const int recordedFrame = max(0, m_frame - m_specification.warmupFrames);
+	const float t0 = m_cameraSpline.time[0];
+	const float duration = m_cameraSpline.duration();
+	return m_cameraSpline.evaluate(t0 + duration * float(recordedFrame) / float(m_specification.frameCount)).toCoordinateFrame();
+}
+
+void Benchmark::endFrame(const Counters& counters)
+{
+	if ((m_frame >= m_specification.warmupFrames) && (m_frame < timedFrameEnd()))
+	{
+		FrameRecord& record = m_records.next();
+		record.frame = m_frame - m_specification.warmupFrames;
+		record.counters = counters;
+
+		Array<const Array<Profiler::Event>*> eventTrees;
+		Profiler::getEvents(eventTrees);
+		for (const Array<Profiler::Event>* tree : eventTrees)
+		{
+			for (const Profiler::Event& event : *tree)
+			{
+				PassTiming& timing = record.passes.next();
+				timing.name = event.name();
+				timing.level = event.level();
+				timing.cpuTime = event.cpuDuration();
+				timing.gpuTime = event.gfxDuration();
+			}
+		}
+	}
+
+	++m_frame;
+}
+
+String Benchmark::referenceFilename(int view) const
+{
+	return FilePath::concat(m_specification.referenceDirectory,
+		format("%s_view%d_matte_indirect.exr", FilePath::makeLegalFilename(m_specification.sceneName).c_str(), view));
+}
+
+bool Benchmark::wantsIndirectCapture() const
+{
+	if (!qualityEnabled() || (qualityFrame() < 0) || done()) {
+		return false;
+	}
+	const int step = qualityFrame() % m_specification.settleFrames;
+	return step >= m_specification.settleFrames - m_specification.flickerFrames - 1;
+}
+
+void Benchmark::onIndirectCaptured(RenderDevice* rd, const shared_ptr<Texture>& indirect)
+{
+	const int view = qualityFrame() / m_specification.settleFrames;
+	const int step = qualityFrame() % m_specification.settleFrames;
+
+	if (isNull(m_previousIndirect) || (m_previousIndirect->vector2Bounds() != indirect->vector2Bounds())) {
+		m_previousIndirect = Texture::createEmpty("Benchmark::m_previousIndirect", indirect->width(), indirect->height(), indirect->format());
+	}
+
+	// The first capture at a viewpoint only seeds the flicker window
+	if (step == m_specification.settleFrames - m_specification.flickerFrames - 1) {
+		m_flickerSum = 0.0f;
+		Texture::copy(indirect, m_previousIndirect);
+		return;
+	}
+
+	const bool lastStep = (step == m_specification.settleFrames - 1);
+	QualityRecord record;
+	record.view = view;
+	record.referenceFilename = referenceFilename(view);
+
+	shared_ptr<Texture> reference = indirect;
+	if (lastStep && !m_specification.captureReferences && FileSystem::exists(record.referenceFilename)) {
+		reference = Texture::fromFile(record.referenceFilename, ImageFormat::RGBA32F());
+		record.referenceFound = (reference->vector2Bounds() == indirect->vector2Bounds());
+		if (!record.referenceFound) {
+			logPrintf("Benchmark: %s is %dx%d, expected %dx%d\n", record.referenceFilename.c_str(), reference->width(), reference->height(), indirect->width(), indirect->height());
+			reference = indirect;
+		}
+	}
+
+	const ImageQuality::Metrics& metrics = m_imageQuality->compare(rd, indirect, reference, m_previousIndirect);
+	m_flickerSum += metrics.flicker;
+	Texture::copy(indirect, m_previousIndirect);
+
+	if (!lastStep) {
+		return;
+	}
+
+	if (m_specification.captureReferences) {
+		FileSystem::createDirectory(m_specification.referenceDirectory);
+		indirect->toImage(ImageFormat::RGB32F())->save(record.referenceFilename);
+		record.referenceFound = true;
+	}
+
+	record.metrics = metrics;
+	record.metrics.flicker = m_flickerSum / float(m_specification.flickerFrames);
+	record.passed = record.referenceFound &&
+		(record.metrics.relativeRMSE <= m_specification.maxRelativeRMSE) &&
+		(record.metrics.flip <= m_specification.maxFLIP) &&
+		(record.metrics.flicker <= m_specification.maxFlicker);
+	m_qualityRecords.append(record);
+
+	logPrintf("Benchmark: view %d relative RMSE %.4f, FLIP %.4f, flicker %.4f%s\n", view,
+		record.metrics.relativeRMSE, record.metrics.flip, record.metrics.flicker, record.passed ? "" : " (FAILED)");
+}
+
+bool Benchmark::passed() const
+{
+	for (const QualityRecord& record : m_qualityRecords) {
+		if (!record.passed) {
+			return false;
+		}
+	}
+	return true;
+}
+
+RealTime Benchmark::meanFrameGPUTime() const
+{
+	if (m_records.size() == 0) {
+		return 0;
+	}
+
+	RealTime total = 0;
+	for (const FrameRecord& record : m_records) {
+		for (const PassTiming& timing : record.passes) {
+			// Nested events are already contained in their parent
+			if (timing.level == 0) {
+				total += timing.gpuTime;
+			}
+		}
+	}
+	return total / RealTime(m_records.size());
+}
+
+float Benchmark::meanRelativeRMSE() const
+{
+	if (m_qualityRecords.size() == 0) {
+		return finf();
+	}
+
+	float total = 0.0f;
+	for (const QualityRecord& record : m_qualityRecords) {
+		if (!record.referenceFound) {
+			return finf();
+		}
+		total += record.metrics.relativeRMSE;
+	}
+	return total / float(m_qualityRecords.size());
+}
+
+void Benchmark::writeResults() const
+{
+	const String& filename = m_specification.outputFilename;
+	if (endsWith(toLower(filename), ".csv")) {
+		writeCSV(filename);
+	} else {
+		writeJSON(filename);
+	}
+	logPrintf("Benchmark: wrote %d frames of %s to %s\n", m_records.size(), m_specification.sceneName.c_str(), filename.c_str());
+}
+
+static String jsonString(const String& s)
+{
+	String escaped = "\"";
+	for (const char c : s) {
+		if ((c == '"') || (c == '\\')) {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped + "\"";
+}
+
+void Benchmark::writeJSON(const String& filename) const
+{
+	String json = "{\n";
+	json += format("  \"scene\": %s,\n", jsonString(m_specification.sceneName).c_str());
+	json += format("  \"width\": %d,\n  \"height\": %d,\n", m_specification.width, m_specification.height);
+	json += format("  \"warmupFrames\": %d,\n  \"seed\": %u,\n", m_specification.warmupFrames, m_specification.seed);
+	json += format("  \"glRenderer\": %s,\n", jsonString(GLCaps::renderer()).c_str());
+
+	// Median and 95th percentile per pass name over all recorded frames
+	Table<String, Array<RealTime>> cpuTimes, gpuTimes;
+	for (const FrameRecord& record : m_records) {
+		for (const PassTiming& timing : record.passes) {
+			cpuTimes.getCreate(timing.name).append(timing.cpuTime);
+			gpuTimes.getCreate(timing.name).append(timing.gpuTime);
+		}
+	}
+
+	json += "  \"summary\": {";
+	bool first = true;
+	for (Table<String, Array<RealTime>>::Iterator it = cpuTimes.begin(); it.isValid(); ++it)
+	{
+		Array<RealTime> cpu = it->value;
+		Array<RealTime> gpu = gpuTimes[it->key];
+		cpu.sort();
+		gpu.sort();
+		json += format("%s\n    %s: {\"count\": %d, \"cpuMsMedian\": %.4f, \"cpuMsP95\": %.4f, \"gpuMsMedian\": %.4f, \"gpuMsP95\": %.4f}",
+			first ? "" : ",", jsonString(it->key).c_str(), cpu.size(),
+			cpu[cpu.size() / 2] * 1000.0, cpu[(cpu.size() * 95) / 100] * 1000.0,
+			gpu[gpu.size() / 2] * 1000.0, gpu[(gpu.size() * 95) / 100] * 1000.0);
+		first = false;
+	}
+	json += "\n  },\n";
+
+	if (qualityEnabled())
+	{
+		json += format("  \"qualityPassed\": %s,\n  \"quality\": [", passed() ? "true" : "false");
+		for (int q = 0; q < m_qualityRecords.size(); ++q)
+		{
+			const QualityRecord& record = m_qualityRecords[q];
+			json += format("%s\n    {\"view\": %d, \"reference\": %s, \"referenceFound\": %s, \"rmse\": %.6f, \"relativeRMSE\": %.6f, \"flip\": %.6f, \"flicker\": %.6f, \"passed\": %s}",
+				(q == 0) ? "" : ",", record.view, jsonString(record.referenceFilename).c_str(), record.referenceFound ? "true" : "false",
+				record.metrics.rmse, record.metrics.relativeRMSE, record.metrics.flip, record.metrics.flicker, record.passed ? "true" : "false");
+		}
+		json += "\n  ],\n";
+	}
+
+	json += "  \"frames\": [";
+	for (int f = 0; f < m_records.size(); ++f)
+	{
+		const FrameRecord& record = m_records[f];
+		json += format("%s\n    {\"frame\": %d, \"irradianceRays\": %lld, \"radianceCacheRays\": %lld, \"uniformProbes\": %d, \"adaptiveProbes\": %d, \"passes\": [",
+			(f == 0) ? "" : ",", record.frame, (long long)record.counters.irradianceRays, (long long)record.counters.radianceCacheRays,
+			record.counters.uniformProbes, record.counters.adaptiveProbes);
+		for (int p = 0; p < record.passes.size(); ++p)
+		{
+			const PassTiming& timing = record.passes[p];
+			json += format("%s{\"name\": %s, \"level\": %d, \"cpuMs\": %.4f, \"gpuMs\": %.4f}",
+				(p == 0) ? "" : ", ", jsonString(timing.name).c_str(), timing.level, timing.cpuTime * 1000.0, timing.gpuTime * 1000.0);
+		}
+		json += "]}";
+	}
+	json += "\n  ]\n}\n";
+
+	writeWholeFile(filename, json);
+}
+
+void Benchmark::writeCSV(const String& filename) const
+{
+	String csv = "frame,pass,level,cpu_ms,gpu_ms,irradiance_rays,radiance_cache_rays,uniform_probes,adaptive_probes\n";
+	for (const FrameRecord& record : m_records)
+	{
+		for (const PassTiming& timing : record.passes)
+		{
+			// Pass names are C identifiers or short phrases; quote them in case of commas
+			csv += format("%d,\"%s\",%d,%.4f,%.4f,%lld,%lld,%d,%d\n",
+				record.frame, timing.name.c_str(), timing.level, timing.cpuTime * 1000.0, timing.gpuTime * 1000.0,
+				(long long)record.counters.irradianceRays, (long long)record.counters.radianceCacheRays,
+				record.counters.uniformProbes, record.counters.adaptiveProbes);
+		}
+	}
+
+	writeWholeFile(filename, csv);
+
+	if (qualityEnabled())
+	{
+		String quality = "view,reference,reference_found,rmse,relative_rmse,flip,flicker,passed\n";
+		for (const QualityRecord& record : m_qualityRecords)
+		{
+			quality += format("%d,\"%s\",%d,%.6f,%.6f,%.6f,%.6f,%d\n", record.view, record.referenceFilename.c_str(), record.referenceFound ? 1 : 0,
+				record.metrics.rmse, record.metrics.relativeRMSE, record.metrics.flip, record.metrics.flicker, record.passed ? 1 : 0);
+		}
+		writeWholeFile(FilePath::concat(FilePath::parent(filename), FilePath::base(filename) + "_quality.csv"), quality);
+	}
+}
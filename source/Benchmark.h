@@ -0,0 +1,180 @@
+#pragma once
+#include <G3D/G3D.h>
+#include "ImageQuality.h"
+
+/** Reproducible benchmark run: one scene, a fixed camera spline, a fixed RNG seed and a fixed
+	number of frames, with the per-pass profiler timings and GI counters of every frame written
+	to JSON or CSV on exit.
+
+	Started from the command line, e.g.
+	\code
+	main --benchmark --scene BathRoom --frames 300 --seed 1 --out bathroom.json
+	\endcode
+	The window is hidden, so the run only needs an OpenGL context. On machines without a GPU,
+	run under Xvfb with Mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+
+	With --reference-dir the timed frames are followed by an image-quality check: the camera holds
+	at every control point of the spline until the GI has settled, and the matte indirect buffer is
+	compared against <reference-dir>/<scene>_view<i>_matte_indirect.exr. --capture-references
+	writes those files instead. The run exits with code 1 if a metric exceeds its --max-* bound. */
+class Benchmark : public ReferenceCountedObject
+{
+public:
+	class Specification
+	{
+	public:
+		bool        enabled = false;
+		String      sceneName = "BathRoom";
+		int         width = 1600;
+		int         height = 960;
+
+		/** Frames recorded after the warm-up */
+		int         frameCount = 300;
+
+		/** Frames rendered at the first camera position and not recorded, so shader compilation,
+			the first BVH build and probe convergence stay out of the timings */
+		int         warmupFrames = 30;
+
+		uint32      seed = 1;
+
+		/** .csv for one row per pass per frame, anything else for JSON */
+		String      outputFilename = "benchmark.json";
+
+		/** PhysicsFrameSpline Any file. Empty orbits the scene's default camera. */
+		String      splineFilename;
+
+		/** Empty disables the image-quality check */
+		String      referenceDirectory;
+		bool        captureReferences = false;
+
+		/** Frames spent at each quality viewpoint. The last flickerFrames + 1 of them are captured. */
+		int         settleFrames = 64;
+		int         flickerFrames = 8;
+
+		float       maxRelativeRMSE = finf();
+		float       maxFLIP = finf();
+		float       maxFlicker = finf();
+
+		/** Reads --benchmark, --scene, --width, --height, --frames, --warmup, --seed, --out,
+			--spline, --reference-dir, --capture-references, --settle, --max-rmse, --max-flip and
+			--max-flicker. enabled is false unless --benchmark is present. */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+	/** GI work done in one frame, gathered by App */
+	class Counters
+	{
+	public:
+		int64       irradianceRays = 0;
+		int64       radianceCacheRays = 0;
+		int         uniformProbes = 0;
+		int         adaptiveProbes = 0;
+	};
+
+protected:
+	class PassTiming
+	{
+	public:
+		String      name;
+		int         level = 0;
+		RealTime    cpuTime = 0;
+		RealTime    gpuTime = 0;
+	};
+
+	class FrameRecord
+	{
+	public:
+		int                 frame = 0;
+		Counters            counters;
+		Array<PassTiming>   passes;
+	};
+
+	class QualityRecord
+	{
+	public:
+		int                     view = 0;
+		String                  referenceFilename;
+		bool                    referenceFound = false;
+		ImageQuality::Metrics   metrics;
+		bool                    passed = false;
+	};
+
+	Specification           m_specification;
+	PhysicsFrameSpline      m_cameraSpline;
+
+	/** Counts the warm-up frames as well */
+	int                     m_frame = 0;
+
+	Array<FrameRecord>      m_records;
+
+	shared_ptr<ImageQuality> m_imageQuality;
+	Array<QualityRecord>    m_qualityRecords;
+
+	/** Last captured frame at the current quality viewpoint, for the flicker metric */
+	shared_ptr<Texture>     m_previousIndirect;
+	float                   m_flickerSum = 0.0f;
+
+	Benchmark(const Specification& specification) : m_specification(specification) {}
+
+	bool qualityEnabled() const {
+		return !m_specification.referenceDirectory.empty();
+	}
+
+	int timedFrameEnd() const {
+		return m_specification.warmupFrames + m_specification.frameCount;
+	}
+
+	/** Frame index within the image-quality phase, negative before it */
+	int qualityFrame() const {
+		return m_frame - timedFrameEnd();
+	}
+
+	String referenceFilename(int view) const;
+
+	void writeJSON(const String& filename) const;
+	void writeCSV(const String& filename) const;
+
+public:
+	static shared_ptr<Benchmark> create(const Specification& specification) {
+		return createShared<Benchmark>(specification);
+	}
+
+	const Specification& specification() const {
+		return m_specification;
+	}
+
+	/** Four points orbiting 30 degrees to either side of whatever the camera looks at 2 m ahead.
+		Also the BatchRenderer's path when none is given. */
+	static PhysicsFrameSpline defaultSpline(const CoordinateFrame& cameraFrame);
+
+	/** Seeds Random::common() and builds the camera spline. Call after the scene is loaded. */
+	void begin(const CoordinateFrame& initialCameraFrame);
+
+	/** Where the camera should be for the frame about to be simulated */
+	CoordinateFrame cameraFrame() const;
+
+	/** Records the profiler events of the last completed frame together with its counters */
+	void endFrame(const Counters& counters);
+
+	bool done() const {
+		return m_frame >= timedFrameEnd() + (qualityEnabled() ? m_cameraSpline.control.size() * m_specification.settleFrames : 0);
+	}
+
+	/** True if the matte indirect of the frame being rendered should be passed to onIndirectCaptured() */
+	bool wantsIndirectCapture() const;
+
+	/** Accumulates flicker and, on the last frame at a viewpoint, compares against the reference */
+	void onIndirectCaptured(RenderDevice* rd, const shared_ptr<Texture>& indirect);
+
+	/** False if any image-quality metric exceeded its bound or a reference was missing */
+	bool passed() const;
+
+	/** Mean over the recorded frames of the summed GPU time of the top-level profiler events */
+	RealTime meanFrameGPUTime() const;
+
+	/** Mean relative RMSE over the quality viewpoints. finf() if a reference was missing. */
+	float meanRelativeRMSE() const;
+
+	/** Writes the records to specification().outputFilename */
+	void writeResults() const;
+};
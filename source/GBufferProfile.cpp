@@ -0,0 +1,106 @@
+#include "GBufferProfile.h"
+
+const char* GBufferProfile::toString(Value profile)
+{
+	static const char* names[] = { "FULL_PRECISION", "PACKED" };
+	return names[profile];
+}
+
+void GBufferProfile::applyToMainView(GBuffer::Specification& specification, Value profile)
+{
+	if (profile == PACKED) {
+		specification.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA8();
+		specification.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA8();
+		specification.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::R11G11B10F();
+		specification.encoding[GBuffer::Field::WS_POSITION].format = nullptr;
+		specification.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGB10A2(), FrameName::WORLD, 2.0f, -1.0f);
+	} else {
+		specification.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::WS_POSITION].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA32F(), FrameName::CAMERA, 1.0f, 0.0f);
+	}
+}
+
+GBuffer::Specification GBufferProfile::raySpecification(Value profile)
+{
+	GBuffer::Specification specification;
+
+	if (profile == PACKED) {
+		specification.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA8();
+		specification.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA8();
+		specification.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::R11G11B10F();
+		specification.encoding[GBuffer::Field::TRANSMISSIVE].format = ImageFormat::RGBA8();
+		// The tracer writes raw unit normals, so keep them signed
+		specification.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA16F(), FrameName::CAMERA, 1.0f, 0.0f);
+	} else {
+		specification.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::TRANSMISSIVE].format = ImageFormat::RGBA32F();
+		specification.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA32F(), FrameName::CAMERA, 1.0f, 0.0f);
+	}
+	specification.encoding[GBuffer::Field::WS_POSITION].format = ImageFormat::RGBA32F();
+	specification.encoding[GBuffer::Field::DEPTH_AND_STENCIL].format = nullptr;
+	specification.encoding[GBuffer::Field::CS_NORMAL] = nullptr;
+	specification.encoding[GBuffer::Field::CS_POSITION] = nullptr;
+
+	return specification;
+}
+
+void GBufferProfile::setDecodeArgs(UniformTable& args, const shared_ptr<GBuffer>& gbuffer, const CoordinateFrame& cameraFrame)
+{
+	const shared_ptr<Texture>& wsPosition = gbuffer->texture(GBuffer::Field::WS_POSITION);
+	const bool packed = isNull(wsPosition);
+
+	args.setMacro("PACKED_GBUFFER", packed ? 1 : 0);
+	args.setUniform("depthTexture", gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
+	args.setUniform("ws_normalTexture", gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
+
+	if (packed) {
+		const Projection& projection = gbuffer->camera()->projection();
+		args.setUniform("gbufferCameraFrame", cameraFrame);
+		args.setUniform("gbufferClipInfo", projection.reconstructFromDepthClipInfo());
+		args.setUniform("gbufferProjInfo", projection.reconstructFromDepthProjInfo(gbuffer->width(), gbuffer->height()));
+	} else {
+		args.setUniform("ws_positionTexture", wsPosition, Sampler::buffer());
+	}
+}
+
+int GBufferProfile::bytesPerPixel(const GBuffer::Specification& specification)
+{
+	int bits = 0;
+	for (int f = 0; f < GBuffer::Field::COUNT; ++f) {
+		const ImageFormat* format = specification.encoding[f].format;
+		if (notNull(format)) {
+			bits += format->openGLBitsPerPixel;
+		}
+	}
+	return bits / 8;
+}
+
+void GBufferProfile::logMemoryComparison(const GBuffer::Specification& mainViewSpecification)
+{
+	static const Vector2int32 resolutions[] = { Vector2int32(1600, 960), Vector2int32(3840, 2160) };
+
+	for (int p = 0; p < COUNT; ++p) {
+		GBuffer::Specification mainView = mainViewSpecification;
+		applyToMainView(mainView, Value(p));
+		const int mainViewBytes = bytesPerPixel(mainView);
+		const int rayBytes = bytesPerPixel(raySpecification(Value(p)));
+
+		// WS_POSITION + WS_NORMAL, or depth + WS_NORMAL when positions are reconstructed
+		const int positionNormalBytes = (p == PACKED) ?
+			(mainView.encoding[GBuffer::Field::DEPTH_AND_STENCIL].format->openGLBitsPerPixel + mainView.encoding[GBuffer::Field::WS_NORMAL].format->openGLBitsPerPixel) / 8 :
+			(mainView.encoding[GBuffer::Field::WS_POSITION].format->openGLBitsPerPixel + mainView.encoding[GBuffer::Field::WS_NORMAL].format->openGLBitsPerPixel) / 8;
+
+		logPrintf("GBufferProfile %s: main view %d B/px, rays %d B/ray, %d B/px of position and normal reads per full-screen pass\n",
+			toString(Value(p)), mainViewBytes, rayBytes, positionNormalBytes);
+		for (const Vector2int32& resolution : resolutions) {
+			const double pixels = double(resolution.x) * double(resolution.y);
+			logPrintf("    %dx%d: main view %.1f MB, position and normal traffic %.1f MB per pass\n",
+				resolution.x, resolution.y, pixels * mainViewBytes / 1e6, pixels * positionNormalBytes / 1e6);
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** G-buffer layouts for the main view and the probe ray buffers.
+
+	FULL_PRECISION stores every field as RGBA32F. PACKED stores albedos in RGBA8, emission in
+	R11G11B10F and main view normals in RGB10A2, and drops the main view WS_POSITION in favour of
+	reconstruction from depth. Shaders read the main view through shaders/GBufferDecode.glsl. */
+class GBufferProfile
+{
+public:
+	enum Value { FULL_PRECISION = 0, PACKED, COUNT };
+
+	static const char* toString(Value profile);
+
+	/** Sets the LAMBERTIAN, GLOSSY, EMISSIVE, WS_POSITION and WS_NORMAL encodings of the main view */
+	static void applyToMainView(GBuffer::Specification& specification, Value profile);
+
+	/** Layout written by the ray tracer for probe and radiance cache rays. Positions stay
+		RGBA32F because there is no depth to reconstruct them from. */
+	static GBuffer::Specification raySpecification(Value profile);
+
+	/** Binds depthTexture, ws_normalTexture and either ws_positionTexture or the reconstruction
+		constants expected by GBufferDecode.glsl. cameraFrame is the frame \a gbuffer was rendered from. */
+	static void setDecodeArgs(UniformTable& args, const shared_ptr<GBuffer>& gbuffer, const CoordinateFrame& cameraFrame);
+
+	/** Sum of the allocated fields */
+	static int bytesPerPixel(const GBuffer::Specification& specification);
+
+	/** Writes the main view and ray buffer sizes of both profiles at 1600x960 and 3840x2160 to the log */
+	static void logMemoryComparison(const GBuffer::Specification& mainViewSpecification);
+};
@@ -1,37 +1,271 @@
 #include "GIRenderer.h"
+#include "ResourceTracker.h"
+#include "ShaderCache.h"
+
+void CGIRenderer::computeIndirect(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Framebuffer>& target, int downsampleFactor)
+{
+	Args args;
+
+	// One work group per screen tile, see GIRenderer_ComputeIndirect.glc
+	const int tileSide = m_pIrradianceField->screenProbeDownsampleFactor / downsampleFactor;
+	const Vector3int32 blockSize(tileSide, tileSide, 1);
+	args.setComputeGridDim(ShaderWarmUp::gridDim(Vector3int32(iCeil(target->width() / float(blockSize.x)), iCeil(target->height() / float(blockSize.y)), 1)));
+	args.setComputeGroupSize(blockSize);
+
+	args.setImageUniform("E_lambertianIndirect", target->texture(0), Access::WRITE, false);
+	m_pIrradianceField->setShaderArgs(args, "irradianceFieldSurface.", *m_view);
+
+	args.setUniform("screenProbeDownsampleFactor", m_pIrradianceField->screenProbeDownsampleFactor);
+	args.setUniform("gatherDownsampleFactor", downsampleFactor);
+	// The probe math works in full-resolution pixels whatever the size of the target
+	args.setUniform("viewport_height", float(gbuffer->height()));
+	args.setUniform("viewport_width", float(gbuffer->width()));
+	GBufferProfile::setDecodeArgs(args, gbuffer, gbuffer->camera()->frame());
+	args.setUniform("screenTileTable", m_view->screenTileTableTexture, Sampler::buffer());
+
+	LAUNCH_SHADER("shaders/GIRenderer_ComputeIndirect.glc", args);
+
+	// Read back through samplers by the upsample, error and deferred shading passes
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void CGIRenderer::upsampleIndirect(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& lowResIndirect, const shared_ptr<Framebuffer>& target)
+{
+	rd->push2D(target); {
+		Args args;
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+		args.setUniform("lowResIndirect", lowResIndirect, Sampler::buffer());
+		args.setUniform("gatherDownsampleFactor", m_gatherDownsampleFactor);
+		args.setUniform("cameraPosition", gbuffer->camera()->frame().translation);
+		GBufferProfile::setDecodeArgs(args, gbuffer, gbuffer->camera()->frame());
+
+		LAUNCH_SHADER("shaders/GIRenderer_UpsampleIndirect.pix", args);
+	} rd->pop2D();
+}
+
+void CGIRenderer::computeGatherError(RenderDevice* rd, const shared_ptr<Texture>& indirect, const shared_ptr<Texture>& reference, const shared_ptr<Framebuffer>& error)
+{
+	rd->push2D(error); {
+		Args args;
+		args.setRect(rd->viewport());
+		args.setUniform("testIndirect", indirect, Sampler::buffer());
+		args.setUniform("referenceIndirect", reference, Sampler::buffer());
+
+		LAUNCH_SHADER("shaders/GIRenderer_IndirectError.pix", args);
+	} rd->pop2D();
+
+	// The top mip level holds the screen average
+	const shared_ptr<Texture>& errorTexture = error->texture(0);
+	errorTexture->generateMipMaps();
+	const Color4& mean = errorTexture->readTexel(0, 0, rd, errorTexture->numMipMapLevels() - 1);
+
+	m_gatherRMSE = sqrt(mean.r);
+	m_gatherRelativeRMSE = (mean.g > 0.0f) ? sqrt(mean.r / mean.g) : 0.0f;
+}
+
+void CGIRenderer::temporalAccumulate(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& indirect, const shared_ptr<Framebuffer>& history, const shared_ptr<Framebuffer>& target)
+{
+	rd->push2D(target); {
+		Args args;
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+		args.setUniform("currentIndirect", indirect, Sampler::buffer());
+		args.setUniform("historyIndirect", history->texture(Framebuffer::COLOR0), Sampler::buffer());
+		args.setUniform("historyPosition", history->texture(Framebuffer::COLOR1), Sampler::buffer());
+		args.setUniform("historyNormal", history->texture(Framebuffer::COLOR2), Sampler::buffer());
+		args.setUniform("historyValid", m_view->giHistoryValid ? 1 : 0);
+		args.setUniform("ssPositionChange", gbuffer->texture(GBuffer::Field::SS_POSITION_CHANGE), Sampler::buffer());
+		args.setUniform("cameraPosition", gbuffer->camera()->frame().translation);
+		args.setUniform("minAlpha", m_temporalAlpha);
+		args.setUniform("varianceClampScale", m_varianceClampScale);
+		GBufferProfile::setDecodeArgs(args, gbuffer, gbuffer->camera()->frame());
+
+		LAUNCH_SHADER("shaders/GIRenderer_TemporalAccumulate.pix", args);
+	} rd->pop2D();
+
+	if (!ShaderWarmUp::active()) {
+		m_view->giHistoryValid = true;
+	}
+}
+
+void CGIRenderer::spatialFilter(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& indirect, const shared_ptr<Framebuffer>& target, int stepWidth)
+{
+	rd->push2D(target); {
+		Args args;
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+		args.setUniform("inputIndirect", indirect, Sampler::buffer());
+		args.setUniform("stepWidth", stepWidth);
+		args.setUniform("cameraPosition", gbuffer->camera()->frame().translation);
+		GBufferProfile::setDecodeArgs(args, gbuffer, gbuffer->camera()->frame());
+
+		LAUNCH_SHADER("shaders/GIRenderer_SpatialFilter.pix", args);
+	} rd->pop2D();
+}
+
+bool CGIRenderer::warmUpShaders(RenderDevice* rd, const shared_ptr<ScreenProbeView>& view)
+{
+	if (isNull(m_pIrradianceField) || isNull(view->irradianceProbes) || isNull(view->screenTileTableTexture)) {
+		// The gather binds the probes of the view
+		return false;
+	}
+
+	const shared_ptr<GBuffer>& gbuffer = view->gbuffer;
+	const String& key = format("%d", int(isNull(gbuffer->texture(GBuffer::Field::WS_POSITION))));
+	if (key == m_warmShadersKey) {
+		return false;
+	}
+	m_warmShadersKey = key;
+
+	if (isNull(m_warmUpFramebuffer))
+	{
+		// Same formats as the indirect buffers and the history
+		m_warmUpFramebuffer = Framebuffer::create("CGIRenderer::WarmUpFramebuffer");
+		m_warmUpFramebuffer->set(Framebuffer::COLOR0, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::WarmUpIndirect", 1, 1, ImageFormat::RGBA16F()));
+		m_warmUpFramebuffer->set(Framebuffer::COLOR1, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::WarmUpPosition", 1, 1, ImageFormat::RGBA32F()));
+		m_warmUpFramebuffer->set(Framebuffer::COLOR2, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::WarmUpNormal", 1, 1, ImageFormat::RGBA16F()));
+	}
+	const shared_ptr<Texture>& indirect = m_warmUpFramebuffer->texture(0);
+
+	const shared_ptr<ScreenProbeView> previousView = m_view;
+	m_view = view;
+	{
+		ShaderWarmUp::Scope warmUp;
+		view->warmUpShaders();
+
+		// The work group size follows the gather resolution
+		for (int downsampleFactor = 1; downsampleFactor <= 4; downsampleFactor *= 2) {
+			computeIndirect(rd, gbuffer, m_warmUpFramebuffer, downsampleFactor);
+		}
+		upsampleIndirect(rd, gbuffer, indirect, m_warmUpFramebuffer);
+		temporalAccumulate(rd, gbuffer, indirect, m_warmUpFramebuffer, m_warmUpFramebuffer);
+		spatialFilter(rd, gbuffer, indirect, m_warmUpFramebuffer, 1);
+	}
+	m_view = previousView;
+
+	return true;
+}
 
 void CGIRenderer::renderDeferredShading(RenderDevice * rd, const Array<shared_ptr<Surface>>& sortedVisibleSurfaceArray, const shared_ptr<GBuffer>& gbuffer, const LightingEnvironment & environment)
 {
-	if (m_pIrradianceField)
+	RenderGraph& graph = notNull(m_view) ? *m_view->giRenderGraph : *m_pRenderGraph;
+	graph.reset();
+
+	const int width = gbuffer->width();
+	const int height = gbuffer->height();
+
+	RenderGraph::Handle matteIndirect = RenderGraph::NONE;
+
+	// DIRECT_ONLY while the scene tree is built in the background; the probes are not updated yet.
+	// A view added this frame has no probes until the next one.
+	if (m_pIrradianceField && ((m_pIrradianceField->lightingMode() == LightingMode::DIRECT_ONLY) || isNull(m_view) || isNull(m_view->irradianceProbes)))
 	{
-		if (isNull(m_pGIFramebuffer))
-		{
-			m_pGIFramebuffer = Framebuffer::create("CGIRenderer::m_pGIFramebuffer");
-			m_pGIFramebuffer->set(Framebuffer::COLOR0, Texture::createEmpty("CGIRenderer::Indirect", gbuffer->width(), gbuffer->height(), ImageFormat::RGBA32F()));
+		if (notNull(m_view)) {
+			m_view->giHistoryValid = false;
 		}
-		m_pGIFramebuffer->resize(gbuffer->width(), gbuffer->height());
+	}
+	else if (m_pIrradianceField)
+	{
+		// Every full-resolution indirect buffer shares this description, so buffers that are dead
+		// by the time the next one is written (gather -> accumulate -> filter) share memory
+		const RenderGraph::TextureDesc indirectDesc("CGIRenderer::Indirect", width, height, ImageFormat::RGBA16F());
+		const RenderGraph::Handle indirect = graph.createTexture(indirectDesc);
 
 		// Compute GI
-		rd->push2D(m_pGIFramebuffer); {
-			Args args;
-			gbuffer->setShaderArgsRead(args, "gbuffer_");
-			args.setRect(rd->viewport());
-			m_pIrradianceField->setShaderArgs(args, "irradianceFieldSurface.");
-			args.setUniform("energyPreservation", 1.0f);
-
-			args.setUniform("screenProbeDownsampleFactor", m_pIrradianceField->screenProbeDownsampleFactor);
-			args.setUniform("viewport_height", rd->viewport().height());
-			args.setUniform("viewport_width", rd->viewport().width());
-			args.setUniform("adaptiveProbeNum", m_pIrradianceField->adaptiveProbeCount);
-			args.setUniform("ws_positionTexture", m_pIrradianceField->m_gbuffer->texture(GBuffer::Field::WS_POSITION), Sampler::buffer());
-			args.setUniform("depthTexture", m_pIrradianceField->m_gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
-			args.setUniform("ws_normalTexture", m_pIrradianceField->m_gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
-			args.setUniform("adaptiveProbeSSPosData", m_pIrradianceField->screenProbeSSAdaptivePositionTexture, Sampler::buffer());
-			args.setUniform("screenTileHeaderData", m_pIrradianceField->screenTileAdaptiveProbeHeaderTexture, Sampler::buffer());
-			args.setUniform("screenTileProbeIndex", m_pIrradianceField->screenTileAdaptiveProbeIndicesTexture, Sampler::buffer());
-
-			LAUNCH_SHADER("shaders/GIRenderer_ComputeIndirect.pix", args);
-		} rd->pop2D();
+		if (m_gatherDownsampleFactor > 1)
+		{
+			const RenderGraph::Handle lowResIndirect = graph.createTexture(RenderGraph::TextureDesc("CGIRenderer::IndirectLowRes",
+				iCeil(width / float(m_gatherDownsampleFactor)), iCeil(height / float(m_gatherDownsampleFactor)), ImageFormat::RGBA16F()));
+
+			graph.addPass("ComputeIndirect (reduced)", [this, &graph, gbuffer, lowResIndirect](RenderDevice* rd) {
+				computeIndirect(rd, gbuffer, graph.framebuffer(lowResIndirect), m_gatherDownsampleFactor);
+			}).write(lowResIndirect);
+
+			graph.addPass("UpsampleIndirect", [this, &graph, gbuffer, lowResIndirect, indirect](RenderDevice* rd) {
+				upsampleIndirect(rd, gbuffer, graph.texture(lowResIndirect), graph.framebuffer(indirect));
+			}).read(lowResIndirect).write(indirect);
+
+			if (m_measureGatherError)
+			{
+				const RenderGraph::Handle reference = graph.createTexture(RenderGraph::TextureDesc("CGIRenderer::IndirectReference", width, height, ImageFormat::RGBA16F()));
+				const RenderGraph::Handle error = graph.createTexture(RenderGraph::TextureDesc("CGIRenderer::IndirectError", width, height, ImageFormat::RG32F(), true));
+
+				graph.addPass("ComputeIndirect (reference)", [this, &graph, gbuffer, reference](RenderDevice* rd) {
+					computeIndirect(rd, gbuffer, graph.framebuffer(reference), 1);
+				}).write(reference);
+
+				graph.addPass("IndirectError", [this, &graph, indirect, reference, error](RenderDevice* rd) {
+					computeGatherError(rd, graph.texture(indirect), graph.texture(reference), graph.framebuffer(error));
+					screenPrintf("Indirect gather at 1/%d resolution: RMSE %.4f (%.1f%% of reference)", m_gatherDownsampleFactor, m_gatherRMSE, m_gatherRelativeRMSE * 100.0f);
+				}).read(indirect).read(reference).write(error).setSideEffects();
+			}
+		}
+		else
+		{
+			graph.addPass("ComputeIndirect", [this, &graph, gbuffer, indirect](RenderDevice* rd) {
+				computeIndirect(rd, gbuffer, graph.framebuffer(indirect), 1);
+			}).write(indirect);
+		}
+
+		matteIndirect = indirect;
+
+		if (m_temporalAccumulation)
+		{
+			shared_ptr<Framebuffer>* historyFramebuffer = m_view->giHistoryFramebuffer;
+			if (isNull(historyFramebuffer[0]))
+			{
+				for (int i = 0; i < 2; ++i)
+				{
+					historyFramebuffer[i] = Framebuffer::create("CGIRenderer::" + m_view->name + "::GIHistoryFramebuffer");
+					historyFramebuffer[i]->set(Framebuffer::COLOR0, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::" + m_view->name + "::IndirectHistory", width, height, ImageFormat::RGBA16F()));
+					historyFramebuffer[i]->set(Framebuffer::COLOR1, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::" + m_view->name + "::PositionHistory", width, height, ImageFormat::RGBA32F()));
+					historyFramebuffer[i]->set(Framebuffer::COLOR2, ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::" + m_view->name + "::NormalHistory", width, height, ImageFormat::RGBA16F()));
+				}
+			}
+			if ((historyFramebuffer[0]->width() != width) || (historyFramebuffer[0]->height() != height))
+			{
+				historyFramebuffer[0]->resize(width, height);
+				historyFramebuffer[1]->resize(width, height);
+				m_view->giHistoryValid = false;
+			}
+
+			// The history persists across frames, so it is imported rather than transient
+			const shared_ptr<Framebuffer>& history = historyFramebuffer[m_view->giHistoryIndex];
+			m_view->giHistoryIndex = 1 - m_view->giHistoryIndex;
+			const RenderGraph::Handle accumulated = graph.importFramebuffer("CGIRenderer::IndirectHistory", historyFramebuffer[m_view->giHistoryIndex]);
+
+			graph.addPass("TemporalAccumulate", [this, &graph, gbuffer, matteIndirect, history, accumulated](RenderDevice* rd) {
+				temporalAccumulate(rd, gbuffer, graph.texture(matteIndirect), history, graph.framebuffer(accumulated));
+			}).read(matteIndirect).write(accumulated);
+
+			matteIndirect = accumulated;
+		}
+		else
+		{
+			m_view->giHistoryValid = false;
+		}
+
+		for (int iteration = 0; iteration < m_spatialFilterIterations; ++iteration)
+		{
+			const RenderGraph::Handle filtered = graph.createTexture(indirectDesc);
+			const RenderGraph::Handle input = matteIndirect;
+			graph.addPass("SpatialFilter", [this, &graph, gbuffer, input, filtered, iteration](RenderDevice* rd) {
+				spatialFilter(rd, gbuffer, graph.texture(input), graph.framebuffer(filtered), 1 << iteration);
+			}).read(input).write(filtered);
+
+			matteIndirect = filtered;
+		}
+
+		if (m_captureIndirect)
+		{
+			if (isNull(m_capturedIndirect) || (m_capturedIndirect->width() != width) || (m_capturedIndirect->height() != height))
+			{
+				m_capturedIndirect = ResourceTracker::createTexture("CGIRenderer", "CGIRenderer::CapturedIndirect", width, height, indirectDesc.format);
+			}
+			const RenderGraph::Handle captured = graph.importTexture("CGIRenderer::CapturedIndirect", m_capturedIndirect);
+			const RenderGraph::Handle input = matteIndirect;
+			graph.addPass("CaptureIndirect", [&graph, input, captured](RenderDevice* rd) {
+				Texture::copy(graph.texture(input), graph.texture(captured));
+			}).read(input).write(captured);
+		}
 	}
 
 	// Find the skybox
@@ -42,17 +276,33 @@ void CGIRenderer::renderDeferredShading(RenderDevice * rd, const Array<shared_pt
 		if (skyboxSurface) { break; }
 	}
 
-	rd->push2D(); {
-		Args args;
-		environment.setShaderArgs(args);
-		gbuffer->setShaderArgsRead(args, "gbuffer_");
-		args.setRect(rd->viewport());
+	const float indirectWeight = m_pIrradianceField ? m_pIrradianceField->indirectWeight() : 1.0f;
 
-		args.setUniform("matteIndirectBuffer", notNull(m_pGIFramebuffer) ? m_pGIFramebuffer->texture(0) : Texture::opaqueBlack(), Sampler::buffer());
+	RenderGraph::Pass& deferredShade = graph.addPass("DeferredShade", [&graph, gbuffer, &environment, skyboxSurface, matteIndirect, indirectWeight](RenderDevice* rd) {
+		rd->push2D(); {
+			Args args;
+			environment.setShaderArgs(args);
+			gbuffer->setShaderArgsRead(args, "gbuffer_");
+			args.setRect(rd->viewport());
 
-		args.setMacro("OVERRIDE_SKYBOX", true);
-		if (skyboxSurface) skyboxSurface->setShaderArgs(args, "skybox_");
+			args.setUniform("matteIndirectBuffer", (matteIndirect != RenderGraph::NONE) ? graph.texture(matteIndirect) : Texture::opaqueBlack(), Sampler::buffer());
+			args.setUniform("indirectWeight", indirectWeight);
 
-		LAUNCH_SHADER("shaders/GIRenderer_DeferredShade.pix", args);
-	} rd->pop2D();
-}
\ No newline at end of file
+			args.setMacro("OVERRIDE_SKYBOX", true);
+			if (skyboxSurface) skyboxSurface->setShaderArgs(args, "skybox_");
+
+			LAUNCH_SHADER("shaders/GIRenderer_DeferredShade.pix", args);
+		} rd->pop2D();
+	}).setSideEffects();
+	if (matteIndirect != RenderGraph::NONE) {
+		deferredShade.read(matteIndirect);
+	}
+
+	graph.execute(rd);
+
+	if (m_showRenderGraphStats)
+	{
+		screenPrintf("GI render graph: %d culled passes, transient indirect buffers %.1f MB (%.1f MB without aliasing)",
+			graph.culledPassCount(), graph.peakTransientBytes() / 1e6, graph.unaliasedTransientBytes() / 1e6);
+	}
+}
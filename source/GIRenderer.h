@@ -1,12 +1,68 @@
 #pragma once
 #include <G3D/G3D.h>
 #include "IrradianceField.h"
+#include "RenderGraph.h"
 
 class CGIRenderer :public DefaultRenderer
 {
 	shared_ptr<IrradianceField> m_pIrradianceField;
 
-	shared_ptr<Framebuffer>     m_pGIFramebuffer;
+	/** Gather, upsample, error, filter and shading passes while no view is set. A view brings
+		its own, ScreenProbeView::giRenderGraph. Rebuilt every frame; owns the transient indirect
+		buffers, see renderDeferredShading() */
+	shared_ptr<RenderGraph>     m_pRenderGraph = RenderGraph::create();
+
+	/** screenPrintf the pass count and transient memory of the render graph of each view */
+	bool                        m_showRenderGraphStats = false;
+
+	/** If set, the final matte indirect of each frame is copied into m_capturedIndirect */
+	bool                        m_captureIndirect = false;
+	shared_ptr<Texture>         m_capturedIndirect;
+
+	/** 1 = full resolution, 2 = half, 4 = quarter */
+	int                         m_gatherDownsampleFactor = 1;
+
+	/** If true and the gather is reduced, also gather at full resolution and report the RMSE */
+	bool                        m_measureGatherError = false;
+
+	float                       m_gatherRMSE = 0.0f;
+	float                       m_gatherRelativeRMSE = 0.0f;
+
+	/** View rendered next, holds the screen probes and the indirect history. See setView(). */
+	shared_ptr<ScreenProbeView> m_view;
+
+	bool                        m_temporalAccumulation = true;
+
+	/** Weight of the current frame once the history is full. Lower is smoother but slower to respond to lighting changes. */
+	float                       m_temporalAlpha = 0.1f;
+
+	/** Half-width of the neighbourhood clamp box in standard deviations */
+	float                       m_varianceClampScale = 1.5f;
+
+	/** Edge-aware a-trous iterations after accumulation, 0 disables the spatial filter */
+	int                         m_spatialFilterIterations = 0;
+
+	/** One texel per attachment of the indirect history, the target of every pass in warmUpShaders() */
+	shared_ptr<Framebuffer>     m_warmUpFramebuffer;
+
+	/** G-buffer layout the warm variants were compiled for, see warmUpShaders() */
+	String                      m_warmShadersKey;
+
+	/** Runs GIRenderer_ComputeIndirect.glc into target, which is downsampleFactor times smaller than gbuffer */
+	void computeIndirect(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Framebuffer>& target, int downsampleFactor);
+
+	/** Joint bilateral upsample of the reduced gather into target */
+	void upsampleIndirect(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& lowResIndirect, const shared_ptr<Framebuffer>& target);
+
+	/** Compares indirect against a full-resolution gather. Reads one texel back, debugging only. */
+	void computeGatherError(RenderDevice* rd, const shared_ptr<Texture>& indirect, const shared_ptr<Texture>& reference, const shared_ptr<Framebuffer>& error);
+
+	/** Blends indirect into the reprojected history, writing all three attachments of target */
+	void temporalAccumulate(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& indirect, const shared_ptr<Framebuffer>& history, const shared_ptr<Framebuffer>& target);
+
+	/** One edge-aware a-trous iteration with taps stepWidth pixels apart */
+	void spatialFilter(RenderDevice* rd, const shared_ptr<GBuffer>& gbuffer, const shared_ptr<Texture>& indirect, const shared_ptr<Framebuffer>& target, int stepWidth);
+
 public:
 	static shared_ptr<CGIRenderer> create()
 	{
@@ -15,6 +71,42 @@ public:
 
 	void setIrradianceField(shared_ptr<IrradianceField> vIrradianceField) { m_pIrradianceField = vIrradianceField; }
 
+	/** Selects the screen probes and indirect history used by the next render(). The G-buffer
+		passed to render() must be the one of \a view. Without probes the view is shaded direct only. */
+	void setView(const shared_ptr<ScreenProbeView>& view) { m_view = view; }
+
+	void setGatherDownsampleFactor(int factor) { m_gatherDownsampleFactor = factor; }
+	int gatherDownsampleFactor() const { return m_gatherDownsampleFactor; }
+
+	void setMeasureGatherError(bool b) { m_measureGatherError = b; }
+	bool measureGatherError() const { return m_measureGatherError; }
+
+	void setTemporalAccumulation(bool b) { m_temporalAccumulation = b; }
+	bool temporalAccumulation() const { return m_temporalAccumulation; }
+
+	void setTemporalAlpha(float a) { m_temporalAlpha = a; }
+	float temporalAlpha() const { return m_temporalAlpha; }
+
+	void setVarianceClampScale(float s) { m_varianceClampScale = s; }
+	float varianceClampScale() const { return m_varianceClampScale; }
+
+	void setSpatialFilterIterations(int n) { m_spatialFilterIterations = n; }
+	int spatialFilterIterations() const { return m_spatialFilterIterations; }
+
+	void setShowRenderGraphStats(bool b) { m_showRenderGraphStats = b; }
+	bool showRenderGraphStats() const { return m_showRenderGraphStats; }
+
+	void setCaptureIndirect(bool b) { m_captureIndirect = b; }
+
+	/** Matte indirect of the last frame rendered with setCaptureIndirect(true), after accumulation and filtering */
+	const shared_ptr<Texture>& capturedIndirect() const { return m_capturedIndirect; }
+
+	/** Compiles the placement passes of \a view and the gather, upsample, accumulation and filter
+		passes for its G-buffer layout, whatever the current settings, by launching them under a
+		ShaderWarmUp::Scope. Requires the probes of \a view. Returns false without launching
+		anything if the layout did not change since the last call. */
+	bool warmUpShaders(RenderDevice* rd, const shared_ptr<ScreenProbeView>& view);
+
 protected:
 	CGIRenderer() {}
 
@@ -23,4 +115,4 @@ protected:
 		const Array<shared_ptr<Surface>>&   sortedVisibleSurfaceArray,
 		const shared_ptr<GBuffer>&          gbuffer,
 		const LightingEnvironment&          environment) override;
-};
\ No newline at end of file
+};
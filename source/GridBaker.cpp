@@ -0,0 +1,323 @@
+#include "GridBaker.h"
+#include "IrradianceField.h"
+
+#ifdef _WIN32
+#   include <process.h>
+#else
+#   include <spawn.h>
+#   include <sys/wait.h>
+extern char** environ;
+#endif
+
+static const char s_magic[8] = { 'P', 'R', 'B', 'G', 'R', 'I', 'D', '0' };
+
+GridBaker::Specification GridBaker::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if (arg == "--bake-grid") {
+			s.enabled = true;
+		} else if ((arg == "--scene") && hasValue) {
+			s.sceneName = argv[++i];
+		} else if ((arg == "--bake-workers") && hasValue) {
+			s.workerCount = max(1, atoi(argv[++i]));
+		} else if ((arg == "--bake-passes") && hasValue) {
+			s.passes = max(1, atoi(argv[++i]));
+		} else if ((arg == "--bake-out") && hasValue) {
+			s.outputFilename = argv[++i];
+		} else if ((arg == "--bake-shard") && hasValue) {
+			s.shardIndex = atoi(argv[++i]);
+		}
+	}
+	return s;
+}
+
+String GridBaker::Specification::filename() const
+{
+	return outputFilename.empty() ? defaultFilename(sceneName) : outputFilename;
+}
+
+String GridBaker::shardFilename(const String& filename, int shardIndex)
+{
+	return format("%s.shard%d", filename.c_str(), shardIndex);
+}
+
+void GridBaker::writeAtlas(const String& filename, const Atlas& atlas)
+{
+	const String& directory = FilePath::parent(filename);
+	if (!directory.empty() && !FileSystem::exists(directory)) {
+		FileSystem::createDirectory(directory);
+	}
+
+	BinaryOutput out(filename, G3D_LITTLE_ENDIAN);
+	out.writeBytes(s_magic, sizeof(s_magic));
+	out.writeUInt32(VERSION);
+	out.writeInt32(atlas.probeCounts.x);
+	out.writeInt32(atlas.probeCounts.y);
+	out.writeInt32(atlas.probeCounts.z);
+	out.writeInt32(atlas.firstProbe);
+	out.writeInt32(atlas.endProbe);
+	out.writeUInt64(atlas.key);
+
+	out.writeInt32(atlas.layers.size());
+	for (const Layer& layer : atlas.layers)
+	{
+		out.writeString32(layer.name);
+		out.writeInt32(layer.width);
+		out.writeInt32(layer.height);
+		out.writeString32(layer.formatName);
+		out.writeUInt64(uint64(layer.texels.size()));
+		out.writeBytes(layer.texels.getCArray(), int64(layer.texels.size()));
+	}
+
+	out.commit();
+}
+
+bool GridBaker::readAtlas(const String& filename, Atlas& atlas)
+{
+	if (!FileSystem::exists(filename)) {
+		logPrintf("GridBaker: %s is missing\n", filename.c_str());
+		return false;
+	}
+
+	BinaryInput in(filename, G3D_LITTLE_ENDIAN);
+	char magic[sizeof(s_magic)];
+	if (in.size() >= int64(sizeof(s_magic))) {
+		in.readBytes(magic, sizeof(s_magic));
+	}
+	if ((in.size() < int64(sizeof(s_magic))) || (memcmp(magic, s_magic, sizeof(s_magic)) != 0) || (in.readUInt32() != VERSION)) {
+		logPrintf("GridBaker: %s is not a grid atlas of version %u\n", filename.c_str(), VERSION);
+		return false;
+	}
+
+	atlas.probeCounts.x = in.readInt32();
+	atlas.probeCounts.y = in.readInt32();
+	atlas.probeCounts.z = in.readInt32();
+	atlas.firstProbe = in.readInt32();
+	atlas.endProbe = in.readInt32();
+	atlas.key = in.readUInt64();
+
+	atlas.layers.resize(in.readInt32());
+	for (Layer& layer : atlas.layers)
+	{
+		layer.name = in.readString32();
+		layer.width = in.readInt32();
+		layer.height = in.readInt32();
+		layer.formatName = in.readString32();
+		layer.texels.resize(int(in.readUInt64()));
+		in.readBytes(layer.texels.getCArray(), int64(layer.texels.size()));
+	}
+	return true;
+}
+
+int64 GridBaker::startWorker(const Array<String>& args)
+{
+	Array<const char*> argv;
+#	ifdef _WIN32
+		// _spawnv joins the arguments with spaces
+		Array<String> quoted;
+		for (const String& arg : args) {
+			quoted.append((arg.find(' ') == String::npos) ? arg : "\"" + arg + "\"");
+		}
+		for (const String& arg : quoted) {
+			argv.append(arg.c_str());
+		}
+		argv.append(nullptr);
+		const intptr_t handle = _spawnv(_P_NOWAIT, args[0].c_str(), argv.getCArray());
+		return (handle == -1) ? 0 : int64(handle);
+#	else
+		for (const String& arg : args) {
+			argv.append(arg.c_str());
+		}
+		argv.append(nullptr);
+		pid_t pid = 0;
+		if (posix_spawnp(&pid, args[0].c_str(), nullptr, nullptr, const_cast<char* const*>(argv.getCArray()), environ) != 0) {
+			return 0;
+		}
+		return int64(pid);
+#	endif
+}
+
+int GridBaker::waitForWorker(int64 worker)
+{
+#	ifdef _WIN32
+		int status = 0;
+		if (_cwait(&status, intptr_t(worker), _WAIT_CHILD) == -1) {
+			return -1;
+		}
+		return status;
+#	else
+		int status = 0;
+		if ((waitpid(pid_t(worker), &status, 0) == -1) || !WIFEXITED(status)) {
+			return -1;
+		}
+		return WEXITSTATUS(status);
+#	endif
+}
+
+int GridBaker::run(const Specification& specification, int argc, const char* argv[])
+{
+	const RealTime start = System::time();
+	const String& filename = specification.filename();
+
+	Array<int64> workers;
+	for (int i = 0; i < specification.workerCount; ++i)
+	{
+		Array<String> args;
+		for (int a = 0; a < argc; ++a) {
+			args.append(argv[a]);
+		}
+		args.append("--bake-shard", format("%d", i));
+
+		const int64 worker = startWorker(args);
+		if (worker == 0) {
+			logPrintf("GridBaker: could not start worker %d\n", i);
+		}
+		workers.append(worker);
+	}
+	logPrintf("GridBaker: baking %s into %s with %d workers\n", specification.sceneName.c_str(), filename.c_str(), specification.workerCount);
+
+	bool succeeded = true;
+	for (int i = 0; i < workers.size(); ++i)
+	{
+		const int exitCode = (workers[i] == 0) ? -1 : waitForWorker(workers[i]);
+		if (exitCode != 0) {
+			logPrintf("GridBaker: worker %d failed with exit code %d\n", i, exitCode);
+			succeeded = false;
+		}
+	}
+
+	succeeded = succeeded && mergeShards(specification);
+
+	for (int i = 0; i < specification.workerCount; ++i) {
+		const String& shard = shardFilename(filename, i);
+		if (FileSystem::exists(shard)) {
+			FileSystem::removeFile(shard);
+		}
+	}
+
+	if (succeeded) {
+		logPrintf("GridBaker: wrote %s in %.1f s\n", filename.c_str(), System::time() - start);
+	}
+	return succeeded ? 0 : 1;
+}
+
+bool GridBaker::mergeShards(const Specification& specification)
+{
+	Array<Atlas> shards;
+	shards.resize(specification.workerCount);
+	for (int i = 0; i < shards.size(); ++i) {
+		if (!readAtlas(shardFilename(specification.filename(), i), shards[i])) {
+			return false;
+		}
+	}
+
+	Atlas merged;
+	merged.probeCounts = shards[0].probeCounts;
+	merged.key = shards[0].key;
+	merged.firstProbe = 0;
+	merged.endProbe = merged.probeCounts.x * merged.probeCounts.y * merged.probeCounts.z;
+	const int probesPerRow = merged.probeCounts.x * merged.probeCounts.y;
+
+	// Shard i follows shard i - 1; empty shards hold no layers
+	int nextProbe = 0;
+	for (const Atlas& shard : shards)
+	{
+		if ((shard.probeCounts != merged.probeCounts) || (shard.key != merged.key) || (shard.firstProbe != nextProbe)) {
+			logPrintf("GridBaker: the shards were baked with different configurations or do not tile the grid\n");
+			return false;
+		}
+		nextProbe = shard.endProbe;
+
+		if ((shard.firstProbe < shard.endProbe) && (merged.layers.size() == 0)) {
+			for (const Layer& layer : shard.layers)
+			{
+				// Probe tiles include their border
+				const int tileSize = (layer.width - 2) / probesPerRow;
+				Layer& out = merged.layers.next();
+				out.name = layer.name;
+				out.width = layer.width;
+				out.height = tileSize * merged.probeCounts.z + 2;
+				out.formatName = layer.formatName;
+				out.texels.resize(layer.texels.size() / layer.height * out.height);
+				System::memset(out.texels.getCArray(), 0, out.texels.size());
+			}
+		}
+	}
+	if ((nextProbe != merged.endProbe) || (merged.layers.size() == 0)) {
+		logPrintf("GridBaker: the shards cover %d of %d probes\n", nextProbe, merged.endProbe);
+		return false;
+	}
+
+	// Each shard is a band of whole tile rows, one per z-slice
+	for (const Atlas& shard : shards)
+	{
+		if (shard.firstProbe == shard.endProbe) {
+			continue;
+		}
+		for (int i = 0; i < merged.layers.size(); ++i)
+		{
+			const Layer& in = shard.layers[i];
+			Layer& out = merged.layers[i];
+			if ((in.name != out.name) || (in.width != out.width) || (in.formatName != out.formatName)) {
+				logPrintf("GridBaker: %s differs between shards\n", out.name.c_str());
+				return false;
+			}
+
+			const size_t rowBytes = size_t(in.texels.size() / in.height);
+			const int tileSize = (in.width - 2) / probesPerRow;
+			const int rows = tileSize * ((shard.endProbe - shard.firstProbe) / probesPerRow);
+			const int firstRow = tileSize * (shard.firstProbe / probesPerRow);
+			System::memcpy(out.texels.getCArray() + rowBytes * firstRow, in.texels.getCArray(), rowBytes * rows);
+		}
+	}
+
+	writeAtlas(specification.filename(), merged);
+	return true;
+}
+
+void GridBaker::bakeShard(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray) const
+{
+	const RealTime start = System::time();
+
+	const Vector3int32& probeCounts = irradianceField.probeCounts();
+	const int probesPerRow = irradianceField.gridProbesPerAtlasRow();
+	const int shardCount = m_specification.workerCount;
+	const int i = m_specification.shardIndex;
+
+	Atlas atlas;
+	atlas.probeCounts = probeCounts;
+	atlas.firstProbe = probesPerRow * (probeCounts.z * i / shardCount);
+	atlas.endProbe = probesPerRow * (probeCounts.z * (i + 1) / shardCount);
+	atlas.key = irradianceField.probeCacheKey(0);
+
+	// More workers than z-slices leaves some shards empty
+	if (atlas.firstProbe < atlas.endProbe)
+	{
+		shared_ptr<Texture> irradianceProbes, meanDistProbes;
+		irradianceField.bakeGridProbes(rd, surfaceArray, atlas.firstProbe, atlas.endProbe, m_specification.passes, irradianceProbes, meanDistProbes);
+
+		for (const shared_ptr<Texture>& texture : { irradianceProbes, meanDistProbes })
+		{
+			const shared_ptr<GLPixelTransferBuffer>& buffer = texture->toPixelTransferBuffer();
+			const size_t bytes = size_t(texture->width()) * size_t(texture->height()) * size_t(texture->format()->openGLBitsPerPixel) / 8;
+			alwaysAssertM(buffer->size() >= bytes, "GridBaker: unexpected readback size for " + texture->name());
+
+			Layer& layer = atlas.layers.next();
+			layer.name = texture->name();
+			layer.width = texture->width();
+			layer.height = texture->height();
+			layer.formatName = texture->format()->name();
+			layer.texels.resize(int(bytes));
+			System::memcpy(layer.texels.getCArray(), buffer->mapRead(), bytes);
+			buffer->unmap();
+		}
+	}
+
+	writeAtlas(shardFilename(m_specification.filename(), i), atlas);
+	logPrintf("GridBaker: shard %d of %d baked probes [%d, %d) in %.1f s\n", i, shardCount, atlas.firstProbe, atlas.endProbe, System::time() - start);
+}
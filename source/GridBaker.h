@@ -0,0 +1,123 @@
+#pragma once
+#include <G3D/G3D.h>
+
+class IrradianceField;
+
+/** Offline bake of the world-space IrradianceField grid, sharded over local worker processes.
+
+	Started from the command line, e.g.
+	\code
+	main --bake-grid --scene BathRoom --bake-workers 8 --bake-passes 32 --bake-out BathRoom.IrradianceGrid
+	\endcode
+	The coordinator does not open a window. It starts --bake-workers copies of the executable with
+	the same arguments plus --bake-shard <i>. Each worker loads the scene, builds its own TriTree,
+	bakes the z-slices [z * i / n, z * (i + 1) / n) of the probe grid and writes them to
+	<out>.shard<i>. Once every worker has exited the coordinator stacks the shards into <out>
+	and deletes them.
+
+	Shards are whole z-slices, so every shard is a band of rows of the final atlases. Workers
+	share nothing but the disk and the GPU, so the bake scales with the worker count until one of
+	the two saturates.
+
+	Atlas files hold a header (magic, VERSION, probe counts, the range of probes they contain and
+	IrradianceField::probeCacheKey() of the configuration) followed by the irradiance and
+	mean-distance atlases as raw texels. */
+class GridBaker : public ReferenceCountedObject
+{
+public:
+	/** Bump whenever the layout or the meaning of the stored texels changes */
+	static const uint32 VERSION = 1;
+
+	class Specification
+	{
+	public:
+		bool        enabled = false;
+		String      sceneName = "BathRoom";
+
+		/** Worker processes, and therefore shards */
+		int         workerCount = 4;
+
+		/** Ray batches averaged per probe */
+		int         passes = 32;
+
+		/** Empty uses defaultFilename() */
+		String      outputFilename;
+
+		/** Shard baked by this process, or -1 in the coordinator */
+		int         shardIndex = -1;
+
+		/** Reads --bake-grid, --scene, --bake-workers, --bake-passes, --bake-out and --bake-shard.
+			enabled is false unless --bake-grid is present. */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+
+		bool isWorker() const {
+			return shardIndex >= 0;
+		}
+
+		String filename() const;
+	};
+
+protected:
+	class Layer
+	{
+	public:
+		String          name;
+		int             width = 0;
+		int             height = 0;
+		String          formatName;
+		Array<uint8>    texels;
+	};
+
+	/** Contents of a shard or of the final atlas file */
+	class Atlas
+	{
+	public:
+		Vector3int32    probeCounts;
+		int             firstProbe = 0;
+		int             endProbe = 0;
+		uint64          key = 0;
+		Array<Layer>    layers;
+	};
+
+	Specification           m_specification;
+
+	GridBaker(const Specification& specification) : m_specification(specification) {}
+
+	static String shardFilename(const String& filename, int shardIndex);
+
+	static void writeAtlas(const String& filename, const Atlas& atlas);
+
+	/** Returns false if the file is missing or was written by another VERSION */
+	static bool readAtlas(const String& filename, Atlas& atlas);
+
+	/** Starts argv[0] with \a args. Returns 0 on failure. */
+	static int64 startWorker(const Array<String>& args);
+
+	/** Exit code of the worker, or -1 if it could not be waited for */
+	static int waitForWorker(int64 worker);
+
+	/** Stacks the shards into the final atlas. Returns false if one is missing, inconsistent or
+		the shards do not cover the grid. */
+	static bool mergeShards(const Specification& specification);
+
+public:
+	static shared_ptr<GridBaker> create(const Specification& specification) {
+		return createShared<GridBaker>(specification);
+	}
+
+	const Specification& specification() const {
+		return m_specification;
+	}
+
+	/** Name of the atlas file baked for \a sceneName when --bake-out is not given */
+	static String defaultFilename(const String& sceneName) {
+		return FilePath::mangle(sceneName) + ".IrradianceGrid";
+	}
+
+	/** Runs the coordinator: starts the workers, waits for them and merges their shards.
+		Returns the process exit code. */
+	static int run(const Specification& specification, int argc, const char* argv[]);
+
+	/** Worker side: bakes this process's shard of \a irradianceField and writes it */
+	void bakeShard(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray) const;
+};
@@ -0,0 +1,35 @@
+#include "ImageQuality.h"
+
+ImageQuality::Metrics ImageQuality::compare(RenderDevice* rd, const shared_ptr<Texture>& test, const shared_ptr<Texture>& reference, const shared_ptr<Texture>& previous)
+{
+	alwaysAssertM((test->vector2Bounds() == reference->vector2Bounds()) && (test->vector2Bounds() == previous->vector2Bounds()),
+		"ImageQuality: " + test->name() + " and " + reference->name() + " differ in size");
+
+	if (isNull(m_errorFramebuffer))
+	{
+		m_errorFramebuffer = Framebuffer::create(Texture::createEmpty("ImageQuality::Error", test->width(), test->height(), ImageFormat::RGBA32F(), Texture::DIM_2D, true));
+	}
+	m_errorFramebuffer->resize(test->width(), test->height());
+
+	rd->push2D(m_errorFramebuffer); {
+		Args args;
+		args.setRect(rd->viewport());
+		args.setUniform("testIndirect", test, Sampler::buffer());
+		args.setUniform("referenceIndirect", reference, Sampler::buffer());
+		args.setUniform("previousIndirect", previous, Sampler::buffer());
+
+		LAUNCH_SHADER("shaders/ImageQuality_Compare.pix", args);
+	} rd->pop2D();
+
+	// The top mip level holds the screen average
+	const shared_ptr<Texture>& error = m_errorFramebuffer->texture(0);
+	error->generateMipMaps();
+	const Color4& mean = error->readTexel(0, 0, rd, error->numMipMapLevels() - 1);
+
+	Metrics metrics;
+	metrics.rmse = sqrt(mean.r);
+	metrics.relativeRMSE = (mean.g > 0.0f) ? sqrt(mean.r / mean.g) : 0.0f;
+	metrics.flip = mean.b;
+	metrics.flicker = mean.a;
+	return metrics;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Error metrics of an indirect lighting buffer against a reference, computed on the GPU
+	by shaders/ImageQuality_Compare.pix and reduced through the mip chain. */
+class ImageQuality : public ReferenceCountedObject
+{
+public:
+	class Metrics
+	{
+	public:
+		float       rmse = 0.0f;
+		/** rmse divided by the RMS of the reference */
+		float       relativeRMSE = 0.0f;
+		/** Mean FLIP-style perceptual error in [0, 1] */
+		float       flip = 0.0f;
+		/** Mean relative luminance change against the previous frame */
+		float       flicker = 0.0f;
+	};
+
+protected:
+	/** RGBA32F with mipmaps, resized to the compared images */
+	shared_ptr<Framebuffer>     m_errorFramebuffer;
+
+	ImageQuality() {}
+
+public:
+	static shared_ptr<ImageQuality> create() {
+		return createShared<ImageQuality>();
+	}
+
+	/** All three textures must have the same size. Pass test as previous when there is no previous frame.
+		Reads one texel back, so this stalls the pipeline. */
+	Metrics compare(RenderDevice* rd, const shared_ptr<Texture>& test, const shared_ptr<Texture>& reference, const shared_ptr<Texture>& previous);
+};
@@ -1,4 +1,10 @@
 #include "IrradianceField.h"
+#include "RadianceCache.h"
+#include "Telemetry.h"
+#include "ResourceTracker.h"
+#include "ProbeCache.h"
+#include "ProbeVolumePager.h"
+#include "ShaderCache.h"
 
 /** How much should the probes count when shading *themselves*? 1.0 preserves
 	energy perfectly. Lower numbers compensate for small leaks/precision by avoiding
@@ -13,6 +19,10 @@ const Array<const ImageFormat*> IrradianceField::s_irradianceFormats = {
 	ImageFormat::RGB16F(),
 	ImageFormat::RGB32F() };
 
+Array<std::pair<uint64, shared_ptr<TriTree>>> IrradianceField::s_triTreeCache;
+Array<std::shared_future<RealTime>> IrradianceField::s_orphanedBuilds;
+const RealTime IrradianceField::indirectFadeInDuration = 0.5;
+
 const Array<const ImageFormat*> IrradianceField::s_depthFormats = {
 	ImageFormat::RGB8(),
 	ImageFormat::RG16F(),
@@ -36,10 +46,23 @@ Any IrradianceField::Specification::toAny() const
 	a["irradianceRaysPerProbe"] = irradianceRaysPerProbe;
 	a["glossyToMatte"] = glossyToMatte;
 	a["singleBounce"] = singleBounce;
+	a["shortRangeTrace"] = shortRangeTrace;
+	a["shortRangeTraceDistanceScale"] = shortRangeTraceDistanceScale;
 	a["irradianceFormatIndex"] = irradianceFormatIndex;
 	a["depthFormatIndex"] = depthFormatIndex;
-	a["showLights"] = singleBounce;
+	a["showLights"] = showLights;
 	a["encloseBounds"] = encloseBounds;
+	a["pagedVolume"] = pagedVolume;
+	a["brickSize"] = brickSize;
+	a["residentBrickRadius"] = residentBrickRadius;
+	a["brickBakePasses"] = brickBakePasses;
+	a["lightChangeInvalidation"] = lightChangeInvalidation;
+	a["geometryChangeInvalidation"] = geometryChangeInvalidation;
+	a["geometryChangeMargin"] = geometryChangeMargin;
+	a["invalidationHysteresis"] = invalidationHysteresis;
+	a["invalidationExtraPasses"] = invalidationExtraPasses;
+	a["importanceSampling"] = importanceSampling;
+	a["importanceSamplingUniformFraction"] = importanceSamplingUniformFraction;
 	return a;
 }
 
@@ -60,10 +83,23 @@ IrradianceField::Specification::Specification(const Any& any)
 	reader.getIfPresent("irradianceRaysPerProbe", irradianceRaysPerProbe);
 	reader.getIfPresent("glossyToMatte", glossyToMatte);
 	reader.getIfPresent("singleBounce", singleBounce);
+	reader.getIfPresent("shortRangeTrace", shortRangeTrace);
+	reader.getIfPresent("shortRangeTraceDistanceScale", shortRangeTraceDistanceScale);
 	reader.getIfPresent("irradianceFormatIndex", irradianceFormatIndex);
 	reader.getIfPresent("depthFormatIndex", depthFormatIndex);
 	reader.getIfPresent("showLights", showLights);
 	reader.getIfPresent("encloseBounds", encloseBounds);
+	reader.getIfPresent("pagedVolume", pagedVolume);
+	reader.getIfPresent("brickSize", brickSize);
+	reader.getIfPresent("residentBrickRadius", residentBrickRadius);
+	reader.getIfPresent("brickBakePasses", brickBakePasses);
+	reader.getIfPresent("lightChangeInvalidation", lightChangeInvalidation);
+	reader.getIfPresent("geometryChangeInvalidation", geometryChangeInvalidation);
+	reader.getIfPresent("geometryChangeMargin", geometryChangeMargin);
+	reader.getIfPresent("invalidationHysteresis", invalidationHysteresis);
+	reader.getIfPresent("invalidationExtraPasses", invalidationExtraPasses);
+	reader.getIfPresent("importanceSampling", importanceSampling);
+	reader.getIfPresent("importanceSamplingUniformFraction", importanceSamplingUniformFraction);
 	reader.verifyDone();
 }
 
@@ -78,7 +114,7 @@ void IrradianceField::loadNewScene
 	const String& sceneFilename = Scene::sceneNameToFilename(sceneName);
 
 	// Check if there is an options file for this scene
-	const String& specName = FilePath::mangle(sceneName) + ".LightFieldModelSpecification.Any";
+	const String& specName = specificationFilename(sceneName);
 	const String& irradianceFieldSpecificationFilename = System::findDataFile(specName, false);
 	debugPrintf("%s\n", specName.c_str());
 
@@ -133,11 +169,12 @@ void IrradianceField::loadNewScene
 		spec.probeCounts = probeCountsOverride;
 	}
 	else if (maxProbeDistance > 0.0f) {
+		// Any dimensions work, so the grid fits the box instead of rounding each axis up to a power of two
 		spec.probeCounts = Vector3int32(Vector3(spec.probeDimensions.high() - spec.probeDimensions.low()) / Vector3(maxProbeDistance, maxProbeDistance, maxProbeDistance));
-		debugPrintf("Debug probe counts: %d, %d, %d\n", spec.probeCounts.x, spec.probeCounts.y, spec.probeCounts.z);
 		for (int i = 0; i < 3; ++i) {
-			spec.probeCounts[i] = ceilPow2(spec.probeCounts[i]);
+			spec.probeCounts[i] = max(1, spec.probeCounts[i]);
 		}
+		debugPrintf("Debug probe counts: %d, %d, %d\n", spec.probeCounts.x, spec.probeCounts.y, spec.probeCounts.z);
 	}
 
 	if (irradianceCubeResolutionOverride > 0) {
@@ -147,27 +184,7 @@ void IrradianceField::loadNewScene
 		spec.depthOctResolution = depthCubeResolutionOverride;
 	}
 
-	// Assume the probe counts are powers of two.
-	int totalProbes = spec.probeCounts.x + spec.probeCounts.y + spec.probeCounts.z;
-	// Do not go larger than 8k texture
-	static const int MAX_TEXTURE_SIZE = 4096 * 4096;
-	while ((totalProbes * spec.irradianceOctResolution * spec.irradianceOctResolution) > MAX_TEXTURE_SIZE
-		|| (totalProbes * spec.depthOctResolution * spec.depthOctResolution) > MAX_TEXTURE_SIZE) {
-		debugPrintf("Requested probe count is larger than max texture size of %d\n", MAX_TEXTURE_SIZE);
-		// Heuristics. XZ resolution is probably more important than Y resolution,
-		// unless Y resolution is relatively low...
-		if (spec.probeCounts.y > 8) {
-			spec.probeCounts.y /= 2;
-		}
-		else {
-			spec.probeCounts.x /= 2; spec.probeCounts.z /= 2;
-		}
-		totalProbes = spec.probeCounts.x + spec.probeCounts.y + spec.probeCounts.z;
-	}
-
-	const Vector3 boundingBoxLengths(spec.probeDimensions.high() - spec.probeDimensions.low());
-	// Slightly larger than the diagonal across the grid cell
-	m_maxDistance = (boundingBoxLengths / spec.probeCounts).length() * 1.5f;
+	clampProbeCounts(spec);
 
 	init(spec);
 	//allocateIntermediateBuffers();
@@ -177,6 +194,41 @@ void IrradianceField::loadNewScene
 	debugPrintf("Load complete.\n");
 }
 
+void IrradianceField::clampProbeCounts(Specification& spec)
+{
+	// A paged volume only keeps the bricks near the camera
+	if (spec.pagedVolume) {
+		return;
+	}
+
+	const int maxSize = GLCaps::maxTextureSize();
+	while (true) {
+		const Vector2int32& irradianceSize = gridAtlasSize(spec.probeCounts, spec.irradianceOctResolution);
+		const Vector2int32& depthSize = gridAtlasSize(spec.probeCounts, spec.depthOctResolution);
+		const int width = max(irradianceSize.x, depthSize.x);
+		const int height = max(irradianceSize.y, depthSize.y);
+		if ((width <= maxSize) && (height <= maxSize)) {
+			return;
+		}
+		debugPrintf("Requested probe counts need a %d x %d atlas, larger than the max texture size of %d\n", width, height, maxSize);
+
+		// A row of tiles holds x * y probes, a column z
+		if (height > maxSize) {
+			spec.probeCounts.z = max(1, spec.probeCounts.z / 2);
+		}
+		if (width > maxSize) {
+			// Heuristics. XZ resolution is probably more important than Y resolution,
+			// unless Y resolution is relatively low...
+			if (spec.probeCounts.y > 8) {
+				spec.probeCounts.y /= 2;
+			}
+			else {
+				spec.probeCounts.x = max(1, spec.probeCounts.x / 2);
+			}
+		}
+	}
+}
+
 shared_ptr<IrradianceField> IrradianceField::create
 (const String& sceneName,
 	const shared_ptr<Scene>& scene,
@@ -194,22 +246,45 @@ IrradianceField::IrradianceField()
 	m_sceneTriTree = TriTree::create(true);
 }
 
-void IrradianceField::setShaderArgs(UniformTable& args, const String& prefix) {
+IrradianceField::~IrradianceField()
+{
+	// The build only holds the trees and triangles it was given, not this field
+	if (m_triTreeBuild.valid()) {
+		s_orphanedBuilds.append(m_triTreeBuild.share());
+	}
+}
+
+void IrradianceField::reapOrphanedBuilds(bool wait)
+{
+	for (int i = 0; i < s_orphanedBuilds.size(); ++i) {
+		if (wait || (s_orphanedBuilds[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+			s_orphanedBuilds[i].wait();
+			s_orphanedBuilds.remove(i);
+			--i;
+		}
+	}
+}
+
+void IrradianceField::setShaderArgs(UniformTable& args, const String& prefix, const ScreenProbeView& view) {
 	alwaysAssertM(endsWith(prefix, "."), "Requires a struct prefix");
 
 	Sampler bilinear = Sampler::video();
-	m_irradianceProbes->setShaderArgs(args, prefix + "irradianceProbeGrid", bilinear);
-	m_meanDistProbes->setShaderArgs(args, prefix + "meanMeanSquaredProbeGrid", bilinear);
+	view.irradianceProbes->setShaderArgs(args, prefix + "irradianceProbeGrid", bilinear);
+	view.meanDistProbes->setShaderArgs(args, prefix + "meanMeanSquaredProbeGrid", bilinear);
 
 	// Uniforms to convert oct to texel and back
-	args.setUniform(prefix + "irradianceTextureWidth", m_irradianceProbes->width());
-	args.setUniform(prefix + "irradianceTextureHeight", m_irradianceProbes->height());
-	args.setUniform(prefix + "depthTextureWidth", m_meanDistProbes->width());
-	args.setUniform(prefix + "depthTextureHeight", m_meanDistProbes->height());
+	args.setUniform(prefix + "irradianceTextureWidth", view.irradianceProbes->width());
+	args.setUniform(prefix + "irradianceTextureHeight", view.irradianceProbes->height());
+	args.setUniform(prefix + "depthTextureWidth", view.meanDistProbes->width());
+	args.setUniform(prefix + "depthTextureHeight", view.meanDistProbes->height());
 	args.setUniform(prefix + "irradianceProbeSideLength", irradianceOctSideLength());
 	args.setUniform(prefix + "depthProbeSideLength", depthOctSideLength());
 
 	args.setUniform(prefix + "probeCounts", m_specification.probeCounts);
+	args.setUniform(prefix + "probeCountXMultiplier", m_probeCountXDivisor.multiplier);
+	args.setUniform(prefix + "probeCountXShift", m_probeCountXDivisor.shift);
+	args.setUniform(prefix + "probeCountXYMultiplier", m_probeCountXYDivisor.multiplier);
+	args.setUniform(prefix + "probeCountXYShift", m_probeCountXYDivisor.shift);
 	args.setUniform(prefix + "probeStartPosition", m_probeStartPosition);
 	args.setUniform(prefix + "probeStep", m_probeStep);
 
@@ -220,7 +295,16 @@ void IrradianceField::setShaderArgs(UniformTable& args, const String& prefix) {
 
 	args.setMacro("TRACE_MODE", "WORLD_SPACE_MARCH");
 	args.setMacro("FILL_HOLES", "true");
-	args.setMacro("LIGHTING_MODE", m_lightingMode);
+	// The passes that bind the field only run with indirect light, so warm that variant while the tree is built
+	args.setMacro("LIGHTING_MODE", (ShaderWarmUp::active() && (m_lightingMode == LightingMode::DIRECT_ONLY)) ? LightingMode::DIRECT_INDIRECT : m_lightingMode);
+}
+
+float IrradianceField::screenProbeTraceDistance() const
+{
+	if (m_specification.shortRangeTrace && notNull(m_radianceCache) && m_radianceCache->hasRadiance()) {
+		return m_radianceCache->probeTMin() * m_specification.shortRangeTraceDistanceScale;
+	}
+	return finf();
 }
 
 void IrradianceField::init(const Specification& spec)
@@ -228,16 +312,24 @@ void IrradianceField::init(const Specification& spec)
 	m_name = "Irradiance Field";
 
 	m_specification = spec;
-	alwaysAssertM(G3D::isPow2(m_specification.probeCounts.x * m_specification.probeCounts.y * m_specification.probeCounts.z),
-		"Probe count must be power of two");
+	alwaysAssertM((m_specification.probeCounts.x > 0) && (m_specification.probeCounts.y > 0) && (m_specification.probeCounts.z > 0),
+		"Probe counts must be positive");
+	alwaysAssertM(int64(m_specification.probeCounts.x) * m_specification.probeCounts.y * m_specification.probeCounts.z < (int64(1) << 31),
+		"Probe indices must fit in an int");
+	m_probeCountXDivisor = MagicDivisor(m_specification.probeCounts.x);
+	m_probeCountXYDivisor = MagicDivisor(m_specification.probeCounts.x * m_specification.probeCounts.y);
 
 	const Point3& lo = spec.probeDimensions.low();
 	const Point3& hi = spec.probeDimensions.high();
 	m_probeStep = (hi - lo) / (Vector3(m_specification.probeCounts) - Vector3(1, 1, 1)).max(Vector3(1, 1, 1));
 	m_probeStartPosition = lo;
+	// Slightly larger than the diagonal across the grid cell
+	m_maxDistance = ((hi - lo) / Vector3(spec.probeCounts)).length() * 1.5f;
 	m_oneBounce = spec.singleBounce;
 	m_irradianceFormatIndex = spec.irradianceFormatIndex;
 	m_depthFormatIndex = spec.depthFormatIndex;
+	m_pager = spec.pagedVolume ? ProbeVolumePager::create(spec.brickSize, spec.residentBrickRadius, spec.brickBakePasses) : nullptr;
+	m_probeInvalidation->reset();
 
 	// Special case of 1-probe high surface
 	for (int i = 0; i < 3; ++i)
@@ -251,9 +343,10 @@ void IrradianceField::init(const Specification& spec)
 
 Point3int32 IrradianceField::probeIndexToGridIndex(int index) const
 {
-	const int xIndex = index % m_specification.probeCounts.x;
-	const int yIndex = (index % (m_specification.probeCounts.x * m_specification.probeCounts.y)) / m_specification.probeCounts.x;
-	const int zIndex = index / (m_specification.probeCounts.x * m_specification.probeCounts.y);
+	const int zIndex = m_probeCountXYDivisor.divide(index);
+	const int slice = index - zIndex * m_probeCountXYDivisor.divisor;
+	const int yIndex = m_probeCountXDivisor.divide(slice);
+	const int xIndex = slice - yIndex * m_probeCountXDivisor.divisor;
 	return Point3int32(xIndex, yIndex, zIndex);
 }
 
@@ -263,31 +356,282 @@ Point3 IrradianceField::probeIndexToPosition(int index) const
 	return m_probeStep * Vector3(P) + m_probeStartPosition;
 }
 
-void IrradianceField::onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray, 
-	const shared_ptr<Texture> screenProbeWSAdaptivePositionTexture, 
-	const shared_ptr<Texture> screenProbeWSUniformPositionTexture, 
-	const shared_ptr<Texture> screenProbeSSAdaptivePositionTexture,
-	const shared_ptr<Texture> numAdaptiveScreenProbesTexture, 
-	const shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture, 
-	const shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture, 
-	shared_ptr<GBuffer> m_gbuffer)
+void IrradianceField::onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray, const Array<shared_ptr<ScreenProbeView>>& views)
 {
-	if (m_sceneDirty && System::time() - lastSceneUpdateTime() > 0.1)
+	reapOrphanedBuilds();
+
+	if (m_triTreeBuild.valid() && (m_triTreeBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
 	{
-		m_sceneTriTree->setContents(m_scene);
+		// get() rethrows anything the build threw
+		installSceneTriTree(m_pendingTriTree, m_pendingDynamicTriTree, m_triTreeBuild.get());
+		m_pendingTriTree.reset();
+		m_pendingDynamicTriTree.reset();
+	}
+
+	if (notNull(m_scene)) {
+		updateProbeInvalidation();
+	}
+
+	if ((m_sceneDirty || m_dynamicDirty) && !m_triTreeBuild.valid() && System::time() - lastSceneUpdateTime() > 0.1)
+	{
+		updateSceneTriTree();
 		m_sceneDirty = false;
+		m_dynamicDirty = false;
 	}
 
-	generateIrradianceProbes(rd, screenProbeWSAdaptivePositionTexture, screenProbeWSUniformPositionTexture, screenProbeSSAdaptivePositionTexture, numAdaptiveScreenProbesTexture, screenTileAdaptiveProbeHeaderTexture, screenTileAdaptiveProbeIndicesTexture, m_gbuffer);
-	generateIrradianceRays(rd, m_scene);
-	sampleAndShadeIrradianceRays(rd, m_scene, surfaceArray);
-	updateIrradianceProbes(rd, m_scene);
+	m_views = views;
+	if (m_views.size() == 0) {
+		return;
+	}
+
+	// A new specification resets the atlases of every view
+	const bool reallocate = m_probeFormatChanged;
+	m_probeFormatChanged = false;
+	if (m_firstFrame) {
+		for (const shared_ptr<ScreenProbeView>& view : m_views) {
+			view->firstFrame = true;
+		}
+		m_firstFrame = false;
+	}
+
+	// One batch for all views: the rays of view i follow those of view i - 1
+	int probeRows = 0;
+	for (const shared_ptr<ScreenProbeView>& view : m_views) {
+		generateIrradianceProbes(rd, *view, reallocate);
+		view->rayRowOffset = probeRows;
+		probeRows += view->probeCount();
+	}
+	allocateRayBuffers(m_screenProbeRays, "screenProbeRays", probeRows);
+
+	if (m_lightingMode == LightingMode::DIRECT_ONLY)
+	{
+		// Nothing to trace against yet
+		return;
+	}
+
+	updateScreenProbes(rd, surfaceArray);
+
+	// More rays for the probes near lights and geometry that changed. The other probes trace empty
+	// rays, which the tracer rejects immediately, and keep their contents.
+	m_invalidationPass = true;
+	for (int pass = 0; (pass < m_specification.invalidationExtraPasses) && m_probeInvalidation->active(); ++pass) {
+		updateScreenProbes(rd, surfaceArray);
+		Telemetry::add("probeInvalidation.extraPasses", 1.0);
+	}
+	m_invalidationPass = false;
+
+	if (notNull(m_pager)) {
+		m_pager->update(rd, *this, surfaceArray, m_views[0]->camera->frame().translation);
+	}
+}
+
+uint64 IrradianceField::probeCacheKey(uint64 sceneHash) const
+{
+	return ProbeCache::hash(format("%d|%d|%s", m_irradianceFormatIndex, m_depthFormatIndex, m_specification.toAny().unparse().c_str()), sceneHash);
+}
+
+void IrradianceField::requestProbeCacheRestore(const String& filename, uint64 key)
+{
+	m_probeCacheFilename = filename;
+	m_probeCacheKey = key;
+	m_probeCacheRestorePending = true;
+}
+
+void IrradianceField::saveProbeCache(const CoordinateFrame& cameraFrame) const
+{
+	if (m_probeCacheFilename.empty() || (m_views.size() == 0) || isNull(m_views[0]->irradianceProbes) || m_probeCacheRestorePending) {
+		return;
+	}
+	const ScreenProbeView& view = *m_views[0];
+	ProbeCache::save(m_probeCacheFilename, m_probeCacheKey, cameraFrame, m_specification.toAny().unparse(), { view.irradianceProbes, view.meanDistProbes });
 }
 
-void IrradianceField::onSceneChanged(const shared_ptr<Scene>& scene)
+void IrradianceField::onSceneChanged(const shared_ptr<Scene>& scene, uint64 geometryHash)
 {
 	m_scene = scene;
+	m_geometryHash = geometryHash;
 	m_sceneDirty = true;
+	m_dynamicEntities.clear();
+	m_dynamicTriTree.reset();
+	m_dynamicDirty = false;
+	m_probeInvalidation->reset();
+}
+
+void IrradianceField::updateProbeInvalidation()
+{
+	m_probeInvalidation->setHysteresis(m_specification.hysteresis, m_specification.invalidationHysteresis);
+
+	if (m_specification.lightChangeInvalidation) {
+		m_probeInvalidation->updateLights(m_scene->lightingEnvironment());
+	} else {
+		m_probeInvalidation->forget(ProbeInvalidation::Region::LIGHT);
+	}
+
+	if (!m_specification.geometryChangeInvalidation) {
+		m_probeInvalidation->forget(ProbeInvalidation::Region::ENTITY);
+		return;
+	}
+
+	Array<Sphere> moved;
+	Array<String> movedNames;
+	m_probeInvalidation->updateEntities(m_scene, m_specification.geometryChangeMargin, moved, movedNames);
+	for (const String& name : movedNames) {
+		if (!m_dynamicEntities.contains(name)) {
+			// Leaves the static tree, which is rebuilt once without it
+			m_dynamicEntities.append(name);
+			m_sceneDirty = true;
+		}
+	}
+
+	if (moved.size() > 0) {
+		// Trace against the new positions
+		m_dynamicDirty = true;
+		if (notNull(m_pager)) {
+			for (const Sphere& bounds : moved) {
+				m_pager->invalidate(*this, bounds);
+			}
+		}
+	}
+}
+
+/** Extracts the triangles of \a surfaces into \a tris and \a vertices */
+static void extractTris(const Array<shared_ptr<Surface>>& surfaces, CPUVertexArray& vertices, Array<Tri>& tris)
+{
+	Surface::getTris(surfaces, vertices, tris);
+
+	const Material* previous = nullptr;
+	for (const Tri& tri : tris) {
+		const shared_ptr<Material>& material = tri.material();
+		// Consecutive triangles usually share their material
+		if (notNull(material) && (material.get() != previous)) {
+			material->setStorage(ImageStorage::COPY_TO_CPU_IMAGE);
+			previous = material.get();
+		}
+	}
+}
+
+void IrradianceField::updateSceneTriTree()
+{
+	if (m_sceneDirty && (m_dynamicEntities.size() == 0)) {
+		for (const std::pair<uint64, shared_ptr<TriTree>>& entry : s_triTreeCache) {
+			if ((m_geometryHash != 0) && (entry.first == m_geometryHash)) {
+				m_sceneTriTree = entry.second;
+				m_dynamicTriTree.reset();
+				m_lightingMode = LightingMode::DIRECT_INDIRECT;
+				logPrintf("IrradianceField: reusing the TriTree built for geometry %016llx\n", (unsigned long long)m_geometryHash);
+				return;
+			}
+		}
+	}
+
+	// Posing the scene and copying the material images to the CPU for the tracer need the
+	// render thread; only building the hierarchy over the extracted triangles is moved off it.
+	// The static tree is only rebuilt when an entity joins m_dynamicEntities.
+	Array<shared_ptr<Surface>> surfaces;
+	Array<shared_ptr<Surface>> dynamicSurfaces;
+	if (m_dynamicEntities.size() == 0) {
+		m_scene->onPose(surfaces);
+	} else {
+		Array<shared_ptr<Entity>> entities;
+		m_scene->getTypedEntityArray<Entity>(entities);
+		for (const shared_ptr<Entity>& entity : entities) {
+			if (m_dynamicEntities.contains(entity->name())) {
+				entity->onPose(dynamicSurfaces);
+			} else if (m_sceneDirty) {
+				entity->onPose(surfaces);
+			}
+		}
+	}
+
+	const shared_ptr<Array<Tri>> tris = std::make_shared<Array<Tri>>();
+	const shared_ptr<CPUVertexArray> vertices = std::make_shared<CPUVertexArray>();
+	extractTris(surfaces, *vertices, *tris);
+
+	const shared_ptr<Array<Tri>> dynamicTris = std::make_shared<Array<Tri>>();
+	const shared_ptr<CPUVertexArray> dynamicVertices = std::make_shared<CPUVertexArray>();
+	extractTris(dynamicSurfaces, *dynamicVertices, *dynamicTris);
+	Telemetry::set("triTree.dynamicTris", double(dynamicTris->size()));
+
+	// Always build into fresh trees: the current ones keep serving rays meanwhile and the static
+	// one may be cached under another hash
+	const shared_ptr<TriTree>& tree = m_sceneDirty ? TriTree::create(true) : nullptr;
+	const shared_ptr<TriTree>& dynamicTree = (m_dynamicEntities.size() > 0) ? TriTree::create(true) : nullptr;
+	const auto build = [tree, tris, vertices, dynamicTree, dynamicTris, dynamicVertices]() {
+		const RealTime start = System::time();
+		if (notNull(tree)) {
+			tree->setContents(*tris, *vertices, ImageStorage::IMAGE_STORAGE_CURRENT);
+		}
+		if (notNull(dynamicTree)) {
+			dynamicTree->setContents(*dynamicTris, *dynamicVertices, ImageStorage::IMAGE_STORAGE_CURRENT);
+		}
+		return System::time() - start;
+	};
+
+	if (m_backgroundBuild) {
+		m_pendingTriTree = tree;
+		m_pendingDynamicTriTree = dynamicTree;
+		m_triTreeBuild = std::async(std::launch::async, build);
+		if (m_sceneTriTree->size() == 0) {
+			// First build for this scene: render direct lighting only until it finishes
+			m_lightingMode = LightingMode::DIRECT_ONLY;
+		}
+	} else {
+		installSceneTriTree(tree, dynamicTree, build());
+	}
+}
+
+void IrradianceField::installSceneTriTree(const shared_ptr<TriTree>& tree, const shared_ptr<TriTree>& dynamicTree, RealTime buildTime)
+{
+	if (notNull(tree)) {
+		m_sceneTriTree = tree;
+
+		// Without a dynamic tree the static one holds exactly the geometry of m_geometryHash
+		if ((m_geometryHash != 0) && isNull(dynamicTree)) {
+			if (s_triTreeCache.size() >= s_triTreeCacheSize) {
+				s_triTreeCache.remove(0);
+			}
+			s_triTreeCache.append(std::make_pair(m_geometryHash, m_sceneTriTree));
+		}
+	}
+	m_dynamicTriTree = dynamicTree;
+	Telemetry::set("triTree.rebuildMs", buildTime * 1000.0);
+
+	// Probes near moved geometry converged against the old tree so far
+	m_probeInvalidation->restart(ProbeInvalidation::Region::ENTITY);
+
+	if (m_lightingMode == LightingMode::DIRECT_ONLY) {
+		m_lightingMode = LightingMode::DIRECT_INDIRECT;
+		m_sceneReadyTime = System::time();
+	}
+}
+
+void IrradianceField::finishSceneTriTree()
+{
+	if (m_triTreeBuild.valid()) {
+		installSceneTriTree(m_pendingTriTree, m_pendingDynamicTriTree, m_triTreeBuild.get());
+		m_pendingTriTree.reset();
+		m_pendingDynamicTriTree.reset();
+	}
+
+	if (m_sceneDirty || m_dynamicDirty) {
+		const bool backgroundBuild = m_backgroundBuild;
+		m_backgroundBuild = false;
+		updateSceneTriTree();
+		m_backgroundBuild = backgroundBuild;
+		m_sceneDirty = false;
+		m_dynamicDirty = false;
+	}
+}
+
+float IrradianceField::indirectWeight() const
+{
+	if (m_lightingMode == LightingMode::DIRECT_ONLY) {
+		return 0.0f;
+	} else if (m_sceneReadyTime == 0) {
+		return 1.0f;
+	} else {
+		return clamp(float((System::time() - m_sceneReadyTime) / indirectFadeInDuration), 0.0f, 1.0f);
+	}
 }
 
 Color3 IrradianceField::probeCoordVisualizationColor(Point3int32 P)
@@ -314,64 +658,38 @@ void IrradianceField::debugDraw() const
 	}
 }
 
-void IrradianceField::allocateIntermediateBuffers()
+bool IrradianceField::hasSecondaryBounce() const
 {
-	const ImageFormat* depthFormat = ImageFormat::DEPTH32();
-
-	GBuffer::Specification gbufferRTSpec;
-
-	gbufferRTSpec.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA32F();
-	gbufferRTSpec.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA32F();
-	gbufferRTSpec.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::RGBA32F();
-	gbufferRTSpec.encoding[GBuffer::Field::TRANSMISSIVE].format = ImageFormat::RGBA32F();
-	gbufferRTSpec.encoding[GBuffer::Field::WS_POSITION].format = ImageFormat::RGBA32F();
-	gbufferRTSpec.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA32F(), FrameName::CAMERA, 1.0f, 0.0f);
-	gbufferRTSpec.encoding[GBuffer::Field::DEPTH_AND_STENCIL].format = nullptr;
-	gbufferRTSpec.encoding[GBuffer::Field::CS_NORMAL] = nullptr;
-	gbufferRTSpec.encoding[GBuffer::Field::CS_POSITION] = nullptr;
-
-	//int rayDimX = probeCount();
-	int rayDimX = screenProbeWSUniformPositionTexture->width() * screenProbeWSUniformPositionTexture->height() + adaptiveProbeCount;
-	int rayDimY = m_specification.irradianceRaysPerProbe;
-
-	
-	m_irradianceRaysGBuffer = GBuffer::create(gbufferRTSpec, "IrradianceField::m_irradianceRaysGBuffer");
-	m_irradianceRaysGBuffer->setSpecification(gbufferRTSpec);
-	m_irradianceRaysGBuffer->resize(rayDimX, rayDimY);
+	return (notNull(m_pager) && (m_pager->residentBrickCount() > 0)) || (notNull(m_radianceCache) && m_radianceCache->hasRadiance());
 }
 
-void IrradianceField::renderIndirectIllumination
+void IrradianceField::renderSecondaryBounce
    (RenderDevice*                          rd,
 	const shared_ptr<GBuffer>&             gbuffer,
-	const LightingEnvironment&             environment)
+	const shared_ptr<Framebuffer>&         matteIndirectFB)
 {
-	m_giFramebuffer->resize(gbuffer->width(), gbuffer->height());
+	matteIndirectFB->resize(gbuffer->width(), gbuffer->height());
 
-	// Compute GI
-	rd->push2D(m_giFramebuffer); {
-		rd->setGuardBandClip2D(gbuffer->colorGuardBandThickness());
-		// Don't shade the skybox on this pass because it will be forward rendered
-		rd->setDepthTest(RenderDevice::DEPTH_GREATER);
+	rd->push2D(matteIndirectFB); {
 		Args args;
-		gbuffer->setShaderArgsRead(args, "gbuffer_");
-		args.setRect(rd->viewport());
-		setShaderArgs(args, "irradianceFieldSurface.");
-		m_irradianceRayOrigins->setShaderArgs(args, "gbuffer_WS_RAY_ORIGIN_", Sampler::buffer());
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+		gbuffer->texture(GBuffer::Field::WS_POSITION)->setShaderArgs(args, "rayHitLocations.", Sampler::buffer());
+		gbuffer->texture(GBuffer::Field::WS_NORMAL)->setShaderArgs(args, "rayHitNormals.", Sampler::buffer());
 		args.setUniform("energyPreservation", recursiveEnergyPreservation);
-		args.setMacro("RT_GBUFFER", 1);
-
-		args.setUniform("screenProbeDownsampleFactor", screenProbeDownsampleFactor);
-		args.setUniform("viewport_height", rd->viewport().height());
-		args.setUniform("viewport_width", rd->viewport().width());		
-		args.setUniform("adaptiveProbeNum", adaptiveProbeCount);
-		args.setUniform("ws_positionTexture", m_gbuffer->texture(GBuffer::Field::WS_POSITION), Sampler::buffer());
-		args.setUniform("depthTexture", m_gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
-		args.setUniform("ws_normalTexture", m_gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
-		args.setUniform("adaptiveProbeSSPosData",screenProbeSSAdaptivePositionTexture,Sampler::buffer());
-		args.setUniform("screenTileHeaderData", screenTileAdaptiveProbeHeaderTexture, Sampler::buffer());
-		args.setUniform("screenTileProbeIndex", screenTileAdaptiveProbeIndicesTexture, Sampler::buffer());
-
-		LAUNCH_SHADER("shaders/GIRenderer_ComputeIndirect.pix", args);
+
+		const bool pagedVolume = notNull(m_pager) && (m_pager->residentBrickCount() > 0);
+		args.setMacro("PAGED_VOLUME", pagedVolume);
+		if (pagedVolume) {
+			m_pager->setShaderArgs(args, "pagedVolume.", *this);
+		}
+
+		const bool radianceCache = notNull(m_radianceCache) && m_radianceCache->hasRadiance();
+		args.setMacro("RADIANCE_CACHE", radianceCache);
+		if (radianceCache) {
+			m_radianceCache->setShaderArgs(args, "radianceCache.");
+		}
+
+		LAUNCH_SHADER("shaders/IrradianceField_SecondaryBounce.pix", args);
 	} rd->pop2D();
 }
 
@@ -379,66 +697,191 @@ void IrradianceField::generateIrradianceRays(RenderDevice* rd, const shared_ptr<
 {
 	BEGIN_PROFILER_EVENT("generateIrradianceRays");
 
-	rd->push2D(m_irradianceRaysFB); {
-		Args args;
-
-		args.setMacro("RAYS_PER_PROBE", m_specification.irradianceRaysPerProbe);
-		args.setRect(rd->viewport());
-		screenProbeWSAdaptivePositionTexture->setShaderArgs(args, "adaptiveWSPosition.", Sampler::buffer());
-		screenProbeWSUniformPositionTexture->setShaderArgs(args, "uniformWSPosition.", Sampler::buffer());
-		args.setUniform("uniformProbeCountX", screenProbeWSUniformPositionTexture->width());
-		args.setUniform("uniformProbeCountY", screenProbeWSUniformPositionTexture->height());
-		args.setUniform("adaptiveProbeCount", adaptiveProbeCount);
-		
-		setShaderArgs(args, "irradianceFieldSurface.");
-		args.setUniform("randomOrientation", Matrix3::fromAxisAngle(Vector3::random(), Random::common().uniform(0.f, 2 * pif())));
+	// The same orientation for every view, so that the batch is one set of directions
+	const Matrix3& randomOrientation = Matrix3::fromAxisAngle(Vector3::random(), Random::common().uniform(0.f, 2 * pif()));
 
-		LAUNCH_SHADER("shaders/IrradianceField_GenerateRandomRays.pix", args);
+	rd->push2D(m_screenProbeRays.raysFB); {
+		for (const shared_ptr<ScreenProbeView>& view : m_views)
+		{
+			if (view->probeCount() == 0) {
+				continue;
+			}
 
+			Args args;
+
+			args.setMacro("RAYS_PER_PROBE", m_specification.irradianceRaysPerProbe);
+			args.setRect(ShaderWarmUp::rect(rd, Rect2D::xywh(0.0f, float(view->rayRowOffset), rd->viewport().width(), float(view->probeCount()))));
+			view->screenProbeWSAdaptivePositionTexture->setShaderArgs(args, "adaptiveWSPosition.", Sampler::buffer());
+			view->screenProbeWSUniformPositionTexture->setShaderArgs(args, "uniformWSPosition.", Sampler::buffer());
+			args.setUniform("uniformProbeCountX", view->screenProbeWSUniformPositionTexture->width());
+			args.setUniform("uniformProbeCountY", view->screenProbeWSUniformPositionTexture->height());
+			args.setUniform("adaptiveProbeCount", view->adaptiveProbeCount);
+			args.setUniform("probeRowOffset", view->rayRowOffset);
+			args.setUniform("rayMaxDistance", screenProbeTraceDistance());
+
+			setShaderArgs(args, "irradianceFieldSurface.", *view);
+			args.setUniform("randomOrientation", randomOrientation);
+			m_probeInvalidation->setShaderArgs(args, "probeInvalidation.");
+			args.setUniform("invalidatedProbesOnly", m_invalidationPass);
+
+			// The first rays of each probe are uniform, the rest follow last frame's irradiance
+			const int rays = m_specification.irradianceRaysPerProbe;
+			const bool guided = m_specification.importanceSampling && !view->firstFrame;
+			args.setUniform("uniformRayCount", guided ? iClamp(iRound(rays * m_specification.importanceSamplingUniformFraction), 1, rays) : rays);
+			args.setUniform("randomSeed", Random::common().bits());
+
+			LAUNCH_SHADER("shaders/IrradianceField_GenerateRandomRays.pix", args);
+		}
 	} rd->pop2D();
 
 	END_PROFILER_EVENT();
 }
 
-void IrradianceField::sampleAndShadeArbitraryRays
-   (RenderDevice*                       rd,
-	const Array<shared_ptr<Surface>>&   surfaceArray,
-	const shared_ptr<Framebuffer>&      targetFramebuffer,
-	const LightingEnvironment&          environment,
-	const shared_ptr<Texture>&          rayOrigins,
-	const shared_ptr<Texture>&          rayDirections,
-	const bool                          useProbeIndirect,
-	const bool                          glossyToMatte,
-	const shared_ptr<GBuffer>&          gbuffer,
-	const TriTree::IntersectRayOptions  traceOptions)
+/** G-buffer fields of a CPU trace: position and normal are RGBA32F, lambertian and glossy RGBA8 */
+static void createHitBuffers(int width, int height, shared_ptr<GLPixelTransferBuffer> buffers[5])
 {
-	BEGIN_PROFILER_EVENT("sampleAndShadeArbitraryRays");
-	//m_sceneTriTree->intersectRays(rayOrigins, rayDirections, gbuffer, traceOptions);
-
-	int Width = rayOrigins->width();
-	int Height = rayOrigins->height();
-	shared_ptr<GLPixelTransferBuffer> RTOutBuffers[5];
 	for (int i = 0; i < 5; ++i)
 	{
 		switch (i) {
 		case 2:
 		case 3:
-			RTOutBuffers[i] = GLPixelTransferBuffer::create(Width, Height, ImageFormat::RGBA8());// , nullptr, 1, GL_STREAM_DRAW);
+			buffers[i] = ResourceTracker::createBuffer("IrradianceField", "RTOutBuffer", width, height, ImageFormat::RGBA8());// , nullptr, 1, GL_STREAM_DRAW);
 			break;
 		default:
-			RTOutBuffers[i] = GLPixelTransferBuffer::create(Width, Height, ImageFormat::RGBA32F());// , nullptr, 1, GL_STREAM_DRAW);
+			buffers[i] = ResourceTracker::createBuffer("IrradianceField", "RTOutBuffer", width, height, ImageFormat::RGBA32F());// , nullptr, 1, GL_STREAM_DRAW);
+		}
+	}
+}
+
+/** Replaces each hit in \a hits by the one in \a otherHits where that is nearer to the ray origin */
+static void mergeNearestHits(const shared_ptr<GLPixelTransferBuffer>& origins, const shared_ptr<GLPixelTransferBuffer> hits[5], const shared_ptr<GLPixelTransferBuffer> otherHits[5])
+{
+	const int64 rayCount = int64(origins->width()) * int64(origins->height());
+	const Vector4* O = (const Vector4*)origins->mapRead();
+	void* dst[5];
+	const void* src[5];
+	for (int i = 0; i < 5; ++i) {
+		dst[i] = hits[i]->mapReadWrite();
+		src[i] = otherHits[i]->mapRead();
+	}
+
+	for (int64 r = 0; r < rayCount; ++r) {
+		// Misses have a zero normal
+		if (((const Vector4*)src[1])[r].xyz().squaredLength() == 0.0f) {
+			continue;
+		}
+		const bool hit = (((const Vector4*)dst[1])[r].xyz().squaredLength() > 0.0f);
+		if (hit && ((((const Vector4*)dst[0])[r].xyz() - O[r].xyz()).squaredLength() <= (((const Vector4*)src[0])[r].xyz() - O[r].xyz()).squaredLength())) {
+			continue;
+		}
+		for (int i = 0; i < 5; ++i) {
+			if ((i == 2) || (i == 3)) {
+				((uint32*)dst[i])[r] = ((const uint32*)src[i])[r];
+			} else {
+				((Vector4*)dst[i])[r] = ((const Vector4*)src[i])[r];
+			}
 		}
 	}
 
-	m_sceneTriTree->intersectRays(rayOrigins->toPixelTransferBuffer(), rayDirections->toPixelTransferBuffer(), RTOutBuffers);
+	for (int i = 0; i < 5; ++i) {
+		hits[i]->unmap();
+		otherHits[i]->unmap();
+	}
+	origins->unmap();
+}
+
+void IrradianceField::traceArbitraryRays
+   (const shared_ptr<Texture>&          rayOrigins,
+	const shared_ptr<Texture>&          rayDirections,
+	const shared_ptr<GBuffer>&          gbuffer,
+	const String&                       telemetryPrefix)
+{
+	int Width = rayOrigins->width();
+	int Height = rayOrigins->height();
+	shared_ptr<GLPixelTransferBuffer> RTOutBuffers[5];
+	createHitBuffers(Width, Height, RTOutBuffers);
+
+	const RealTime traceStart = System::time();
+	const shared_ptr<GLPixelTransferBuffer>& origins = ResourceTracker::readback("IrradianceField", rayOrigins);
+	const shared_ptr<GLPixelTransferBuffer>& directions = ResourceTracker::readback("IrradianceField", rayDirections);
+	m_sceneTriTree->intersectRays(origins, directions, RTOutBuffers);
+	if (notNull(m_dynamicTriTree) && (m_dynamicTriTree->size() > 0)) {
+		shared_ptr<GLPixelTransferBuffer> dynamicHits[5];
+		createHitBuffers(Width, Height, dynamicHits);
+		m_dynamicTriTree->intersectRays(origins, directions, dynamicHits);
+		mergeNearestHits(origins, RTOutBuffers, dynamicHits);
+	}
+	Telemetry::add(telemetryPrefix + ".traceMs", (System::time() - traceStart) * 1000.0);
+
+	const int64 rayCount = int64(Width) * int64(Height);
+	Telemetry::add(telemetryPrefix + ".rays", double(rayCount));
+	Telemetry::add("transfer.downloadBytes", double(rayCount * (rayOrigins->format()->openGLBitsPerPixel + rayDirections->format()->openGLBitsPerPixel) / 8));
+	size_t hitBytes = 0;
+	for (int i = 0; i < 5; ++i) {
+		hitBytes += RTOutBuffers[i]->size();
+	}
+	Telemetry::add("transfer.uploadBytes", double(hitBytes));
+
+	if (Telemetry::enabled() && (rayCount > 0)) {
+		// Misses have a zero normal, see IrradianceField_UpdateIrradianceProbe.pix
+		const Vector4* normals = (const Vector4*)RTOutBuffers[1]->mapRead();
+		int64 hits = 0;
+		for (int64 i = 0; i < rayCount; ++i) {
+			hits += (normals[i].xyz().squaredLength() > 0.0f) ? 1 : 0;
+		}
+		RTOutBuffers[1]->unmap();
+		Telemetry::set(telemetryPrefix + ".hitRatio", double(hits) / double(rayCount));
+	}
 
 	gbuffer->texture(GBuffer::Field::WS_POSITION)->update(RTOutBuffers[0]);
 	gbuffer->texture(GBuffer::Field::WS_NORMAL)->update(  RTOutBuffers[1]);
 	gbuffer->texture(GBuffer::Field::LAMBERTIAN)->update( RTOutBuffers[2]);
 	gbuffer->texture(GBuffer::Field::GLOSSY)->update(     RTOutBuffers[3]);
 	gbuffer->texture(GBuffer::Field::EMISSIVE)->update(   RTOutBuffers[4]);
+}
+
+void IrradianceField::sampleAndShadeArbitraryRays
+   (RenderDevice*                       rd,
+	const Array<shared_ptr<Surface>>&   surfaceArray,
+	const shared_ptr<Framebuffer>&      targetFramebuffer,
+	const LightingEnvironment&          environment,
+	const shared_ptr<Texture>&          rayOrigins,
+	const shared_ptr<Texture>&          rayDirections,
+	const shared_ptr<Framebuffer>&      matteIndirectFB,
+	const bool                          glossyToMatte,
+	const shared_ptr<GBuffer>&          gbuffer,
+	const TriTree::IntersectRayOptions  traceOptions,
+	const String&                       telemetryPrefix)
+{
+	BEGIN_PROFILER_EVENT("sampleAndShadeArbitraryRays");
+	//m_sceneTriTree->intersectRays(rayOrigins, rayDirections, gbuffer, traceOptions);
 
-	renderIndirectIllumination(rd, gbuffer, environment);
+	// While warming up, the shading passes read whatever the buffers hold
+	if (!ShaderWarmUp::active()) {
+		traceArbitraryRays(rayOrigins, rayDirections, gbuffer, telemetryPrefix);
+	}
+	shadeArbitraryRays(rd, surfaceArray, targetFramebuffer, environment, rayOrigins, rayDirections, matteIndirectFB, glossyToMatte, gbuffer);
+
+	END_PROFILER_EVENT();
+}
+
+void IrradianceField::shadeArbitraryRays
+   (RenderDevice*                       rd,
+	const Array<shared_ptr<Surface>>&   surfaceArray,
+	const shared_ptr<Framebuffer>&      targetFramebuffer,
+	const LightingEnvironment&          environment,
+	const shared_ptr<Texture>&          rayOrigins,
+	const shared_ptr<Texture>&          rayDirections,
+	const shared_ptr<Framebuffer>&      matteIndirectFB,
+	const bool                          glossyToMatte,
+	const shared_ptr<GBuffer>&          gbuffer)
+{
+	// Multi-bounce comes from the resident grid bricks and last frame's radiance cache, which cover
+	// hits outside the view
+	const bool secondaryBounce = notNull(matteIndirectFB) && hasSecondaryBounce();
+	if (secondaryBounce) {
+		renderSecondaryBounce(rd, gbuffer, matteIndirectFB);
+	}
 
 	// Find the skybox
 	shared_ptr<SkyboxSurface> skyboxSurface;
@@ -458,10 +901,11 @@ void IrradianceField::sampleAndShadeArbitraryRays
 		Args args;
 		e.setShaderArgs(args);
 		gbuffer->setShaderArgsRead(args, "gbuffer_");
-		args.setRect(rd->viewport());
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
 
 		args.setMacro("GLOSSY_TO_MATTE", glossyToMatte);
-		args.setUniform("matteIndirectBuffer", useProbeIndirect ? m_giFramebuffer->texture(0) : Texture::opaqueBlack(), Sampler::buffer());
+		args.setUniform("matteIndirectBuffer", secondaryBounce ? matteIndirectFB->texture(0) : Texture::opaqueBlack(), Sampler::buffer());
+		args.setUniform("indirectWeight", 1.0f);
 		args.setMacro("LIGHTING_MODE", LightingMode::DIRECT_INDIRECT);
 
 		args.setMacro("OVERRIDE_SKYBOX", true);
@@ -476,28 +920,27 @@ void IrradianceField::sampleAndShadeArbitraryRays
 
 		LAUNCH_SHADER("shaders/GIRenderer_DeferredShade.pix", args);
 	} rd->pop2D();
-
-	END_PROFILER_EVENT();
 }
 
-void IrradianceField::sampleAndShadeIrradianceRays(RenderDevice* rd, const shared_ptr<Scene>& scene, const Array<shared_ptr<Surface>>& surfaceArray)
+void IrradianceField::sampleAndShadeIrradianceRays(RenderDevice* rd, const shared_ptr<Scene>& scene, const Array<shared_ptr<Surface>>& surfaceArray, RayBuffers& rays)
 {
 	BEGIN_PROFILER_EVENT("sampleIrradianceRays");
 
-	m_irradianceRaysGBuffer->prepare(rd, 0.0f, 0.0f, Vector2int16(0, 0), Vector2int16(0, 0));
+	rays.gbuffer->prepare(rd, 0.0f, 0.0f, Vector2int16(0, 0), Vector2int16(0, 0));
 
 	// Don't cull backfaces...if a probe looks through a back face (e.g., single-sided ceiling), it will get incorrect results
 	sampleAndShadeArbitraryRays
 	    (rd,
 		surfaceArray,
-		m_irradianceRaysShadedFB,
+		rays.shadedFB,
 		scene->lightingEnvironment(),
-		m_irradianceRayOrigins,
-		m_irradianceRayDirections,
-		!m_oneBounce,
+		rays.origins,
+		rays.directions,
+		m_oneBounce ? nullptr : rays.matteIndirectFB,
 		m_specification.glossyToMatte,
-		m_irradianceRaysGBuffer,
-		TriTree::DO_NOT_CULL_BACKFACES);
+		rays.gbuffer,
+		TriTree::DO_NOT_CULL_BACKFACES,
+		"irradianceField");
 
 	END_PROFILER_EVENT();
 }
@@ -508,17 +951,81 @@ void IrradianceField::updateIrradianceProbes(RenderDevice* rd, const shared_ptr<
 
 	static const bool IRRADIANCE = true, DEPTH = false;
 
-	updateIrradianceProbe(rd, IRRADIANCE);
-	updateIrradianceProbe(rd, DEPTH);
-
-	m_firstFrame = false;
+	// Rays were capped in generateIrradianceRays(); resolve their misses from last frame's radiance cache
+	const bool shortRangeTrace = screenProbeTraceDistance() < finf();
+	for (const shared_ptr<ScreenProbeView>& view : m_views)
+	{
+		updateIrradianceProbe(rd, *view, IRRADIANCE, shortRangeTrace);
+		updateIrradianceProbe(rd, *view, DEPTH, shortRangeTrace);
+		view->firstFrame = false;
+	}
+	m_probeInvalidation->onProbesUpdated();
 
 	END_PROFILER_EVENT();
 }
 
-void IrradianceField::updateIrradianceProbe(RenderDevice* rd, bool irradiance)
+void IrradianceField::updateScreenProbes(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray)
+{
+	RenderGraph& graph = *m_renderGraph;
+	graph.reset();
+
+	// Kept across frames only to avoid reallocating them, so they do not keep a pass alive
+	RayBuffers& rays = m_screenProbeRays;
+	const RenderGraph::Handle rayHandle = graph.importFramebuffer("IrradianceField::screenProbeRays::rays", rays.raysFB, false);
+	const RenderGraph::Handle hits = graph.importTexture("IrradianceField::screenProbeRays::hits", rays.gbuffer->texture(GBuffer::Field::WS_POSITION), false);
+	const RenderGraph::Handle shaded = graph.importFramebuffer("IrradianceField::screenProbeRays::shaded", rays.shadedFB, false);
+
+	RenderGraph::Pass& generate = graph.addPass("GenerateIrradianceRays", [this](RenderDevice* rd) {
+		generateIrradianceRays(rd, m_scene);
+	}).write(rayHandle);
+
+	graph.addPass("TraceIrradianceRays", [this, &rays](RenderDevice* rd) {
+		rays.gbuffer->prepare(rd, 0.0f, 0.0f, Vector2int16(0, 0), Vector2int16(0, 0));
+		traceArbitraryRays(rays.origins, rays.directions, rays.gbuffer, "irradianceField");
+	}).read(rayHandle).write(hits);
+
+	graph.addPass("ShadeIrradianceRays", [this, &rays, &surfaceArray](RenderDevice* rd) {
+		shadeArbitraryRays(rd, surfaceArray, rays.shadedFB, m_scene->lightingEnvironment(), rays.origins, rays.directions,
+			m_oneBounce ? nullptr : rays.matteIndirectFB, m_specification.glossyToMatte, rays.gbuffer);
+	}).read(rayHandle).read(hits).write(shaded);
+
+	RenderGraph::Pass& update = graph.addPass("UpdateIrradianceProbes", [this](RenderDevice* rd) {
+		updateIrradianceProbes(rd, m_scene);
+	}).read(rayHandle).read(hits).read(shaded);
+
+	for (const shared_ptr<ScreenProbeView>& view : m_views) {
+		if (view->probeCount() == 0) {
+			continue;
+		}
+		generate.read(graph.importTexture(view->name + "::screenProbeWSUniformPositionTexture", view->screenProbeWSUniformPositionTexture));
+		generate.read(graph.importTexture(view->name + "::screenProbeWSAdaptivePositionTexture", view->screenProbeWSAdaptivePositionTexture));
+		update.write(graph.importFramebuffer(view->name + "::irradianceProbes", view->irradianceProbeFB));
+		update.write(graph.importFramebuffer(view->name + "::meanDistProbes", view->meanDistProbeFB));
+	}
+
+	graph.execute(rd);
+}
+
+void IrradianceField::updateIrradianceProbe(RenderDevice* rd, ScreenProbeView& view, bool irradiance, bool shortRangeTrace)
+{
+	const shared_ptr<Framebuffer>& probeFB = irradiance ? view.irradianceProbeFB : view.meanDistProbeFB;
+	updateProbeAtlas(rd, m_screenProbeRays, probeFB, irradiance, shortRangeTrace, view.firstFrame ? 0.0f : m_specification.hysteresis, true,
+		view.rayRowOffset, view.probeCount(), probeFB->rect2DBounds());
+}
+
+void IrradianceField::updateProbeAtlas
+   (RenderDevice*                       rd,
+	const RayBuffers&                   rays,
+	const shared_ptr<Framebuffer>&      probeFB,
+	bool                                irradiance,
+	bool                                shortRangeTrace,
+	float                               hysteresis,
+	bool                                invalidation,
+	int                                 probeRowOffset,
+	int                                 probeRowCount,
+	const Rect2D&                       rect)
 {
-	rd->push2D(irradiance ? m_irradianceProbeFB : m_meanDistProbeFB); {
+	rd->push2D(probeFB); {
 
 		rd->setBlendFunc(RenderDevice::BLEND_SRC_ALPHA, RenderDevice::BLEND_ONE_MINUS_SRC_ALPHA);
 		// Set the depth test to discard the border pixels
@@ -526,27 +1033,38 @@ void IrradianceField::updateIrradianceProbe(RenderDevice* rd, bool irradiance)
 		Args args;
 
 		args.setMacro("RAYS_PER_PROBE", m_specification.irradianceRaysPerProbe);
-		args.setUniform("hysteresis", m_firstFrame ? 0.0f : m_specification.hysteresis);
+		args.setUniform("hysteresis", hysteresis);
+		m_probeInvalidation->setShaderArgs(args, "probeInvalidation.", invalidation);
+		args.setUniform("invalidatedProbesOnly", invalidation && m_invalidationPass);
 		args.setUniform("depthSharpness", m_specification.depthSharpness);
 		// Uniforms to compute texel to direction and back in oct format
-		args.setUniform("fullTextureWidth", irradiance ? m_irradianceProbeFB->width() : m_meanDistProbeFB->width());
-		args.setUniform("fullTextureHeight", irradiance ? m_irradianceProbeFB->height() : m_meanDistProbeFB->height());
+		args.setUniform("fullTextureWidth", probeFB->width());
+		args.setUniform("fullTextureHeight", probeFB->height());
 		args.setUniform("probeSideLength", irradiance ? irradianceOctSideLength() : depthOctSideLength());
 		args.setUniform("maxDistance", m_maxDistance);
-		setShaderArgs(args, "irradianceFieldSurface.");
-		args.setRect(rd->viewport());
+		// Atlas slot i reads ray row probeRowOffset + i
+		args.setUniform("probeRowOffset", probeRowOffset);
+		args.setUniform("probeRowCount", probeRowCount);
+		args.setRect(ShaderWarmUp::rect(rd, rect));
 
-		m_irradianceRaysGBuffer->texture(GBuffer::Field::WS_POSITION)->setShaderArgs(args, "rayHitLocations.", Sampler::buffer());
-		m_irradianceRaysGBuffer->texture(GBuffer::Field::WS_NORMAL)->setShaderArgs(args, "rayHitNormals.", Sampler::buffer());
+		rays.gbuffer->texture(GBuffer::Field::WS_POSITION)->setShaderArgs(args, "rayHitLocations.", Sampler::buffer());
+		rays.gbuffer->texture(GBuffer::Field::WS_NORMAL)->setShaderArgs(args, "rayHitNormals.", Sampler::buffer());
 
-		m_irradianceRayOrigins->setShaderArgs(args, "rayOrigins.", Sampler::buffer());
-		m_irradianceRayDirections->setShaderArgs(args, "rayDirections.", Sampler::buffer());
-		m_irradianceRaysShadedFB->texture(0)->setShaderArgs(args, "rayHitRadiance.", Sampler::buffer());
+		rays.origins->setShaderArgs(args, "rayOrigins.", Sampler::buffer());
+		rays.directions->setShaderArgs(args, "rayDirections.", Sampler::buffer());
+		rays.pdfs->setShaderArgs(args, "rayPdfs.", Sampler::buffer());
+		args.setMacro("RAY_PDF", true);
+		rays.shadedFB->texture(0)->setShaderArgs(args, "rayHitRadiance.", Sampler::buffer());
 
 		// Set skybox args to read on miss
 		dynamic_pointer_cast<Skybox>(m_scene->entity("skybox"))->keyframeArray()[0]->setShaderArgs(args, "skybox_", Sampler::defaults());
 
 		args.setMacro("OUTPUT_IRRADIANCE", irradiance);
+		args.setMacro("SHORT_RANGE_TRACE", shortRangeTrace);
+		if (shortRangeTrace) {
+			m_radianceCache->setShaderArgs(args, "radianceCache.");
+		}
+
 		LAUNCH_SHADER("shaders/IrradianceField_UpdateIrradianceProbe.pix", args);
 	} rd->pop2D();
 
@@ -566,102 +1084,272 @@ void IrradianceField::updateIrradianceProbe(RenderDevice* rd, bool irradiance)
 	//} rd->pop2D();
 }
 
-void IrradianceField::generateIrradianceProbes(RenderDevice* rd,
-	const shared_ptr<Texture> screenProbeWSAdaptivePositionTexture,
-	const shared_ptr<Texture> screenProbeWSUniformPositionTexture,
-	const shared_ptr<Texture> screenProbeSSAdaptivePositionTexture,
-	const shared_ptr<Texture> numAdaptiveScreenProbesTexture,
-	const shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture,
-	const shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture,
-	shared_ptr<GBuffer> m_gbuffer)
+bool IrradianceField::warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray)
 {
+	if ((m_views.size() == 0) || isNull(m_views[0]->irradianceProbeFB) || isNull(m_screenProbeRays.gbuffer) || isNull(m_scene)) {
+		// Nothing to bind yet
+		return false;
+	}
 
-	this->screenProbeWSAdaptivePositionTexture = screenProbeWSAdaptivePositionTexture;
-	this->screenProbeWSUniformPositionTexture = screenProbeWSUniformPositionTexture;
-	this->screenProbeSSAdaptivePositionTexture = screenProbeSSAdaptivePositionTexture;
-	//this->numAdaptiveScreenProbesTexture = numAdaptiveScreenProbesTexture;
-	this->screenTileAdaptiveProbeHeaderTexture = screenTileAdaptiveProbeHeaderTexture;
-	this->screenTileAdaptiveProbeIndicesTexture = screenTileAdaptiveProbeIndicesTexture;
-	this->m_gbuffer = m_gbuffer;
-
-	const int uniformProbeCount = screenProbeWSUniformPositionTexture->width() * screenProbeWSUniformPositionTexture->height();
-	shared_ptr<GLPixelTransferBuffer> numAdaptiveScreenProbesImg = numAdaptiveScreenProbesTexture->toPixelTransferBuffer();
-	int* adaptiveProbeCount = (int*)numAdaptiveScreenProbesImg->mapRead();
-	numAdaptiveScreenProbesImg->unmap();
-	this->adaptiveProbeCount = *adaptiveProbeCount;
+	// The macros and bound formats that select a variant
+	const bool shortRangeTrace = screenProbeTraceDistance() < finf();
+	const bool pagedVolume = notNull(m_pager) && (m_pager->residentBrickCount() > 0);
+	const bool radianceCache = notNull(m_radianceCache) && m_radianceCache->hasRadiance();
+	const String& key = format("%d|%d|%d|%d|%d|%d|%d|%d|%d|%d", m_specification.irradianceRaysPerProbe, int(m_gbufferProfile), m_irradianceFormatIndex, m_depthFormatIndex,
+		int(m_specification.glossyToMatte), int(m_oneBounce), int(shortRangeTrace), int(pagedVolume), int(radianceCache), int(notNull(m_pager)));
+	if (key == m_warmShadersKey) {
+		return false;
+	}
+	m_warmShadersKey = key;
 
+	ShaderWarmUp::Scope warmUp;
+	generateIrradianceRays(rd, m_scene);
+	sampleAndShadeIrradianceRays(rd, m_scene, surfaceArray, m_screenProbeRays);
+	updateIrradianceProbe(rd, *m_views[0], true, shortRangeTrace);
+	updateIrradianceProbe(rd, *m_views[0], false, shortRangeTrace);
+
+	if (notNull(m_pager)) {
+		// The bricks shade like the screen probes but update their atlases with full-range rays.
+		// Only the macros matter, so the view atlases stand in for the brick atlases.
+		generateGridRays(rd, m_screenProbeRays, Point3int32(0, 0, 0), m_specification.probeCounts, 0, 1, Matrix3::identity());
+		for (const shared_ptr<Framebuffer>& probeFB : { m_views[0]->irradianceProbeFB, m_views[0]->meanDistProbeFB }) {
+			updateProbeAtlas(rd, m_screenProbeRays, probeFB, probeFB == m_views[0]->irradianceProbeFB, false, 0.0f, false, 0, 1, probeFB->rect2DBounds());
+		}
+	}
 
-	const int irradianceSide = irradianceOctSideLength();
-	const int depthSide = depthOctSideLength();
+	return true;
+}
 
-	const int rayDimY = uniformProbeCount + *adaptiveProbeCount;
+void IrradianceField::allocateRayBuffers(RayBuffers& rays, const String& name, int probeRows)
+{
+	const int rayDimY = probeRows;
 	const int rayDimX = m_specification.irradianceRaysPerProbe;
 
-	if (isNull(m_irradianceRaysGBuffer)) {
-		allocateIntermediateBuffers();
+	if (isNull(rays.gbuffer)) {
+		const GBuffer::Specification& gbufferRTSpec = GBufferProfile::raySpecification(m_gbufferProfile);
+		rays.gbuffer = GBuffer::create(gbufferRTSpec, "IrradianceField::" + name + "::gbuffer");
+		rays.gbuffer->setSpecification(gbufferRTSpec);
+		rays.gbuffer->resize(rayDimX, rayDimY);
+		ResourceTracker::trackGBuffer("IrradianceField", rays.gbuffer);
 	}
 
 	// Allocate or reallocate the ray tracing buffers if the probe requirements change
-	if (isNull(m_irradianceRayOrigins) ||
-		m_irradianceRayOrigins->width() != rayDimX ||
-		m_irradianceRayOrigins->height() != rayDimY)
+	if (isNull(rays.origins) ||
+		rays.origins->width() != rayDimX ||
+		rays.origins->height() != rayDimY)
 	{
-		m_irradianceRayOrigins = Texture::createEmpty("IrradianceField::m_irradianceRayOrigins", rayDimX, rayDimY, ImageFormat::RGBA32F());
-		m_irradianceRayDirections = Texture::createEmpty("IrradianceField::m_irradianceRayDirections", rayDimX, rayDimY, ImageFormat::RGBA32F());
-		m_irradianceRaysFB = Framebuffer::create(m_irradianceRayOrigins, m_irradianceRayDirections);
-		m_irradianceRaysShadedFB = Framebuffer::create(Texture::createEmpty("IrradianceField::m_irradianceRaysShadedFB", rayDimX, rayDimY, ImageFormat::RGB32F()));
-		m_giFramebuffer = Framebuffer::create(Texture::createEmpty("IrradianceField::matte indirect", rayDimX, rayDimY, ImageFormat::RGBA32F()));
-	}
-
-	static int oldIrradianceSide = 0;
-	static int oldDepthSide = 0;
-
-	// Allocate irradiance/depth probes if this is the first call or the probe resolution changes (mostly for debugging; in normal use,
-	// this is only invoked once anyway)
-	if (isNull(m_irradianceProbes) ||
-		irradianceSide != oldIrradianceSide ||
-		depthSide != oldDepthSide ||
-		m_irradianceProbes->format() != s_irradianceFormats[m_irradianceFormatIndex] ||
-		m_meanDistProbes->format() != s_depthFormats[m_depthFormatIndex] ||
-		m_probeFormatChanged)
+		rays.origins = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::origins", rayDimX, rayDimY, ImageFormat::RGBA32F());
+		rays.directions = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::directions", rayDimX, rayDimY, ImageFormat::RGBA32F());
+		rays.pdfs = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::pdfs", rayDimX, rayDimY, ImageFormat::R32F());
+		rays.raysFB = Framebuffer::create(rays.origins, rays.directions);
+		rays.raysFB->set(Framebuffer::COLOR2, rays.pdfs);
+		rays.shadedFB = Framebuffer::create(ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::shaded", rayDimX, rayDimY, ImageFormat::RGB32F()));
+		rays.matteIndirectFB = Framebuffer::create(ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::matteIndirect", rayDimX, rayDimY, ImageFormat::RGBA32F()));
+		rays.gbuffer->resize(rayDimX, rayDimY);
+	}
+}
+
+void IrradianceField::generateIrradianceProbes(RenderDevice* rd, ScreenProbeView& view, bool reallocate)
+{
+	shared_ptr<GLPixelTransferBuffer> numAdaptiveScreenProbesImg = ResourceTracker::readback("IrradianceField", view.numAdaptiveScreenProbesTexture);
+	view.adaptiveProbeCount = *(const int*)numAdaptiveScreenProbesImg->mapRead();
+	numAdaptiveScreenProbesImg->unmap();
+	Telemetry::add("transfer.downloadBytes", double(numAdaptiveScreenProbesImg->size()));
+
+	const int irradianceSide = irradianceOctSideLength();
+	const int depthSide = depthOctSideLength();
+
+	// 1-pixel of padding surrounding each probe, 1-pixel padding surrounding entire texture for alignment.
+	const shared_ptr<Texture>& uniformProbes = view.screenProbeWSUniformPositionTexture;
+	const int irradianceWidth = (irradianceSide + 2) * uniformProbes->width() + 2;
+	const int irradianceHeight = (irradianceSide + 2) * (uniformProbes->height() * (1.0 + m_specification.maxAdaptiveFactor)) + 2;
+
+	const int depthWidth = (depthSide + 2) * uniformProbes->width() + 2;
+	const int depthHeight = (depthSide + 2) * (uniformProbes->height() * (1.0 + m_specification.maxAdaptiveFactor)) + 2;
+
+	// Allocate irradiance/depth probes if this is the first call, the probe resolution changes (mostly for debugging)
+	// or the view was resized
+	if (reallocate ||
+		isNull(view.irradianceProbes) ||
+		irradianceSide != view.irradianceSide ||
+		depthSide != view.depthSide ||
+		view.irradianceProbes->width() != irradianceWidth ||
+		view.irradianceProbes->height() != irradianceHeight ||
+		view.meanDistProbes->width() != depthWidth ||
+		view.meanDistProbes->height() != depthHeight ||
+		view.irradianceProbes->format() != s_irradianceFormats[m_irradianceFormatIndex] ||
+		view.meanDistProbes->format() != s_depthFormats[m_depthFormatIndex])
 	{
-		m_probeFormatChanged = false;
+		view.irradianceProbes = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + view.name + "::irradianceProbes", irradianceWidth, irradianceHeight, s_irradianceFormats[m_irradianceFormatIndex], Texture::DIM_2D, false, 1);
+		view.meanDistProbes = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + view.name + "::meanDistProbes", depthWidth, depthHeight, s_depthFormats[m_depthFormatIndex], Texture::DIM_2D, false, 1);
 
-		// 1-pixel of padding surrounding each probe, 1-pixel padding surrounding entire texture for alignment.
-		const int irradianceWidth = (irradianceSide + 2) * screenProbeWSUniformPositionTexture->width() + 2;
-		const int irradianceHeight = (irradianceSide + 2) * (screenProbeWSUniformPositionTexture->height() * (1.0 + m_specification.maxAdaptiveFactor)) + 2;
+		view.irradianceProbeFB = Framebuffer::create(view.irradianceProbes);
+		view.meanDistProbeFB = Framebuffer::create(view.meanDistProbes);
 
-		const int depthWidth = (irradianceSide + 2) * screenProbeWSUniformPositionTexture->width() + 2;
-		const int depthHeight = (irradianceSide + 2) * (screenProbeWSUniformPositionTexture->height() * (1.0 + m_specification.maxAdaptiveFactor)) + 2;
+		view.irradianceProbeFB->set(Framebuffer::DEPTH, ResourceTracker::createTexture("IrradianceField", view.name + "::irradianceStencil", view.irradianceProbeFB->width(), view.irradianceProbeFB->height(), ImageFormat::DEPTH32()));
+		view.meanDistProbeFB->set(Framebuffer::DEPTH, ResourceTracker::createTexture("IrradianceField", view.name + "::depthStencil", view.meanDistProbeFB->width(), view.meanDistProbeFB->height(), ImageFormat::DEPTH32()));
 
-		m_irradianceProbes = Texture::createEmpty("IrradianceField::m_irradianceProbes", irradianceWidth, irradianceHeight, s_irradianceFormats[m_irradianceFormatIndex], Texture::DIM_2D, false, 1);
-		m_meanDistProbes = Texture::createEmpty("IrradianceField::m_meanDistProbes", depthWidth, depthHeight, s_depthFormats[m_depthFormatIndex], Texture::DIM_2D, false, 1);
+		view.irradianceSide = irradianceSide;
+		view.depthSide = depthSide;
+		view.firstFrame = true;
 
-		m_irradianceProbeFB = Framebuffer::create(m_irradianceProbes);
-		m_meanDistProbeFB = Framebuffer::create(m_meanDistProbes);
+		clearProbeAtlas(rd, view.irradianceProbeFB, irradianceSide);
+		clearProbeAtlas(rd, view.meanDistProbeFB, depthSide);
 
-		m_irradianceProbeFB->set(Framebuffer::DEPTH, Texture::createEmpty("irradianceStencil", m_irradianceProbeFB->width(), m_irradianceProbeFB->height(), ImageFormat::DEPTH32()));
-		m_meanDistProbeFB->set(Framebuffer::DEPTH, Texture::createEmpty("depthStencil", m_meanDistProbeFB->width(), m_meanDistProbeFB->height(), ImageFormat::DEPTH32()));
+		// The cache holds the main view only
+		if (m_probeCacheRestorePending && (&view == m_views[0].get())) {
+			m_probeCacheRestorePending = false;
+			// The G-buffer still holds the camera of the last rendered frame, which the placement used
+			if (ProbeCache::load(m_probeCacheFilename, m_probeCacheKey, view.gbuffer->camera()->frame(), { view.irradianceProbes, view.meanDistProbes })) {
+				view.firstFrame = false;
+			}
+		}
+	}
+}
 
-		// Write 1 outside probe octahedron
-		for (int i = 0; i < 2; ++i)
-		{
-			rd->push2D(i == 0 ? m_irradianceProbeFB : m_meanDistProbeFB); {
+void IrradianceField::clearProbeAtlas(RenderDevice* rd, const shared_ptr<Framebuffer>& probeFB, int probeSideLength)
+{
+	// Write 1 outside probe octahedron
+	rd->push2D(probeFB); {
+
+		rd->setColorClearValue(Color4(0, 0, 0, 0));
+		rd->setDepthWrite(true);
+		rd->clear();
+		Args args;
 
-				rd->setColorClearValue(Color4(0, 0, 0, 0));
-				rd->setDepthWrite(true);
-				rd->clear();
-				Args args;
+		args.setUniform("probeSideLength", probeSideLength);
+		args.setRect(rd->viewport());
+		LAUNCH_SHADER("shaders/IrradianceField_WriteOnesToProbeBorders.pix", args);
+
+	}; rd->pop2D();
+}
+
+void IrradianceField::bakeGridProbes
+   (RenderDevice*                       rd,
+	const Array<shared_ptr<Surface>>&   surfaceArray,
+	int                                 firstProbe,
+	int                                 endProbe,
+	int                                 passes,
+	shared_ptr<Texture>&                irradianceProbes,
+	shared_ptr<Texture>&                meanDistProbes)
+{
+	const int probesPerRow = gridProbesPerAtlasRow();
+	alwaysAssertM(((firstProbe % probesPerRow) == 0) && ((endProbe % probesPerRow) == 0), "Grid bake ranges are whole z-slices");
+	alwaysAssertM((firstProbe < endProbe) && (endProbe <= probeCount()), "Empty or out of range grid bake");
+
+	bakeGridRegion(rd, surfaceArray, Point3int32(0, 0, firstProbe / probesPerRow),
+		Vector3int32(m_specification.probeCounts.x, m_specification.probeCounts.y, (endProbe - firstProbe) / probesPerRow),
+		0, passes, irradianceProbes, meanDistProbes);
+}
+
+void IrradianceField::bakeGridRegion
+   (RenderDevice*                       rd,
+	const Array<shared_ptr<Surface>>&   surfaceArray,
+	const Point3int32&                  origin,
+	const Vector3int32&                 size,
+	int                                 firstPass,
+	int                                 passes,
+	shared_ptr<Texture>&                irradianceProbes,
+	shared_ptr<Texture>&                meanDistProbes)
+{
+	BEGIN_PROFILER_EVENT("bakeGridRegion");
+
+	// Nothing is rendered meanwhile, so build on this thread
+	finishSceneTriTree();
+
+	const int probesPerRow = size.x * size.y;
+	const int bakeProbes = probesPerRow * size.z;
+
+	// Same layout as the screen probe atlases, with one z-slice of the region per row of probe tiles
+	shared_ptr<Texture>* atlas[2] = { &irradianceProbes, &meanDistProbes };
+	const shared_ptr<Framebuffer>* probeFB = m_gridBakeProbeFB;
+	for (int i = 0; i < 2; ++i)
+	{
+		const int side = (i == 0) ? irradianceOctSideLength() : depthOctSideLength();
+		const ImageFormat* format = (i == 0) ? irradianceFormat() : meanDistFormat();
+		const String& name = (i == 0) ? "gridIrradianceProbes" : "gridMeanDistProbes";
+		const Vector2int32 atlasSize = gridAtlasSize(size, side);
+
+		shared_ptr<Texture>& texture = *atlas[i];
+		if (isNull(texture) || (texture->width() != atlasSize.x) || (texture->height() != atlasSize.y) || (texture->format() != format)) {
+			texture = ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name, atlasSize.x, atlasSize.y, format, Texture::DIM_2D, false, 1);
+		}
 
-				args.setUniform("probeSideLength", (i == 0) ? irradianceSide : depthSide);
-				args.setRect(rd->viewport());
-				LAUNCH_SHADER("shaders/IrradianceField_WriteOnesToProbeBorders.pix", args);
+		// The stencil only depends on the atlas size, so it is kept for as long as the size is
+		shared_ptr<Framebuffer>& fb = m_gridBakeProbeFB[i];
+		if (isNull(fb) || (fb->texture(0) != texture)) {
+			const shared_ptr<Texture>& stencil = (notNull(fb) && (fb->width() == atlasSize.x) && (fb->height() == atlasSize.y)) ? fb->texture(Framebuffer::DEPTH) :
+				ResourceTracker::createTexture("IrradianceField", "IrradianceField::" + name + "::stencil", atlasSize.x, atlasSize.y, ImageFormat::DEPTH32());
+			fb = Framebuffer::create(texture);
+			fb->set(Framebuffer::DEPTH, stencil);
+		}
+		if (firstPass == 0) {
+			clearProbeAtlas(rd, fb, side);
+		}
+	}
 
-			}; rd->pop2D();
+	// Batches of whole z-slices, so that each batch updates a rectangle of the atlas
+	static const int maxRayRows = 4096;
+	const int batchProbes = min(bakeProbes, max(1, maxRayRows / probesPerRow) * probesPerRow);
+	allocateRayBuffers(m_gridBakeRays, "gridBakeRays", batchProbes);
+
+	for (int pass = firstPass; pass < firstPass + passes; ++pass)
+	{
+		// Equal weights: after pass p every texel is the mean of p + 1 ray batches
+		const float hysteresis = float(pass) / float(pass + 1);
+		const Matrix3& randomOrientation = Matrix3::fromAxisAngle(Vector3::random(), Random::common().uniform(0.f, 2 * pif()));
+
+		for (int batchStart = 0; batchStart < bakeProbes; batchStart += batchProbes)
+		{
+			const int batchCount = min(batchProbes, bakeProbes - batchStart);
+			const int firstTileRow = batchStart / probesPerRow;
+
+			generateGridRays(rd, m_gridBakeRays, origin, size, firstTileRow, batchCount, randomOrientation);
+			sampleAndShadeIrradianceRays(rd, m_scene, surfaceArray, m_gridBakeRays);
+
+			// Slot s of this batch reads ray row s - batchStart
+			const int tileRows = (batchCount + probesPerRow - 1) / probesPerRow;
+			for (int i = 0; i < 2; ++i)
+			{
+				const int side = (i == 0) ? irradianceOctSideLength() : depthOctSideLength();
+				const Rect2D& rect = Rect2D::xywh(0.0f, float((side + 2) * firstTileRow), float(probeFB[i]->width()), float((side + 2) * tileRows));
+				updateProbeAtlas(rd, m_gridBakeRays, probeFB[i], i == 0, false, hysteresis, false, -batchStart, batchStart + batchCount, rect);
+			}
 		}
 	}
-	oldIrradianceSide = irradianceSide;
-	oldDepthSide = depthSide;
+
+	END_PROFILER_EVENT();
 }
 
+void IrradianceField::generateGridRays
+   (RenderDevice*                       rd,
+	const RayBuffers&                   rays,
+	const Point3int32&                  origin,
+	const Vector3int32&                 size,
+	int                                 firstSlice,
+	int                                 rowCount,
+	const Matrix3&                      randomOrientation)
+{
+	rd->push2D(rays.raysFB); {
+		Args args;
+		args.setMacro("RAYS_PER_PROBE", m_specification.irradianceRaysPerProbe);
+		args.setRect(ShaderWarmUp::rect(rd, Rect2D::xywh(0.0f, 0.0f, rd->viewport().width(), float(rowCount))));
+		args.setUniform("regionOrigin", Vector3int32(origin.x, origin.y, origin.z + firstSlice));
+		args.setUniform("regionSize", size);
+		args.setUniform("probeStartPosition", m_probeStartPosition);
+		args.setUniform("probeStep", m_probeStep);
+		args.setUniform("randomOrientation", randomOrientation);
+
+		LAUNCH_SHADER("shaders/IrradianceField_GenerateGridRays.pix", args);
+	} rd->pop2D();
+}
 
+Point3int32 IrradianceField::positionToGridIndex(const Point3& position) const
+{
+	const Vector3& step = m_probeStep.max(Vector3(1e-6f, 1e-6f, 1e-6f));
+	const Vector3& coord = (position - m_probeStartPosition) / step;
+	return Point3int32(
+		iClamp(iRound(coord.x), 0, m_specification.probeCounts.x - 1),
+		iClamp(iRound(coord.y), 0, m_specification.probeCounts.y - 1),
+		iClamp(iRound(coord.z), 0, m_specification.probeCounts.z - 1));
+}
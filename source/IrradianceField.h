@@ -1,12 +1,22 @@
 #pragma once
 #include <G3D/G3D.h>
+#include "GBufferProfile.h"
+#include "RenderGraph.h"
+#include "ScreenProbeView.h"
+#include "MagicDivisor.h"
+#include "ProbeInvalidation.h"
+#include <future>
 
 G3D_DECLARE_ENUM_CLASS(LightingMode, DIRECT_INDIRECT, DIRECT_ONLY, INDIRECT_ONLY);
 
+class RadianceCache;
+class ProbeVolumePager;
+
 class IrradianceField : public ReferenceCountedObject 
 {
 protected:
 	friend class App; // This is here for exposing debugging parameters
+	friend class AutoTuner;
 
 	struct Specification 
 	{
@@ -61,6 +71,14 @@ protected:
 
 		bool            singleBounce = false;
 
+		/** If true, screen probe rays stop at the radiance cache's ProbeTMin and rays that travel that far
+			without a hit take their radiance from the world-space radiance cache clipmaps instead of
+			continuing through the scene. */
+		bool            shortRangeTrace = false;
+
+		/** Multiplier on the finest clipmap's ProbeTMin giving the screen probe trace distance. */
+		float           shortRangeTraceDistanceScale = 1.0f;
+
 		int             irradianceFormatIndex = 4;
 		int             depthFormatIndex = 1;
 
@@ -68,6 +86,39 @@ protected:
 		bool            showLights = false;
 		bool            encloseBounds = false;
 
+		/** If true, the world-space grid is split into bricks of brickSize^3 probes and only the
+			bricks within residentBrickRadius bricks of the camera are resident, see ProbeVolumePager.
+			The secondary bounce of the probe rays reads them. probeCounts is then not reduced to fit one atlas. */
+		bool            pagedVolume = false;
+		int             brickSize = 8;
+		int             residentBrickRadius = 2;
+
+		/** Ray batches averaged per brick when a brick is baked instead of loaded, one per frame */
+		int             brickBakePasses = 8;
+
+		/** If true, screen probes within the influence volume of a light that changed are invalidated */
+		bool            lightChangeInvalidation = true;
+
+		/** If true, entities that move are tracked: they are traced in a TriTree of their own that is
+			rebuilt as they move, screen probes within
+			geometryChangeMargin metres of their old or new bounds are invalidated and the resident
+			bricks of a paged volume there are re-baked */
+		bool            geometryChangeInvalidation = true;
+		float           geometryChangeMargin = 1.0f;
+
+		/** Invalidated probes blend with a lowered hysteresis, starting at invalidationHysteresis,
+			until they have caught up, see ProbeInvalidation. They also get invalidationExtraPasses
+			more ray batches per frame meanwhile. */
+		float           invalidationHysteresis = 0.5f;
+		int             invalidationExtraPasses = 1;
+
+		/** If true, the screen probe rays not in importanceSamplingUniformFraction are drawn from a
+			per-probe PDF over 4x4 octahedral cells, proportional to the luminance of the probe's
+			irradiance last frame, and the probe update weights every ray by 1 / its mixture density.
+			New and invalidated probes sample uniformly. */
+		bool            importanceSampling = false;
+		float           importanceSamplingUniformFraction = 0.25f;
+
 		Specification();
 
 		Any toAny() const;
@@ -93,26 +144,18 @@ protected:
 	/** Should the probes enclose the scene boundary (true) or be enclosed by it (false)? */
 	bool                                m_encloseScene = false;
 
-	/**
-		Low resolution irradiance probes, R11G11B10F radiance
-		Cubemap array
-	*/
-	shared_ptr<Texture>                 m_irradianceProbes;
-
-	/**
-		Low resolution variance shadow-map style probes, RG32F()
-		X channel is distance, Y channel is sum of squared distances
-		Cubemap array
-	*/
-	shared_ptr<Texture>                 m_meanDistProbes;
-
-	/** Framebuffers associated with each probe */
-	shared_ptr<Framebuffer>             m_irradianceProbeFB;
-	shared_ptr<Framebuffer>             m_meanDistProbeFB;
+	/** Views updated by the last onGraphics3D(), the first one is the main view. Each owns its
+		screen probe atlases: irradiance (see s_irradianceFormats) and variance shadow-map style
+		mean distance, X channel is distance, Y channel is sum of squared distances. */
+	Array<shared_ptr<ScreenProbeView>>  m_views;
 
 	Point3                              m_probeStartPosition;
 	Vector3                             m_probeStep;
 
+	/** probeCounts.x and probeCounts.x * probeCounts.y, for probeIndexToGridIndex() and the shaders */
+	MagicDivisor                        m_probeCountXDivisor;
+	MagicDivisor                        m_probeCountXYDivisor;
+
 	String                              m_name;
 
 	int                                 m_irradianceFormatIndex = 4;
@@ -120,28 +163,119 @@ protected:
 
 	bool                                m_probeFormatChanged;
 
-	/** Scene tree used for accelerated ray-tracing */
+	/** Scene tree used for accelerated ray-tracing. Holds every entity but m_dynamicEntities. */
 	shared_ptr<TriTree>                 m_sceneTriTree;
 
-	/** Textures storing ray origins and directions for irradiance probe sampling,
-		regenerated every frame and then split between all probes according to a given heuristic */
-	shared_ptr<Texture>                 m_irradianceRayOrigins;
-	shared_ptr<Texture>                 m_irradianceRayDirections;
-	shared_ptr<Framebuffer>             m_irradianceRaysFB;
+	/** Entities that moved, appeared or disappeared since the scene was loaded, most of which
+		keep moving. They are traced in m_dynamicTriTree, which is rebuilt alone when they move,
+		instead of in m_sceneTriTree. */
+	Array<String>                       m_dynamicEntities;
+	shared_ptr<TriTree>                 m_dynamicTriTree;
+
+	/** True when m_dynamicEntities moved since m_dynamicTriTree was built. m_sceneDirty covers
+		both trees. */
+	bool                                m_dynamicDirty = false;
+
+	/** Identifies the geometry m_scene was loaded with, 0 if unknown. See onSceneChanged().
+		Moving entities does not change it; m_sceneTriTree only goes into s_triTreeCache while
+		m_dynamicEntities is empty. */
+	uint64                              m_geometryHash = 0;
+
+	/** Trees built this session with their geometry hash, most recent last, so that reloading
+		an unchanged scene reuses the tree instead of rebuilding it */
+	static Array<std::pair<uint64, shared_ptr<TriTree>>> s_triTreeCache;
+	static const int                    s_triTreeCacheSize = 2;
+
+	/** Trees being built by m_triTreeBuild on a worker thread, null if not rebuilt; see updateSceneTriTree() */
+	shared_ptr<TriTree>                 m_pendingTriTree;
+	shared_ptr<TriTree>                 m_pendingDynamicTriTree;
+	/** Yields the build time in seconds. Invalid when no build is running. */
+	std::future<RealTime>               m_triTreeBuild;
+
+	/** Builds of fields that were destroyed first, e.g. on a quick scene switch. Destroying the
+		future of std::async waits for the build, so they are kept until they finish; see
+		reapOrphanedBuilds(). */
+	static Array<std::shared_future<RealTime>> s_orphanedBuilds;
+
+	/** Drops the orphaned builds that finished. \a wait waits for the others as well. */
+	static void reapOrphanedBuilds(bool wait = false);
+
+	/** When false, trees are built on the render thread, e.g. for benchmark runs that must not
+		depend on when a background build happens to finish */
+	bool                                m_backgroundBuild = true;
+
+	/** Time GI became available after a background build, for fading it in. 0 if it never waited. */
+	RealTime                            m_sceneReadyTime = 0;
+
+	/** Diffs the lights and entities of m_scene against last frame, see Specification::lightChangeInvalidation
+		and Specification::geometryChangeInvalidation. Moved geometry marks m_dynamicTriTree dirty,
+		and m_sceneTriTree too the first time an entity moves. */
+	void updateProbeInvalidation();
+
+	/** Reuses a cached tree for m_geometryHash or rebuilds m_sceneTriTree from m_scene if
+		m_sceneDirty, and rebuilds m_dynamicTriTree from m_dynamicEntities. The triangles are
+		extracted here and the trees are built on a worker thread unless m_backgroundBuild is false. */
+	void updateSceneTriTree();
+
+	/** Makes \a tree the scene tree, unless null, and \a dynamicTree the tree of
+		m_dynamicEntities once they are built */
+	void installSceneTriTree(const shared_ptr<TriTree>& tree, const shared_ptr<TriTree>& dynamicTree, RealTime buildTime);
+
+	/** Finishes a background build on this thread, or starts and finishes one if a tree is dirty */
+	void finishSceneTriTree();
+
+	/** One batch of probe rays: a row per probe, a column per ray, and everything tracing and
+		shading them writes. See allocateRayBuffers(). */
+	struct RayBuffers
+	{
+		/** Ray origins and directions, regenerated for every batch */
+		shared_ptr<Texture>             origins;
+		shared_ptr<Texture>             directions;
+		/** Density over the sphere each ray direction was drawn with, see Specification::importanceSampling */
+		shared_ptr<Texture>             pdfs;
+		shared_ptr<Framebuffer>         raysFB;
+
+		/** Layout is m_gbufferProfile */
+		shared_ptr<GBuffer>             gbuffer;
+		shared_ptr<Framebuffer>         shadedFB;
+
+		/** Matte indirect at the hits, see renderSecondaryBounce() */
+		shared_ptr<Framebuffer>         matteIndirectFB;
+	};
+
+	/** Rays of the screen probes of every view, split between the views by rayRowOffset */
+	RayBuffers                          m_screenProbeRays;
 
-	shared_ptr<GBuffer>                 m_irradianceRaysGBuffer;
-	//shared_ptr<GBuffer>                 m_gbuffer;
-	shared_ptr<Framebuffer>             m_irradianceRaysShadedFB;
+	/** Rays of bakeGridRegion(), so that baking does not resize m_screenProbeRays */
+	RayBuffers                          m_gridBakeRays;
+
+	/** Atlases of the last bakeGridRegion() with their border stencils, reused while the atlases are */
+	shared_ptr<Framebuffer>             m_gridBakeProbeFB[2];
 
 
 
 	shared_ptr<Scene>                   m_scene;
 
+	/** World-space cache used to resolve short-range ray misses. May be null. */
+	shared_ptr<RadianceCache>           m_radianceCache;
+
 	LightingMode                        m_lightingMode = LightingMode::DIRECT_INDIRECT;
 
+	/** Layout of the ray G-buffers */
+	GBufferProfile::Value               m_gbufferProfile = GBufferProfile::FULL_PRECISION;
+
 	bool                                m_sceneDirty = true;
 
-	shared_ptr<Framebuffer>             m_giFramebuffer;
+	/** Snapshot to upload into the probe atlases once they are allocated, see requestProbeCacheRestore() */
+	String                              m_probeCacheFilename;
+	uint64                              m_probeCacheKey = 0;
+	bool                                m_probeCacheRestorePending = false;
+
+	/** Resident bricks of the grid when m_specification.pagedVolume, otherwise null */
+	shared_ptr<ProbeVolumePager>        m_pager;
+
+	/** Where the pager streams bricks from and to. Empty bakes every brick on demand. */
+	String                              m_brickCacheDirectory;
 
 	Point3 probeIndexToPosition(int index) const;
 
@@ -151,41 +285,95 @@ protected:
 
 	IrradianceField();
 
-	/** allocates all of the framebuffers/gbuffers/textures
-		needed for re-generating the irradiancefield. */
-	void allocateIntermediateBuffers();
+	/** Sizes \a rays for \a probeRows probes, reallocating only when that or the G-buffer profile changed */
+	void allocateRayBuffers(RayBuffers& rays, const String& name, int probeRows);
 
-	/** Generate rays for irradiance probe updates. */
+	/** Generate rays for irradiance probe updates, into the rows of each view. */
 	void generateIrradianceRays(RenderDevice* r0d, const shared_ptr<Scene>& scene);
 
 	/** Sample rays for irradiance probe updates, returning shaded hit points. */
-	void sampleAndShadeIrradianceRays(RenderDevice* rd, const shared_ptr<Scene>& scene, const Array<shared_ptr<Surface>>& surfaceArray);
+	void sampleAndShadeIrradianceRays(RenderDevice* rd, const shared_ptr<Scene>& scene, const Array<shared_ptr<Surface>>& surfaceArray, RayBuffers& rays);
 
-	/** Update irradiance probes at runtime using newly sampled rays. */
+	/** Update the irradiance probes of every view at runtime using newly sampled rays. */
 	void updateIrradianceProbes(RenderDevice* rd, const shared_ptr<Scene>& scene);
 
-	/** Update a single irradiance probe at runtime using newly sampled rays. */
-	void updateIrradianceProbe(RenderDevice* rd, bool irradiance);
+	/** Runs one ray batch of the screen probes of m_views as m_renderGraph: ray generation, trace,
+		shade and probe update. The ray buffers are imported as intermediates, so the batch is
+		culled when no view has a probe to update. */
+	void updateScreenProbes(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray);
+
+	/** Passes of updateScreenProbes(). Placement and the radiance cache are not part of it: the
+		adaptive probe count read back after placement sizes the ray batch, and the radiance cache
+		allocates its buffers while it runs. */
+	shared_ptr<RenderGraph>             m_renderGraph = RenderGraph::create();
+
+	/** Update one atlas of \a view using its rows of the newly sampled rays. \a shortRangeTrace
+		resolves ray misses from the radiance cache and requires m_radianceCache->hasRadiance(). */
+	void updateIrradianceProbe(RenderDevice* rd, ScreenProbeView& view, bool irradiance, bool shortRangeTrace);
+
+	/** Blends the rays of \a rays into the probe tiles of \a probeFB within \a rect. Atlas slot i
+		reads ray row probeRowOffset + i; slots at or past probeRowCount keep their contents.
+		\a invalidation lowers the hysteresis of probes in the regions of the ProbeInvalidation. */
+	void updateProbeAtlas
+	(RenderDevice*                       rd,
+	 const RayBuffers&                   rays,
+	 const shared_ptr<Framebuffer>&      probeFB,
+	 bool                                irradiance,
+	 bool                                shortRangeTrace,
+	 float                               hysteresis,
+	 bool                                invalidation,
+	 int                                 probeRowOffset,
+	 int                                 probeRowCount,
+	 const Rect2D&                       rect);
+
+	/** Zeroes the atlas of \a probeFB and marks the border texels of its probe tiles in the depth
+		buffer, which the update passes test against */
+	void clearProbeAtlas(RenderDevice* rd, const shared_ptr<Framebuffer>& probeFB, int probeSideLength);
+
+	/** Regions around the lights and entities that changed recently, see Specification::lightChangeInvalidation */
+	shared_ptr<ProbeInvalidation>       m_probeInvalidation = ProbeInvalidation::create();
+
+	/** True during the extra ray batches for the invalidated probes. Every other probe traces empty
+		rays and keeps its contents. */
+	bool                                m_invalidationPass = false;
+
+	/** Configuration the warm variants were compiled for, see warmUpShaders() */
+	String                              m_warmShadersKey;
+
+	/** Rays through the probes of a grid region, rowCount rows starting with the probes of
+		z-slice firstSlice of the region */
+	void generateGridRays
+	   (RenderDevice*                       rd,
+		const RayBuffers&                   rays,
+		const Point3int32&                  origin,
+		const Vector3int32&                 size,
+		int                                 firstSlice,
+		int                                 rowCount,
+		const Matrix3&                      randomOrientation);
+
+	/** Traces \a rayOrigins and \a rayDirections on the CPU against m_sceneTriTree and
+		m_dynamicTriTree and uploads the nearer hits into \a gbuffer */
+	void traceArbitraryRays
+	   (const shared_ptr<Texture>&          rayOrigins,
+		const shared_ptr<Texture>&          rayDirections,
+		const shared_ptr<GBuffer>&          gbuffer,
+		const String&                       telemetryPrefix);
 
 	//void screenProbeAdaptivePlacement();
 
-	void renderIndirectIllumination
+	/** Matte indirect at the ray hits in gbuffer, into \a matteIndirectFB. Read from the resident
+		bricks of m_pager where there are any, otherwise from the radiance cache. Requires
+		hasSecondaryBounce(). */
+	void renderSecondaryBounce
 	(RenderDevice*							   rd,
 	 const shared_ptr<GBuffer>&                gbuffer,
-	 const LightingEnvironment&                environment);
+	 const shared_ptr<Framebuffer>&            matteIndirectFB);
+
+	/** True if the pager or the radiance cache has anything for renderSecondaryBounce() to read */
+	bool hasSecondaryBounce() const;
 
 public:
 
-	// Added
-	shared_ptr<Texture> screenProbeWSAdaptivePositionTexture;
-	shared_ptr<Texture> screenProbeWSUniformPositionTexture;
-	// shared_ptr<Texture> numAdaptiveScreenProbesTexture;
-	shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture;
-	shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture;
-	shared_ptr<Texture> screenProbeSSAdaptivePositionTexture;
-	shared_ptr<GBuffer> m_gbuffer;
-	// Added
-	int									adaptiveProbeCount;
 	int									screenProbeDownsampleFactor = 16;
 
 
@@ -196,10 +384,25 @@ public:
 	 const LightingEnvironment&                 environment,
 	 const shared_ptr<Texture>&                 rayOrigins,
 	 const shared_ptr<Texture>&                 rayDirections,
-	 const bool                                 useProbeIndirect,
+	 /** Null disables the secondary bounce */
+	 const shared_ptr<Framebuffer>&             matteIndirectFB,
 	 const bool                                 glossyToMatte,
 	 const shared_ptr<GBuffer>&                 gbuffer,
-	 const TriTree::IntersectRayOptions         traceOptions);
+	 const TriTree::IntersectRayOptions         traceOptions,
+	 const String&                              telemetryPrefix);
+
+	/** The shading half of sampleAndShadeArbitraryRays(), for hits already in \a gbuffer */
+	void shadeArbitraryRays
+	(RenderDevice*								rd,
+	 const Array<shared_ptr<Surface>>&          surfaceArray,
+	 const shared_ptr<Framebuffer>&             targetFramebuffer,
+	 const LightingEnvironment&                 environment,
+	 const shared_ptr<Texture>&                 rayOrigins,
+	 const shared_ptr<Texture>&                 rayDirections,
+	 /** Null disables the secondary bounce */
+	 const shared_ptr<Framebuffer>&             matteIndirectFB,
+	 const bool                                 glossyToMatte,
+	 const shared_ptr<GBuffer>&                 gbuffer);
 
 	// Return maxProbeDistance so we can set it in the shader. Note that we may also use this value on the way in
 	// to *set* the maxProbeDistance, or at set the initial distance before converting to powers of two.
@@ -210,21 +413,110 @@ public:
 	 float                    maxProbeDistance, 
 	 int                      irradianceCubeResolutionOverride = -1, 
 	 int                      depthCubeResolutionOverride      = -1);
+
+	/** Reduces spec.probeCounts until the width and the height of both gridAtlasSize() atlases fit
+		in GL_MAX_TEXTURE_SIZE. Paged volumes are left alone, since they only keep the bricks near
+		the camera. */
+	static void clampProbeCounts(Specification& spec);
 	/** If true, set hysteresis to zero and force all probes to re-render.
 		Used for when parameters change */
 	bool                        m_firstFrame = true;
 	bool                        m_oneBounce = false;
 
-	void generateIrradianceProbes(RenderDevice* rd, 
-		const shared_ptr<Texture> screenProbeWSAdaptivePositionTexture, 
-		const shared_ptr<Texture> screenProbeWSUniformPositionTexture, 
-		const shared_ptr<Texture> screenProbeSSAdaptivePositionTexture,
-		const shared_ptr<Texture> numAdaptiveScreenProbesTexture, 
-		const shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture, 
-		const shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture, 
-		shared_ptr<GBuffer> m_gbuffer);
+	/** Reads back the adaptive probe count of \a view and (re)allocates its atlases if the
+		probe resolution, format or screen probe layout changed, or if \a reallocate */
+	void generateIrradianceProbes(RenderDevice* rd, ScreenProbeView& view, bool reallocate);
+
+	/** Binds the grid and the screen probe atlases of \a view */
+	void setShaderArgs(UniformTable& args, const String& prefix, const ScreenProbeView& view);
+
+	void setRadianceCache(const shared_ptr<RadianceCache>& radianceCache) {
+		m_radianceCache = radianceCache;
+	}
+
+	/** Hash of \a sceneHash and everything in the probe configuration that changes the atlas contents */
+	uint64 probeCacheKey(uint64 sceneHash) const;
+
+	/** Restores the irradiance and mean-distance atlases of the main view from \a filename when
+		they are first allocated, if it was saved under \a key from the current view. The first update then
+		blends with the restored probes instead of overwriting them. */
+	void requestProbeCacheRestore(const String& filename, uint64 key);
+
+	/** Writes the atlases of the main view to the file passed to requestProbeCacheRestore(). Does
+		nothing before the atlases exist. */
+	void saveProbeCache(const CoordinateFrame& cameraFrame) const;
+
+	/** The ray G-buffer is reallocated on the next update */
+	void setGBufferProfile(GBufferProfile::Value profile) {
+		if (profile != m_gbufferProfile) {
+			m_gbufferProfile = profile;
+			m_screenProbeRays.gbuffer.reset();
+			m_gridBakeRays.gbuffer.reset();
+		}
+	}
 
-	void setShaderArgs(UniformTable& args, const String& prefix);
+	const shared_ptr<Scene>& scene() const {
+		return m_scene;
+	}
+
+	const shared_ptr<ProbeInvalidation>& probeInvalidation() const {
+		return m_probeInvalidation;
+	}
+
+	/** DIRECT_ONLY until the first scene tree is built; nothing is traced or updated until then */
+	LightingMode lightingMode() const {
+		return m_lightingMode;
+	}
+
+	/** True while the scene tree is out of date or being rebuilt. bakeGridRegion() would wait for it. */
+	bool sceneTriTreePending() const {
+		return m_sceneDirty || m_dynamicDirty || m_triTreeBuild.valid();
+	}
+
+	/** Weight of the indirect term in the final shading: 0 while DIRECT_ONLY, then ramping to 1
+		over indirectFadeInDuration once the tree is ready */
+	float indirectWeight() const;
+
+	static const RealTime indirectFadeInDuration;
+
+	void setBackgroundBuild(bool b) {
+		m_backgroundBuild = b;
+	}
+
+	/** Releases the TriTrees kept across scene loads and waits for the orphaned builds. They hold
+		the scenes' materials and textures, so this must run before the GL context goes away, see
+		App::onCleanup(). */
+	static void clearTriTreeCache() {
+		s_triTreeCache.clear();
+		reapOrphanedBuilds(true);
+	}
+
+	/** Replaces the specification loadNewScene() chose, e.g. with an AutoTuner candidate. The
+		probes are reallocated and reconverge from scratch on the next update. */
+	void setSpecification(const Specification& spec) {
+		init(spec);
+		m_probeFormatChanged = true;
+		m_firstFrame = true;
+	}
+
+	/** Name of the optional per-scene specification file, searched for with System::findDataFile() */
+	static String specificationFilename(const String& sceneName) {
+		return FilePath::mangle(sceneName) + ".LightFieldModelSpecification.Any";
+	}
+
+	/** Compiles the programs of every pass of the screen probe update, i.e. ray generation,
+		secondary bounce, shading and both atlas updates, and of the grid brick bake if there is
+		a pager, by launching them under a ShaderWarmUp::Scope. Selects the variants that the
+		next update will use, with indirect lighting even while the scene tree is built.
+
+		Returns false without launching anything if nothing changed since the last call. The
+		radiance cache and the pager switch variants once they hold radiance, so call it again
+		after they have run. */
+	bool warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray);
+
+	/** Maximum distance of screen probe rays this frame. finf() unless short-range tracing
+		is enabled and the radiance cache has traced probes to fall back on. */
+	float screenProbeTraceDistance() const;
 
 	bool encloseScene() {
 		return m_encloseScene;
@@ -234,8 +526,9 @@ public:
 		m_encloseScene = b;
 	}
 
-	float gRaysPerFrame() {
-		return float(m_irradianceRayOrigins->width() * m_irradianceRayDirections->height()) / 1000000000.0f;
+	/** One ray per texel of the ray textures */
+	float gRaysPerFrame() const {
+		return isNull(m_screenProbeRays.origins) ? 0.0f : float(m_screenProbeRays.origins->width() * m_screenProbeRays.origins->height()) / 1000000000.0f;
 	}
 
 	static const ImageFormat* distanceFormat() {
@@ -263,13 +556,17 @@ public:
 		return s_irradianceFormats[m_irradianceFormatIndex];
 	}
 
+	const ImageFormat* meanDistFormat() const {
+		return s_depthFormats[m_depthFormatIndex];
+	}
+
 	static const Texture::Encoding& normalEncoding() {
 		static Texture::Encoding enc(ImageFormat::RG8(), FrameName::WORLD, 2.0f, -1.0f);
 		return enc;
 	}
 
 	RealTime lastSceneUpdateTime() {
-		return m_sceneTriTree->lastBuildTime();
+		return notNull(m_dynamicTriTree) ? max(m_sceneTriTree->lastBuildTime(), m_dynamicTriTree->lastBuildTime()) : m_sceneTriTree->lastBuildTime();
 	}
 
 	int probeCount() const {
@@ -280,6 +577,82 @@ public:
 		return m_specification.probeCounts;
 	}
 
+	const Point3& probeStartPosition() const {
+		return m_probeStartPosition;
+	}
+
+	const Vector3& probeStep() const {
+		return m_probeStep;
+	}
+
+	float normalBias() const {
+		return m_specification.normalBias;
+	}
+
+	/** World-space grid probes per row of probe tiles in a baked grid atlas: one z-slice */
+	int gridProbesPerAtlasRow() const {
+		return m_specification.probeCounts.x * m_specification.probeCounts.y;
+	}
+
+	/** Bakes the world-space grid probes [firstProbe, endProbe), see probeIndexToPosition(), which
+		must be whole z-slices. Slot i of the atlases holds probe firstProbe + i, see bakeGridRegion(). */
+	void bakeGridProbes
+	(RenderDevice*                       rd,
+	 const Array<shared_ptr<Surface>>&   surfaceArray,
+	 int                                 firstProbe,
+	 int                                 endProbe,
+	 int                                 passes,
+	 shared_ptr<Texture>&                irradianceProbes,
+	 shared_ptr<Texture>&                meanDistProbes);
+
+	/** Bakes the box of grid probes of \a size starting at grid coordinate \a origin into irradiance
+		and mean-distance atlases of gridAtlasSize(). Slot i holds the probe i steps along x, then y,
+		then z of the box, with size.x * size.y probes per row of tiles. \a irradianceProbes and
+		\a meanDistProbes are reused if they already have the atlas size and format.
+
+		Builds the scene tree on this thread if needed and averages ray batches per probe with equal
+		weights. This call adds batches [firstPass, firstPass + passes); firstPass 0 clears the
+		atlases, so a bake can be split across frames by passing the same atlases again. Indirect
+		light beyond the first bounce comes from renderSecondaryBounce(). */
+	void bakeGridRegion
+	(RenderDevice*                       rd,
+	 const Array<shared_ptr<Surface>>&   surfaceArray,
+	 const Point3int32&                  origin,
+	 const Vector3int32&                 size,
+	 int                                 firstPass,
+	 int                                 passes,
+	 shared_ptr<Texture>&                irradianceProbes,
+	 shared_ptr<Texture>&                meanDistProbes);
+
+	/** Atlas of a baked box of \a size probes of oct side length \a side, including borders */
+	static Vector2int32 gridAtlasSize(const Vector3int32& size, int side) {
+		return Vector2int32((side + 2) * size.x * size.y + 2, (side + 2) * size.z + 2);
+	}
+
+	/** Nearest grid coordinate, clamped to the grid */
+	Point3int32 positionToGridIndex(const Point3& position) const;
+
+	/** Null unless the specification enables pagedVolume */
+	const shared_ptr<ProbeVolumePager>& pager() const {
+		return m_pager;
+	}
+
+	void setBrickCacheDirectory(const String& directory) {
+		m_brickCacheDirectory = directory;
+	}
+
+	const String& brickCacheDirectory() const {
+		return m_brickCacheDirectory;
+	}
+
+	/** Identifies the geometry of the scene, see onSceneChanged() */
+	uint64 geometryHash() const {
+		return m_geometryHash;
+	}
+
+	/** Does not wait for a TriTree build that is still running */
+	~IrradianceField();
+
 	static shared_ptr<IrradianceField> create
 	(const String&            sceneFilename, 
 	 const shared_ptr<Scene>& scene,
@@ -288,16 +661,13 @@ public:
      int                      irradianceCubeResolutionOverride = -1);
 
 	/** The surfaceArray is only used to find the skybox */
-	virtual void onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray, 
-		const shared_ptr<Texture> screenProbeWSAdaptivePositionTexture, 
-		const shared_ptr<Texture> screenProbeWSUniformPositionTexture, 
-		const shared_ptr<Texture> screenProbeSSAdaptivePositionTexture,
-		const shared_ptr<Texture> numAdaptiveScreenProbesTexture, 
-		const shared_ptr<Texture> screenTileAdaptiveProbeHeaderTexture, 
-		const shared_ptr<Texture> screenTileAdaptiveProbeIndicesTexture, 
-		shared_ptr<GBuffer> m_gbuffer);
-
-	virtual void onSceneChanged(const shared_ptr<Scene>& scene);
+	/** Traces the screen probes of every view in \a views as one ray batch and updates the atlases
+		of each view. Every view must have placed its probes, see ScreenProbeView::hasGBuffer(). */
+	virtual void onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray, const Array<shared_ptr<ScreenProbeView>>& views);
+
+	/** \a geometryHash identifies the geometry \a scene was loaded with, e.g. a hash of its
+		Any. Pass 0 when the geometry was edited or animated since, which forces a rebuild. */
+	virtual void onSceneChanged(const shared_ptr<Scene>& scene, uint64 geometryHash = 0);
 
 	static Color3 probeCoordVisualizationColor(Point3int32 P);
 
@@ -0,0 +1,46 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Division of a non-negative int below 2^31 by a fixed divisor as a multiply-high, an add and
+	a shift (Granlund & Montgomery). Used to turn probe indices into grid coordinates for grids of
+	any dimensions.
+
+	With l = ceil(log2(divisor)) and multiplier = floor(2^32 (2^l - divisor) / divisor) + 1,
+
+		n / divisor == (mulhi(n, multiplier) + n) >> l
+
+	for every 0 <= n < 2^31; the sum cannot overflow 32 bits in that range. A power of two gets
+	multiplier 1, so the multiply contributes nothing and the result is a plain shift.
+
+	GridHelpers.glsl magicDivide() is the GPU side, reading the same multiplier and shift. */
+class MagicDivisor
+{
+public:
+	int         divisor = 1;
+	uint32      multiplier = 1;
+	int         shift = 0;
+
+	MagicDivisor() {}
+
+	explicit MagicDivisor(int d) : divisor(d)
+	{
+		alwaysAssertM(d > 0, "MagicDivisor: the divisor must be positive");
+		shift = 0;
+		while ((uint64(1) << shift) < uint64(d)) {
+			++shift;
+		}
+		multiplier = uint32(((uint64(1) << 32) * ((uint64(1) << shift) - uint64(d))) / uint64(d) + 1);
+	}
+
+	int divide(int n) const
+	{
+		debugAssert(n >= 0);
+		const uint32 hi = uint32((uint64(uint32(n)) * multiplier) >> 32);
+		return int((hi + uint32(n)) >> shift);
+	}
+
+	int modulo(int n) const
+	{
+		return n - divide(n) * divisor;
+	}
+};
@@ -0,0 +1,333 @@
+#include "ProbeCache.h"
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+static const char s_magic[8] = { 'P', 'R', 'B', 'C', 'A', 'C', 'H', 'E' };
+
+const float ProbeCache::cameraTolerance = 0.01f;
+const float ProbeCache::cameraDirectionTolerance = 0.9995f;
+
+/** Read-only mapping of a whole file, released on destruction */
+class MappedFile
+{
+public:
+	const uint8*    data = nullptr;
+	size_t          size = 0;
+
+#	ifdef _WIN32
+		HANDLE      file = INVALID_HANDLE_VALUE;
+		HANDLE      mapping = nullptr;
+#	else
+		int         fd = -1;
+#	endif
+
+	bool open(const String& filename)
+	{
+#		ifdef _WIN32
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (isNull(mapping)) {
+				return false;
+			}
+			data = (const uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			size = size_t(fileSize.QuadPart);
+#		else
+			fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat st;
+			if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+				return false;
+			}
+			void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) {
+				return false;
+			}
+			data = (const uint8*)p;
+			size = size_t(st.st_size);
+#		endif
+		return notNull(data);
+	}
+
+	~MappedFile()
+	{
+#		ifdef _WIN32
+			if (notNull(data)) { UnmapViewOfFile(data); }
+			if (notNull(mapping)) { CloseHandle(mapping); }
+			if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+#		else
+			if (notNull(data)) { munmap((void*)data, size); }
+			if (fd >= 0) { close(fd); }
+#		endif
+	}
+};
+
+/** True if \a in has \a bytes left. BinaryInput asserts, or reads past the mapping, otherwise. */
+static bool hasBytes(const BinaryInput& in, int64 bytes)
+{
+	return (bytes >= 0) && (in.getPosition() + bytes <= in.size());
+}
+
+/** Reads a string written by BinaryOutput::writeString32(), or returns false if it runs past the end */
+static bool readString32(BinaryInput& in, String& s)
+{
+	if (!hasBytes(in, sizeof(uint32))) {
+		return false;
+	}
+	const int64 start = in.getPosition();
+	const uint32 length = in.readUInt32();
+	if (!hasBytes(in, int64(length))) {
+		return false;
+	}
+	in.setPosition(start);
+	s = in.readString32();
+	return true;
+}
+
+/** Moves \a source over \a target, replacing it atomically where the platform allows */
+static bool replaceFile(const String& source, const String& target)
+{
+#	ifdef _WIN32
+		return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#	else
+		return ::rename(source.c_str(), target.c_str()) == 0;
+#	endif
+}
+
+ProbeCache::Specification ProbeCache::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if ((arg == "--probe-cache-dir") && hasValue) {
+			s.directory = argv[++i];
+		} else if ((arg == "--probe-cache-autosave") && hasValue) {
+			s.autosaveInterval = atof(argv[++i]);
+		} else if (arg == "--no-probe-cache") {
+			s.enabled = false;
+		}
+	}
+	return s;
+}
+
+uint64 ProbeCache::hash(const String& s, uint64 seed)
+{
+	uint64 h = seed;
+	for (const char c : s) {
+		h ^= uint64(uint8(c));
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/** Appends every string in \a any that names an existing data file, e.g. model and texture filenames */
+static void findDataFiles(const Any& any, Array<String>& filenames)
+{
+	switch (any.type()) {
+	case Any::STRING:
+	{
+		const String& filename = System::findDataFile(any.string(), false);
+		if (!filename.empty() && !FileSystem::isDirectory(filename) && !filenames.contains(filename)) {
+			filenames.append(filename);
+		}
+		break;
+	}
+	case Any::ARRAY:
+		for (int i = 0; i < any.size(); ++i) {
+			findDataFiles(any[i], filenames);
+		}
+		break;
+	case Any::TABLE:
+		for (Table<String, Any>::Iterator it = any.table().begin(); it.isValid(); ++it) {
+			findDataFiles(it->value, filenames);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/** Size and last write time of \a filename as text, empty if it cannot be read */
+static String fileStamp(const String& filename)
+{
+#	ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data)) {
+			return "";
+		}
+		return format("%lu:%lu:%lu:%lu", data.nFileSizeHigh, data.nFileSizeLow, data.ftLastWriteTime.dwHighDateTime, data.ftLastWriteTime.dwLowDateTime);
+#	else
+		struct stat st;
+		if (stat(filename.c_str(), &st) != 0) {
+			return "";
+		}
+		return format("%lld:%lld", (long long)st.st_size, (long long)st.st_mtime);
+#	endif
+}
+
+uint64 ProbeCache::sceneHash(const Any& any)
+{
+	uint64 h = hash(any.unparse());
+
+	Array<String> filenames;
+	findDataFiles(any, filenames);
+	// Table iteration order is arbitrary
+	filenames.sort();
+	for (const String& filename : filenames) {
+		h = hash(filename + "|" + fileStamp(filename), h);
+	}
+	return h;
+}
+
+String ProbeCache::filename(const String& directory, const String& sceneName, uint64 key)
+{
+	return FilePath::concat(directory, format("%s_%016llx.probecache", FilePath::makeLegalFilename(sceneName).c_str(), (unsigned long long)key));
+}
+
+void ProbeCache::save
+(const String&                          filename,
+ uint64                                 key,
+ const CoordinateFrame&                 cameraFrame,
+ const String&                          specification,
+ const Array<shared_ptr<Texture>>&      textures)
+{
+	const String& directory = FilePath::parent(filename);
+	if (!directory.empty() && !FileSystem::exists(directory)) {
+		FileSystem::createDirectory(directory);
+	}
+
+	// Autosave and the save on exit can be interrupted; only a complete file replaces the old one
+	const String& tmpFilename = filename + ".tmp";
+	BinaryOutput out(tmpFilename, G3D_LITTLE_ENDIAN);
+	out.writeBytes(s_magic, sizeof(s_magic));
+	out.writeUInt32(VERSION);
+	out.writeUInt64(key);
+	cameraFrame.serialize(out);
+	out.writeString32(specification);
+
+	out.writeInt32(textures.size());
+	for (const shared_ptr<Texture>& texture : textures)
+	{
+		const shared_ptr<GLPixelTransferBuffer>& buffer = texture->toPixelTransferBuffer();
+		const size_t bytes = size_t(texture->width()) * size_t(texture->height()) * size_t(texture->format()->openGLBitsPerPixel) / 8;
+		alwaysAssertM(buffer->size() >= bytes, "ProbeCache: unexpected readback size for " + texture->name());
+
+		out.writeString32(texture->name());
+		out.writeInt32(texture->width());
+		out.writeInt32(texture->height());
+		out.writeString32(texture->format()->name());
+		out.writeUInt64(bytes);
+		out.writeBytes(buffer->mapRead(), int64(bytes));
+		buffer->unmap();
+	}
+
+	out.commit();
+	if (!replaceFile(tmpFilename, filename)) {
+		logPrintf("ProbeCache: could not replace %s\n", filename.c_str());
+		FileSystem::removeFile(tmpFilename);
+		return;
+	}
+	logPrintf("ProbeCache: saved %s\n", filename.c_str());
+}
+
+bool ProbeCache::load
+(const String&                          filename,
+ uint64                                 key,
+ const CoordinateFrame&                 cameraFrame,
+ const Array<shared_ptr<Texture>>&      textures)
+{
+	MappedFile file;
+	if (!file.open(filename)) {
+		return false;
+	}
+	if ((file.size < sizeof(s_magic)) || (memcmp(file.data, s_magic, sizeof(s_magic)) != 0)) {
+		logPrintf("ProbeCache: %s is not a probe cache\n", filename.c_str());
+		return false;
+	}
+
+	// Parse in place; only the header is copied out of the mapping. Every read is checked
+	// against the end, so that a truncated or corrupt file is ignored.
+	BinaryInput in(file.data, int64(file.size), G3D_LITTLE_ENDIAN, false, false);
+	in.skip(sizeof(s_magic));
+
+	// Version, key and the 12 floats of the camera frame
+	if (!hasBytes(in, sizeof(uint32) + sizeof(uint64) + 12 * sizeof(float))) {
+		logPrintf("ProbeCache: %s is truncated, ignoring it\n", filename.c_str());
+		return false;
+	}
+	const uint32 version = in.readUInt32();
+	const uint64 storedKey = in.readUInt64();
+	if ((version != VERSION) || (storedKey != key)) {
+		logPrintf("ProbeCache: %s was written by version %u with another key, ignoring it\n", filename.c_str(), version);
+		return false;
+	}
+
+	CoordinateFrame storedCamera;
+	storedCamera.deserialize(in);
+	if (((storedCamera.translation - cameraFrame.translation).length() > cameraTolerance) ||
+		(storedCamera.lookVector().dot(cameraFrame.lookVector()) < cameraDirectionTolerance)) {
+		logPrintf("ProbeCache: %s was saved from another view, ignoring it\n", filename.c_str());
+		return false;
+	}
+
+	// The specification is part of the key and only stored for inspection
+	String specification;
+	if (!readString32(in, specification) || !hasBytes(in, sizeof(int32)) || (in.readInt32() != textures.size())) {
+		logPrintf("ProbeCache: %s is truncated or corrupt, ignoring it\n", filename.c_str());
+		return false;
+	}
+
+	// Validate every entry before touching any texture
+	Array<const uint8*> texels;
+	for (const shared_ptr<Texture>& texture : textures)
+	{
+		String name, formatName;
+		if (!readString32(in, name) || !hasBytes(in, 2 * sizeof(int32))) {
+			logPrintf("ProbeCache: %s is truncated or corrupt, ignoring it\n", filename.c_str());
+			return false;
+		}
+		const int width = in.readInt32();
+		const int height = in.readInt32();
+		if (!readString32(in, formatName) || !hasBytes(in, sizeof(uint64))) {
+			logPrintf("ProbeCache: %s is truncated or corrupt, ignoring it\n", filename.c_str());
+			return false;
+		}
+		const uint64 bytes = in.readUInt64();
+
+		const uint64 expectedBytes = uint64(texture->width()) * uint64(texture->height()) * uint64(texture->format()->openGLBitsPerPixel) / 8;
+		if ((name != texture->name()) || (width != texture->width()) || (height != texture->height()) ||
+			(formatName != texture->format()->name()) || (bytes != expectedBytes) || !hasBytes(in, int64(bytes))) {
+			logPrintf("ProbeCache: %s does not match the allocated %s, ignoring it\n", filename.c_str(), texture->name().c_str());
+			return false;
+		}
+
+		texels.append(file.data + in.getPosition());
+		in.skip(int64(bytes));
+	}
+
+	for (int i = 0; i < textures.size(); ++i) {
+		const shared_ptr<Texture>& texture = textures[i];
+		texture->update(GLPixelTransferBuffer::create(texture->width(), texture->height(), texture->format(), texels[i]));
+	}
+
+	logPrintf("ProbeCache: restored %s\n", filename.c_str());
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Versioned binary snapshot of converged probe textures, so that a restart resumes with
+	converged lighting instead of starting from hysteresis 0.
+
+	The file holds a header (magic, VERSION, key, camera frame, the IrradianceField::Specification
+	as Any text) followed by the raw texels of each texture. It is memory-mapped on load and the
+	texels are uploaded straight from the mapping.
+
+	The key hashes everything the contents depend on: the scene file and the probe configuration.
+	The screen probe atlases are also laid out by the view, so a snapshot is only restored for a
+	camera within cameraTolerance of the one it was saved from, e.g. a fixed kiosk view. */
+class ProbeCache
+{
+public:
+	/** Bump whenever the layout or the meaning of the stored texels changes */
+	static const uint32 VERSION = 1;
+
+	class Specification
+	{
+	public:
+		bool        enabled = true;
+		String      directory = "probe-cache";
+
+		/** Seconds between saves while running, in addition to the save on exit. 0 disables. */
+		RealTime    autosaveInterval = 300;
+
+		/** Reads --probe-cache-dir, --probe-cache-autosave and --no-probe-cache */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+	/** Metres and cosine of the angle between the view directions */
+	static const float cameraTolerance;
+	static const float cameraDirectionTolerance;
+
+	/** 64-bit FNV-1a */
+	static uint64 hash(const String& s, uint64 seed = 14695981039346656037ull);
+
+	/** Hash of the scene \a any and of the size and modification time of every data file it names,
+		so that re-exporting a model changes the hash even though the scene text does not */
+	static uint64 sceneHash(const Any& any);
+
+	static String filename(const String& directory, const String& sceneName, uint64 key);
+
+	/** Reads the textures back from the GPU and writes them with the header. Creates the directory.
+		The file is written next to \a filename and renamed over it, so an interrupted save leaves the
+		previous file. */
+	static void save
+	(const String&                          filename,
+	 uint64                                 key,
+	 const CoordinateFrame&                 cameraFrame,
+	 const String&                          specification,
+	 const Array<shared_ptr<Texture>>&      textures);
+
+	/** Uploads the stored texels into \a textures, which must have the stored names, sizes and
+		formats. Returns false, leaving the textures untouched, if the file is missing, truncated or
+		corrupt, or was written by another VERSION, key or view. */
+	static bool load
+	(const String&                          filename,
+	 uint64                                 key,
+	 const CoordinateFrame&                 cameraFrame,
+	 const Array<shared_ptr<Texture>>&      textures);
+};
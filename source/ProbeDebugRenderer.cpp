@@ -0,0 +1,64 @@
+#include "ProbeDebugRenderer.h"
+#include "ResourceTracker.h"
+
+void ProbeDebugRenderer::render
+   (RenderDevice*                  rd,
+	const shared_ptr<Texture>&     uniformProbeWSPosition,
+	const shared_ptr<Texture>&     adaptiveProbeWSPosition,
+	const shared_ptr<Texture>&     numAdaptiveProbes,
+	const shared_ptr<Texture>&     worldProbeWSPosition,
+	const shared_ptr<Texture>&     numWorldProbes)
+{
+	if (!enabled() || isNull(uniformProbeWSPosition)) {
+		return;
+	}
+
+	BEGIN_PROFILER_EVENT("ProbeDebugRenderer::render");
+
+	if (isNull(m_drawArgs)) {
+		m_drawArgs = ResourceTracker::createBuffer("ProbeDebugRenderer", "drawArgs", NUM_PROBE_SETS * 4, 1, ImageFormat::R32UI());
+	}
+
+	// Build the indirect arguments from the GPU-side counters
+	{
+		Args args;
+		args.setComputeGroupSize(Vector3int32(1, 1, 1));
+		args.setComputeGridDim(Vector3int32(1, 1, 1));
+
+		m_drawArgs->bindAsShaderStorageBuffer(0);
+		args.setUniform("uniformProbeCount", uint32(uniformProbeWSPosition->width() * uniformProbeWSPosition->height()));
+		args.setUniform("numAdaptiveProbes", notNull(numAdaptiveProbes) ? numAdaptiveProbes : Texture::zero(), Sampler::buffer());
+		args.setUniform("numWorldProbes", notNull(numWorldProbes) ? numWorldProbes : Texture::zero(), Sampler::buffer());
+		args.setUniform("maxAdaptiveProbeCount", uint32(notNull(adaptiveProbeWSPosition) ? adaptiveProbeWSPosition->width() * adaptiveProbeWSPosition->height() : 0));
+		args.setUniform("maxWorldProbeCount", uint32(notNull(worldProbeWSPosition) ? worldProbeWSPosition->width() * worldProbeWSPosition->height() : 0));
+
+		LAUNCH_SHADER("shaders/ProbeDebug_BuildDrawArgs.glc", args);
+	}
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	// Same sizes and colors as App::screenProbeDebugDraw() and RadianceCache::debugDraw()
+	if (showUniformProbes) {
+		drawProbeSet(rd, UNIFORM_PROBES, uniformProbeWSPosition, 0.01f, Color3(1.0f, 1.0f, 1.0f) * 0.8f);
+	}
+	if (showAdaptiveProbes && notNull(adaptiveProbeWSPosition)) {
+		drawProbeSet(rd, ADAPTIVE_PROBES, adaptiveProbeWSPosition, 0.03f, Color3(1.0f, 0.0f, 0.0f) * 0.8f);
+	}
+	if (showWorldProbes && notNull(worldProbeWSPosition)) {
+		drawProbeSet(rd, WORLD_PROBES, worldProbeWSPosition, 0.015f, Color3(0.0f, 1.0f, 1.0f) * 0.8f);
+	}
+
+	END_PROFILER_EVENT();
+}
+
+void ProbeDebugRenderer::drawProbeSet(RenderDevice* rd, ProbeSet set, const shared_ptr<Texture>& positions, float radius, const Color3& color)
+{
+	Args args;
+	args.setPrimitiveType(PrimitiveType::TRIANGLES);
+	args.setIndirectArgs(m_drawArgs, set * 4 * sizeof(uint32));
+
+	args.setUniform("probePositions", positions, Sampler::buffer());
+	args.setUniform("probeRadius", radius);
+	args.setUniform("probeColor", color);
+
+	LAUNCH_SHADER("shaders/ProbeDebug_Draw.*", args);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Draws screen-space uniform, adaptive and world-space radiance cache probes on the GPU,
+	straight from the probe position textures. Probe counts never leave the GPU: they are
+	turned into indirect draw arguments by shaders/ProbeDebug_BuildDrawArgs.glc.
+
+	Nothing is allocated or dispatched while every probe set is hidden. */
+class ProbeDebugRenderer : public ReferenceCountedObject
+{
+protected:
+	enum ProbeSet { UNIFORM_PROBES = 0, ADAPTIVE_PROBES, WORLD_PROBES, NUM_PROBE_SETS };
+
+	/** NUM_PROBE_SETS DrawArraysIndirectCommand {count, instanceCount, first, baseInstance} */
+	shared_ptr<GLPixelTransferBuffer>   m_drawArgs;
+
+	ProbeDebugRenderer() {}
+
+	void drawProbeSet(RenderDevice* rd, ProbeSet set, const shared_ptr<Texture>& positions, float radius, const Color3& color);
+
+public:
+	bool                                showUniformProbes = false;
+	bool                                showAdaptiveProbes = false;
+	bool                                showWorldProbes = false;
+
+	static shared_ptr<ProbeDebugRenderer> create() {
+		return createShared<ProbeDebugRenderer>();
+	}
+
+	bool enabled() const {
+		return showUniformProbes || showAdaptiveProbes || showWorldProbes;
+	}
+
+	/** Renders into the currently bound framebuffer with the current camera matrices. Any texture may be null. */
+	void render
+	(RenderDevice*                  rd,
+	 const shared_ptr<Texture>&     uniformProbeWSPosition,
+	 const shared_ptr<Texture>&     adaptiveProbeWSPosition,
+	 const shared_ptr<Texture>&     numAdaptiveProbes,
+	 const shared_ptr<Texture>&     worldProbeWSPosition,
+	 const shared_ptr<Texture>&     numWorldProbes);
+};
@@ -0,0 +1,216 @@
+#include "ProbeInvalidation.h"
+#include "Telemetry.h"
+
+/** Smallest sphere enclosing \a a and \a b */
+static Sphere enclosingSphere(const Sphere& a, const Sphere& b)
+{
+	if (!isFinite(a.radius) || !isFinite(b.radius)) {
+		return Sphere(Point3::zero(), finf());
+	}
+
+	const float d = (b.center - a.center).length();
+	if (d + b.radius <= a.radius) {
+		return a;
+	} else if (d + a.radius <= b.radius) {
+		return b;
+	}
+
+	const float radius = (d + a.radius + b.radius) * 0.5f;
+	return Sphere(a.center + (b.center - a.center) * ((radius - a.radius) / d), radius);
+}
+
+/** Sphere around \a box grown by \a margin */
+static Sphere boundingSphere(const AABox& box, float margin)
+{
+	return Sphere(box.center(), box.extent().length() * 0.5f + margin);
+}
+
+ProbeInvalidation::LightState ProbeInvalidation::lightState(const shared_ptr<Light>& light)
+{
+	LightState s;
+	s.position = light->position();
+	s.direction = light->frame().lookVector();
+	s.power = light->bulbPower();
+	s.enabled = light->enabled();
+	// Directional lights reach everything
+	s.influence = (s.position.w == 0.0f) ? Sphere(Point3::zero(), finf()) : light->effectSphere();
+	return s;
+}
+
+void ProbeInvalidation::reset()
+{
+	m_lights.clear();
+	m_entities.clear();
+	m_regions.clear();
+	m_hasLights = false;
+	m_hasEntities = false;
+}
+
+void ProbeInvalidation::forget(Region::Source source)
+{
+	if (source == Region::LIGHT) {
+		m_lights.clear();
+		m_hasLights = false;
+	} else {
+		m_entities.clear();
+		m_hasEntities = false;
+	}
+
+	for (int i = 0; i < m_regions.size(); ++i) {
+		if (m_regions[i].source == source) {
+			m_regions.fastRemove(i);
+			--i;
+		}
+	}
+}
+
+void ProbeInvalidation::restart(Region::Source source)
+{
+	for (Region& region : m_regions) {
+		if (region.source == source) {
+			region.updates = 0;
+		}
+	}
+}
+
+void ProbeInvalidation::setHysteresis(float hysteresis, float minHysteresis)
+{
+	m_hysteresis = hysteresis;
+	m_minHysteresis = min(minHysteresis, hysteresis);
+}
+
+void ProbeInvalidation::invalidate(Region::Source source, const String& name, const Sphere& bounds)
+{
+	for (Region& region : m_regions) {
+		if ((region.source == source) && (region.name == name)) {
+			// Replaced, not merged: probes along the older path have restarted already, and a
+			// merged region would grow for as long as the light or entity keeps moving
+			region.bounds = bounds;
+			region.updates = 0;
+			return;
+		}
+	}
+
+	if (m_regions.size() < maxRegions) {
+		Region& region = m_regions.next();
+		region.source = source;
+		region.name = name;
+		region.bounds = bounds;
+		region.updates = 0;
+		return;
+	}
+
+	// Out of regions: grow the one that stays smallest
+	int best = 0;
+	float bestRadius = finf();
+	for (int i = 0; i < m_regions.size(); ++i) {
+		const float r = enclosingSphere(m_regions[i].bounds, bounds).radius;
+		if (r < bestRadius) {
+			best = i;
+			bestRadius = r;
+		}
+	}
+	Region& region = m_regions[best];
+	// Moved geometry wins, so that the merged region restarts with the new TriTree
+	region.source = ((region.source == Region::ENTITY) || (source == Region::ENTITY)) ? Region::ENTITY : Region::LIGHT;
+	region.name = "";
+	region.bounds = enclosingSphere(region.bounds, bounds);
+	region.updates = 0;
+}
+
+void ProbeInvalidation::updateLights(const LightingEnvironment& environment)
+{
+	Table<String, LightState> lights;
+	for (const shared_ptr<Light>& light : environment.lightArray) {
+		lights.set(light->name(), lightState(light));
+	}
+
+	if (m_hasLights) {
+		for (Table<String, LightState>::Iterator it = lights.begin(); it.isValid(); ++it) {
+			const LightState* previous = m_lights.getPointer(it->key);
+			if (isNull(previous)) {
+				invalidate(Region::LIGHT, it->key, it->value.influence);
+			} else if (!(*previous == it->value)) {
+				// Both where the light was and where it is now see a different light
+				invalidate(Region::LIGHT, it->key, enclosingSphere(previous->influence, it->value.influence));
+			}
+		}
+		for (Table<String, LightState>::Iterator it = m_lights.begin(); it.isValid(); ++it) {
+			if (!lights.containsKey(it->key)) {
+				invalidate(Region::LIGHT, it->key, it->value.influence);
+			}
+		}
+	}
+
+	m_lights = lights;
+	m_hasLights = true;
+	Telemetry::set("probeInvalidation.regions", double(m_regions.size()));
+}
+
+void ProbeInvalidation::updateEntities(const shared_ptr<Scene>& scene, float margin, Array<Sphere>& changed, Array<String>& changedNames)
+{
+	Array<shared_ptr<VisibleEntity>> visibleEntities;
+	scene->getTypedEntityArray<VisibleEntity>(visibleEntities);
+
+	Table<String, EntityState> entities;
+	for (const shared_ptr<VisibleEntity>& entity : visibleEntities) {
+		// Unbounded entities, e.g. a skybox, do not move geometry the tracer sees
+		if (!entity->lastBoxBounds().isFinite()) {
+			continue;
+		}
+		EntityState& s = entities.getCreate(entity->name());
+		s.frame = entity->frame();
+		s.bounds = entity->lastBoxBounds();
+	}
+
+	if (m_hasEntities) {
+		for (Table<String, EntityState>::Iterator it = entities.begin(); it.isValid(); ++it) {
+			const EntityState* previous = m_entities.getPointer(it->key);
+			if (isNull(previous)) {
+				changed.append(boundingSphere(it->value.bounds, margin));
+			} else if (!(*previous == it->value)) {
+				// Both where the entity was and where it is now see different geometry
+				changed.append(enclosingSphere(boundingSphere(previous->bounds, margin), boundingSphere(it->value.bounds, margin)));
+			} else {
+				continue;
+			}
+			changedNames.append(it->key);
+			invalidate(Region::ENTITY, it->key, changed.last());
+		}
+		for (Table<String, EntityState>::Iterator it = m_entities.begin(); it.isValid(); ++it) {
+			if (!entities.containsKey(it->key)) {
+				changed.append(boundingSphere(it->value.bounds, margin));
+				changedNames.append(it->key);
+				invalidate(Region::ENTITY, it->key, changed.last());
+			}
+		}
+	}
+
+	m_entities = entities;
+	m_hasEntities = true;
+	Telemetry::set("probeInvalidation.regions", double(m_regions.size()));
+}
+
+void ProbeInvalidation::onProbesUpdated()
+{
+	for (int i = 0; i < m_regions.size(); ++i) {
+		++m_regions[i].updates;
+		if (regionHysteresis(m_regions[i]) >= m_hysteresis) {
+			m_regions.fastRemove(i);
+			--i;
+		}
+	}
+}
+
+void ProbeInvalidation::setShaderArgs(UniformTable& args, const String& prefix, bool enabled) const
+{
+	alwaysAssertM(endsWith(prefix, "."), "Requires a struct prefix");
+
+	const int numRegions = enabled ? m_regions.size() : 0;
+	args.setUniform(prefix + "numRegions", numRegions);
+	for (int i = 0; i < maxRegions; ++i) {
+		const bool valid = (i < numRegions);
+		args.setArrayUniform(prefix + "regionBounds", i, valid ? Vector4(m_regions[i].bounds.center, m_regions[i].bounds.radius) : Vector4::zero());
+		args.setArrayUniform(prefix + "regionHysteresis", i, valid ? regionHysteresis(m_regions[i]) : 1.0f);
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Tracks where the lighting or the geometry of the scene changed recently, so that only the
+	probes there are reset instead of every probe lagging behind by the field's hysteresis.
+
+	Every frame the lights of the LightingEnvironment and the VisibleEntitys of the Scene are
+	diffed against the previous frame. A light that moved, changed power, was toggled, added or
+	removed contributes its influence volume; an entity that moved, appeared or disappeared
+	contributes its old and new bounds. Each becomes an invalidation region.
+
+	Screen probes inside a region blend with a lowered hysteresis, see ProbeInvalidation.glsl, which
+	starts at minHysteresis and follows the running average n / (n + 1) over the n probe updates
+	since the change. A region expires once that reaches the field's hysteresis, so probes away from
+	the changes keep their full temporal reuse throughout.
+
+	Something that keeps changing restarts its region every frame, which then covers where it was
+	last frame and where it is now, not everywhere it has been. */
+class ProbeInvalidation : public ReferenceCountedObject
+{
+public:
+	/** Matches PROBE_INVALIDATION_MAX_REGIONS in ProbeInvalidation.glsl */
+	static const int maxRegions = 8;
+
+	class Region
+	{
+	public:
+		enum Source { LIGHT, ENTITY };
+
+		Source          source = LIGHT;
+
+		/** Name of the light or entity, or empty once merged with another region */
+		String          name;
+		Sphere          bounds;
+
+		/** Probe updates since the last change */
+		int             updates = 0;
+	};
+
+protected:
+
+	/** What the probes see of one light */
+	class LightState
+	{
+	public:
+		Vector4         position;
+		Vector3         direction;
+		Power3          power;
+		bool            enabled = false;
+		Sphere          influence;
+
+		bool operator==(const LightState& other) const {
+			return (position == other.position) && (direction == other.direction) && (power == other.power) && (enabled == other.enabled);
+		}
+	};
+
+	/** What the probes see of one entity */
+	class EntityState
+	{
+	public:
+		CoordinateFrame frame;
+		AABox           bounds;
+
+		bool operator==(const EntityState& other) const {
+			return (frame == other.frame) && (bounds == other.bounds);
+		}
+	};
+
+	/** Name to state last frame. Only diffed once m_hasLights / m_hasEntities, i.e. from the
+		second update after reset(). */
+	Table<String, LightState>   m_lights;
+	Table<String, EntityState>  m_entities;
+	bool                        m_hasLights = false;
+	bool                        m_hasEntities = false;
+
+	Array<Region>               m_regions;
+
+	float                       m_hysteresis = 1.0f;
+	float                       m_minHysteresis = 0.0f;
+
+	ProbeInvalidation() {}
+
+	static LightState lightState(const shared_ptr<Light>& light);
+
+	/** Restarts the region of \a name with \a bounds, which the caller makes enclose the previous and
+		the current state, or adds one */
+	void invalidate(Region::Source source, const String& name, const Sphere& bounds);
+
+public:
+
+	static shared_ptr<ProbeInvalidation> create() {
+		return createShared<ProbeInvalidation>();
+	}
+
+	/** Forgets the lights, the entities and the regions, e.g. on a scene change when every probe
+		restarts anyway */
+	void reset();
+
+	/** Forgets what was tracked from \a source and its regions */
+	void forget(Region::Source source);
+
+	/** Restarts the regions of \a source, e.g. once the tracer sees the moved geometry */
+	void restart(Region::Source source);
+
+	/** \a hysteresis is the field's and \a minHysteresis the value probes drop to right after a change */
+	void setHysteresis(float hysteresis, float minHysteresis);
+
+	/** Diffs the lights of \a environment against last frame */
+	void updateLights(const LightingEnvironment& environment);
+
+	/** Diffs the VisibleEntitys of \a scene against last frame. The regions are the bounds grown by
+		\a margin; the ones that changed this frame are appended to \a changed and the names of their
+		entities to \a changedNames. */
+	void updateEntities(const shared_ptr<Scene>& scene, float margin, Array<Sphere>& changed, Array<String>& changedNames);
+
+	/** Call after each round of probe updates; ages the regions and drops the converged ones */
+	void onProbesUpdated();
+
+	bool active() const {
+		return m_regions.size() > 0;
+	}
+
+	const Array<Region>& regions() const {
+		return m_regions;
+	}
+
+	float regionHysteresis(const Region& region) const {
+		return clamp(float(region.updates) / float(region.updates + 1), m_minHysteresis, m_hysteresis);
+	}
+
+	/** Binds a ProbeInvalidation.glsl struct. With \a enabled false no probe is invalidated. */
+	void setShaderArgs(UniformTable& args, const String& prefix, bool enabled = true) const;
+};
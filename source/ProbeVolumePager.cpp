@@ -0,0 +1,303 @@
+#include "ProbeVolumePager.h"
+#include "IrradianceField.h"
+#include "ProbeCache.h"
+#include "ResourceTracker.h"
+#include "Telemetry.h"
+
+void ProbeVolumePager::allocate(IrradianceField& irradianceField)
+{
+	const Vector3int32 brickSize(m_brickSize, m_brickSize, m_brickSize);
+	const Vector2int32& irradianceSize = IrradianceField::gridAtlasSize(brickSize, irradianceField.irradianceOctSideLength());
+	const Vector2int32& depthSize = IrradianceField::gridAtlasSize(brickSize, irradianceField.depthOctSideLength());
+
+	const Vector3int32& probeCounts = irradianceField.probeCounts();
+	const Vector3int32 brickCounts((probeCounts.x + m_brickSize - 1) / m_brickSize, (probeCounts.y + m_brickSize - 1) / m_brickSize, (probeCounts.z + m_brickSize - 1) / m_brickSize);
+
+	if (notNull(m_irradianceBricks) && (brickCounts == m_brickCounts) &&
+		(m_irradianceBricks->width() == irradianceSize.x) && (m_irradianceBricks->height() == irradianceSize.y) &&
+		(m_meanDistBricks->width() == depthSize.x) && (m_meanDistBricks->height() == depthSize.y) &&
+		(m_irradianceBricks->format() == irradianceField.irradianceFormat()) && (m_meanDistBricks->format() == irradianceField.meanDistFormat())) {
+		return;
+	}
+
+	m_brickCounts = brickCounts;
+	m_key = irradianceField.probeCacheKey(irradianceField.geometryHash());
+
+	// Enough layers for the resident box wherever the camera is
+	int layers = 1;
+	for (int i = 0; i < 3; ++i) {
+		layers *= min(2 * m_residentRadius + 1, m_brickCounts[i]);
+	}
+
+	m_irradianceBricks = ResourceTracker::createTexture("ProbeVolumePager", "ProbeVolumePager::irradianceBricks", irradianceSize.x, irradianceSize.y,
+		irradianceField.irradianceFormat(), Texture::DIM_2D_ARRAY, false, layers);
+	m_meanDistBricks = ResourceTracker::createTexture("ProbeVolumePager", "ProbeVolumePager::meanDistBricks", depthSize.x, depthSize.y,
+		irradianceField.meanDistFormat(), Texture::DIM_2D_ARRAY, false, layers);
+	m_irradianceBrick = ResourceTracker::createTexture("ProbeVolumePager", "ProbeVolumePager::irradianceBrick", irradianceSize.x, irradianceSize.y, irradianceField.irradianceFormat());
+	m_meanDistBrick = ResourceTracker::createTexture("ProbeVolumePager", "ProbeVolumePager::meanDistBrick", depthSize.x, depthSize.y, irradianceField.meanDistFormat());
+	m_pageTable = ResourceTracker::createTexture("ProbeVolumePager", "ProbeVolumePager::pageTable", m_brickCounts.x, m_brickCounts.y,
+		ImageFormat::R32I(), Texture::DIM_3D, false, m_brickCounts.z);
+
+	m_layerOfBrick.clear();
+	m_staleBricks.clear();
+	m_uncachedBricks.clear();
+	m_allUncached = false;
+	m_bakeBrick = -1;
+	m_brickInLayer.resize(layers);
+	m_brickInLayer.setAll(-1);
+	m_pageTableDirty = true;
+
+	logPrintf("ProbeVolumePager: %d x %d x %d bricks of %d^3 probes, %d resident\n", m_brickCounts.x, m_brickCounts.y, m_brickCounts.z, m_brickSize, layers);
+}
+
+String ProbeVolumePager::brickFilename(const String& directory, const Point3int32& brick) const
+{
+	return FilePath::concat(directory, format("%016llx_%d_%d_%d.brick", (unsigned long long)m_key, brick.x, brick.y, brick.z));
+}
+
+bool ProbeVolumePager::loadBrick(IrradianceField& irradianceField, const Point3int32& brick, int& loads, bool& bake)
+{
+	bake = false;
+
+	// Edited geometry (hash 0) cannot be matched against the cache, nor can bricks near moved entities
+	const bool cached = !irradianceField.brickCacheDirectory().empty() && (irradianceField.geometryHash() != 0) &&
+		!m_allUncached && !m_uncachedBricks.contains(brickIndex(brick));
+	const String& filename = cached ? brickFilename(irradianceField.brickCacheDirectory(), brick) : "";
+	if (!cached || !FileSystem::exists(filename)) {
+		bake = true;
+		return false;
+	}
+
+	if (loads >= maxLoadsPerFrame) {
+		return false;
+	}
+	++loads;
+
+	// A file of another configuration is overwritten by the bake
+	bake = !ProbeCache::load(filename, m_key, CoordinateFrame(), { m_irradianceBrick, m_meanDistBrick });
+	return !bake;
+}
+
+void ProbeVolumePager::continueBake(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray)
+{
+	const Point3int32& brick = brickCoord(m_bakeBrick);
+	const int passes = min(bakePassesPerFrame, m_bakePasses - m_bakePass);
+	irradianceField.bakeGridRegion(rd, surfaceArray, Point3int32(brick.x * m_brickSize, brick.y * m_brickSize, brick.z * m_brickSize),
+		Vector3int32(m_brickSize, m_brickSize, m_brickSize), m_bakePass, passes, m_bakeIrradianceBrick, m_bakeMeanDistBrick);
+	m_bakePass += passes;
+	Telemetry::add("probeVolume.bakePasses", double(passes));
+
+	if (m_bakePass < m_bakePasses) {
+		return;
+	}
+
+	if (!irradianceField.brickCacheDirectory().empty() && (irradianceField.geometryHash() != 0) &&
+		!m_allUncached && !m_uncachedBricks.contains(m_bakeBrick)) {
+		ProbeCache::save(brickFilename(irradianceField.brickCacheDirectory(), brick), m_key, CoordinateFrame(),
+			format("brick %d %d %d", brick.x, brick.y, brick.z), { m_bakeIrradianceBrick, m_bakeMeanDistBrick });
+	}
+
+	// Stale bricks are re-baked in place, missing ones take a free layer
+	int layer = -1;
+	if (m_layerOfBrick.get(m_bakeBrick, layer)) {
+		const int stale = m_staleBricks.findIndex(m_bakeBrick);
+		if (stale >= 0) {
+			m_staleBricks.remove(stale);
+		}
+	} else {
+		layer = freeLayer();
+		if (layer >= 0) {
+			m_brickInLayer[layer] = m_bakeBrick;
+			m_layerOfBrick.set(m_bakeBrick, layer);
+			m_pageTableDirty = true;
+		}
+	}
+	if (layer >= 0) {
+		copyToLayer(m_bakeIrradianceBrick, m_bakeMeanDistBrick, layer);
+	}
+
+	m_bakeBrick = -1;
+}
+
+void ProbeVolumePager::uploadPageTable()
+{
+	Array<int32> pages;
+	pages.resize(m_brickCounts.x * m_brickCounts.y * m_brickCounts.z);
+	pages.setAll(-1);
+	for (int layer = 0; layer < m_brickInLayer.size(); ++layer) {
+		if (m_brickInLayer[layer] >= 0) {
+			pages[m_brickInLayer[layer]] = layer;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_3D, m_pageTable->openGLID());
+	glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, m_brickCounts.x, m_brickCounts.y, m_brickCounts.z, GL_RED_INTEGER, GL_INT, pages.getCArray());
+	glBindTexture(GL_TEXTURE_3D, GL_NONE);
+	Telemetry::add("transfer.uploadBytes", double(pages.size() * sizeof(int32)));
+
+	m_pageTableDirty = false;
+}
+
+void ProbeVolumePager::copyToLayer(const shared_ptr<Texture>& irradianceBrick, const shared_ptr<Texture>& meanDistBrick, int layer)
+{
+	glCopyImageSubData(irradianceBrick->openGLID(), GL_TEXTURE_2D, 0, 0, 0, 0,
+		m_irradianceBricks->openGLID(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, irradianceBrick->width(), irradianceBrick->height(), 1);
+	glCopyImageSubData(meanDistBrick->openGLID(), GL_TEXTURE_2D, 0, 0, 0, 0,
+		m_meanDistBricks->openGLID(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, meanDistBrick->width(), meanDistBrick->height(), 1);
+}
+
+void ProbeVolumePager::invalidate(IrradianceField& irradianceField, const Sphere& bounds)
+{
+	if (isNull(m_irradianceBricks)) {
+		return;
+	}
+
+	if (!isFinite(bounds.radius)) {
+		m_allUncached = true;
+		for (const int index : m_brickInLayer) {
+			if ((index >= 0) && !m_staleBricks.contains(index)) {
+				m_staleBricks.append(index);
+			}
+		}
+		// The batches baked so far saw the old geometry
+		m_bakePass = 0;
+		return;
+	}
+
+	const Vector3 r(bounds.radius, bounds.radius, bounds.radius);
+	const Point3int32& lo = irradianceField.positionToGridIndex(bounds.center - r);
+	const Point3int32& hi = irradianceField.positionToGridIndex(bounds.center + r);
+	for (int z = lo.z / m_brickSize; z <= hi.z / m_brickSize; ++z) {
+		for (int y = lo.y / m_brickSize; y <= hi.y / m_brickSize; ++y) {
+			for (int x = lo.x / m_brickSize; x <= hi.x / m_brickSize; ++x) {
+				const int index = brickIndex(Point3int32(x, y, z));
+				m_uncachedBricks.insert(index);
+				if (m_layerOfBrick.containsKey(index) && !m_staleBricks.contains(index)) {
+					m_staleBricks.append(index);
+				}
+				if (index == m_bakeBrick) {
+					m_bakePass = 0;
+				}
+			}
+		}
+	}
+}
+
+void ProbeVolumePager::update(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray, const Point3& cameraPosition)
+{
+	BEGIN_PROFILER_EVENT("ProbeVolumePager::update");
+
+	allocate(irradianceField);
+
+	// Box of bricks that should be resident, clamped to the grid
+	const Point3int32& cameraProbe = irradianceField.positionToGridIndex(cameraPosition);
+	Point3int32 lo, hi;
+	for (int i = 0; i < 3; ++i) {
+		const int center = cameraProbe[i] / m_brickSize;
+		lo[i] = max(0, center - m_residentRadius);
+		hi[i] = min(m_brickCounts[i] - 1, center + m_residentRadius);
+	}
+	const auto inBox = [&](const Point3int32& brick) {
+		return (brick.x >= lo.x) && (brick.y >= lo.y) && (brick.z >= lo.z) && (brick.x <= hi.x) && (brick.y <= hi.y) && (brick.z <= hi.z);
+	};
+
+	if ((m_bakeBrick >= 0) && !inBox(brickCoord(m_bakeBrick))) {
+		m_bakeBrick = -1;
+	}
+
+	for (int layer = 0; layer < m_brickInLayer.size(); ++layer)
+	{
+		const int index = m_brickInLayer[layer];
+		if ((index >= 0) && !inBox(brickCoord(index))) {
+			m_layerOfBrick.remove(index);
+			const int stale = m_staleBricks.findIndex(index);
+			if (stale >= 0) {
+				m_staleBricks.fastRemove(stale);
+			}
+			m_brickInLayer[layer] = -1;
+			m_pageTableDirty = true;
+		}
+	}
+
+	// Nearest first, so the bricks around the camera are filled before the outer ones
+	const Point3int32 center((lo.x + hi.x) / 2, (lo.y + hi.y) / 2, (lo.z + hi.z) / 2);
+	Array<Point3int32> missing;
+	for (int z = lo.z; z <= hi.z; ++z) {
+		for (int y = lo.y; y <= hi.y; ++y) {
+			for (int x = lo.x; x <= hi.x; ++x) {
+				const Point3int32 brick(x, y, z);
+				if (!m_layerOfBrick.containsKey(brickIndex(brick))) {
+					missing.append(brick);
+				}
+			}
+		}
+	}
+	std::stable_sort(missing.begin(), missing.end(), [&center](const Point3int32& a, const Point3int32& b) {
+		const Vector3int32 da = a - center, db = b - center;
+		return (da.x * da.x + da.y * da.y + da.z * da.z) < (db.x * db.x + db.y * db.y + db.z * db.z);
+	});
+
+	int loads = 0, filled = 0, bakeCandidate = -1;
+	for (const Point3int32& brick : missing)
+	{
+		const int index = brickIndex(brick);
+		const int layer = freeLayer();
+		if (layer < 0) {
+			break;
+		}
+		if (index == m_bakeBrick) {
+			continue;
+		}
+		bool bake;
+		if (loadBrick(irradianceField, brick, loads, bake)) {
+			copyToLayer(m_irradianceBrick, m_meanDistBrick, layer);
+			m_brickInLayer[layer] = index;
+			m_layerOfBrick.set(index, layer);
+			m_pageTableDirty = true;
+			++filled;
+		} else if (bake && (bakeCandidate < 0)) {
+			bakeCandidate = index;
+		}
+	}
+
+	// Stale bricks stay mapped, so missing ones go first. Nearest first as well.
+	std::stable_sort(m_staleBricks.begin(), m_staleBricks.end(), [&](int a, int b) {
+		const Vector3int32 da = brickCoord(a) - center, db = brickCoord(b) - center;
+		return (da.x * da.x + da.y * da.y + da.z * da.z) < (db.x * db.x + db.y * db.y + db.z * db.z);
+	});
+	if (m_bakeBrick < 0) {
+		// Bakes of stale bricks: the geometry moved, so they are not saved to the brick cache
+		m_bakeBrick = (bakeCandidate >= 0) ? bakeCandidate : ((m_staleBricks.size() > 0) ? m_staleBricks[0] : -1);
+		m_bakePass = 0;
+	}
+	// The next frames finish a rebuild in the background instead of this bake waiting for it
+	if ((m_bakeBrick >= 0) && !irradianceField.sceneTriTreePending()) {
+		continueBake(rd, irradianceField, surfaceArray);
+	}
+
+	if (m_pageTableDirty) {
+		uploadPageTable();
+	}
+
+	Telemetry::set("probeVolume.residentBricks", residentBrickCount());
+	Telemetry::set("probeVolume.missingBricks", missing.size() - filled);
+	Telemetry::set("probeVolume.staleBricks", m_staleBricks.size());
+
+	END_PROFILER_EVENT();
+}
+
+void ProbeVolumePager::setShaderArgs(UniformTable& args, const String& prefix, IrradianceField& irradianceField) const
+{
+	alwaysAssertM(endsWith(prefix, "."), "Requires a struct prefix");
+
+	args.setUniform(prefix + "pageTable", m_pageTable, Sampler::buffer());
+	args.setUniform(prefix + "irradianceBricks", m_irradianceBricks, Sampler::video());
+	args.setUniform(prefix + "meanDistBricks", m_meanDistBricks, Sampler::video());
+	args.setUniform(prefix + "brickSize", m_brickSize);
+	args.setUniform(prefix + "irradianceProbeSideLength", irradianceField.irradianceOctSideLength());
+	args.setUniform(prefix + "depthProbeSideLength", irradianceField.depthOctSideLength());
+	args.setUniform(prefix + "probeStartPosition", irradianceField.probeStartPosition());
+	args.setUniform(prefix + "probeStep", irradianceField.probeStep());
+	args.setUniform(prefix + "probeCounts", irradianceField.probeCounts());
+	args.setUniform(prefix + "normalBias", irradianceField.normalBias());
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <G3D/G3D.h>
+
+class IrradianceField;
+
+/** Keeps the bricks of the world-space IrradianceField grid around the camera resident, so that
+	probe density does not depend on the size of the level.
+
+	The grid is split into bricks of brickSize^3 probes. The bricks within residentRadius bricks of
+	the camera along each axis live in the layers of two DIM_2D_ARRAY atlases, one brick atlas per
+	layer (see IrradianceField::bakeGridRegion() for the tile layout). A DIM_3D page table maps every
+	brick of the grid to its layer, or -1; PagedProbeVolume.glsl does the lookup.
+
+	When the camera moves, bricks that fall out of range are evicted and the nearest missing bricks
+	are streamed from the brick cache directory, within maxLoadsPerFrame. Bricks that are not in the
+	cache are baked one at a time, bakePassesPerFrame ray batches per frame, and then written there.
+	A brick stays unmapped until it is filled.
+
+	Resident bricks near geometry that moved are marked stale by invalidate() and re-baked in place
+	once no missing brick is waiting for a bake, keeping their old contents mapped until then. The
+	bricks near moved geometry no longer match the scene the cache is keyed on, so they bypass it
+	from then on; the rest of the grid keeps loading from it.
+
+	IrradianceField::renderSecondaryBounce() reads the resident bricks. */
+class ProbeVolumePager : public ReferenceCountedObject
+{
+public:
+	/** Bricks loaded from the cache per frame */
+	static const int maxLoadsPerFrame = 4;
+
+	/** Ray batches of the brick being baked per frame; a bake takes bakePasses / bakePassesPerFrame frames */
+	static const int bakePassesPerFrame = 1;
+
+protected:
+	int                     m_brickSize;
+	int                     m_residentRadius;
+	int                     m_bakePasses;
+
+	/** Bricks covering the grid */
+	Vector3int32            m_brickCounts;
+
+	/** Configuration the layers were filled for, see IrradianceField::probeCacheKey() */
+	uint64                  m_key = 0;
+
+	/** Brick index (see brickIndex()) to layer */
+	Table<int, int>         m_layerOfBrick;
+
+	/** Brick index held by each layer, -1 if free */
+	Array<int>              m_brickInLayer;
+
+	/** Indices of resident bricks to re-bake */
+	Array<int>              m_staleBricks;
+
+	/** Indices of bricks near geometry that moved, which are neither loaded from nor saved to the
+		cache. m_allUncached covers every brick, e.g. after a change with infinite bounds. */
+	Set<int>                m_uncachedBricks;
+	bool                    m_allUncached = false;
+
+	shared_ptr<Texture>     m_irradianceBricks;
+	shared_ptr<Texture>     m_meanDistBricks;
+
+	/** Page table: R32I, one texel per brick of the grid */
+	shared_ptr<Texture>     m_pageTable;
+	bool                    m_pageTableDirty = true;
+
+	/** One brick, loaded before it is copied into its layer */
+	shared_ptr<Texture>     m_irradianceBrick;
+	shared_ptr<Texture>     m_meanDistBrick;
+
+	/** Brick index being baked, or -1, and the ray batches it has so far */
+	int                     m_bakeBrick = -1;
+	int                     m_bakePass = 0;
+
+	/** The brick being baked, until its last pass */
+	shared_ptr<Texture>     m_bakeIrradianceBrick;
+	shared_ptr<Texture>     m_bakeMeanDistBrick;
+
+	ProbeVolumePager(int brickSize, int residentRadius, int bakePasses) :
+		m_brickSize(brickSize), m_residentRadius(residentRadius), m_bakePasses(bakePasses) {}
+
+	int brickIndex(const Point3int32& brick) const {
+		return brick.x + m_brickCounts.x * (brick.y + m_brickCounts.y * brick.z);
+	}
+
+	Point3int32 brickCoord(int index) const {
+		return Point3int32(index % m_brickCounts.x, (index / m_brickCounts.x) % m_brickCounts.y, index / (m_brickCounts.x * m_brickCounts.y));
+	}
+
+	/** (Re)allocates the arrays and drops every brick if the grid or the probe format changed */
+	void allocate(IrradianceField& irradianceField);
+
+	String brickFilename(const String& directory, const Point3int32& brick) const;
+
+	/** Loads \a brick from the cache into m_irradianceBrick and m_meanDistBrick within the load budget.
+		Sets \a bake if the cache does not have it or must not be used for it. */
+	bool loadBrick(IrradianceField& irradianceField, const Point3int32& brick, int& loads, bool& bake);
+
+	/** Adds bakePassesPerFrame ray batches to m_bakeBrick and maps it once it has all of them */
+	void continueBake(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray);
+
+	void uploadPageTable();
+
+	/** First layer holding no brick, or -1 */
+	int freeLayer() const {
+		return m_brickInLayer.findIndex(-1);
+	}
+
+	/** Copies one brick atlas of each kind into \a layer of the arrays */
+	void copyToLayer(const shared_ptr<Texture>& irradianceBrick, const shared_ptr<Texture>& meanDistBrick, int layer);
+
+public:
+	static shared_ptr<ProbeVolumePager> create(int brickSize, int residentRadius, int bakePasses) {
+		return createShared<ProbeVolumePager>(brickSize, residentRadius, bakePasses);
+	}
+
+	/** Evicts the bricks out of range of \a cameraPosition and fills the nearest missing ones */
+	void update(RenderDevice* rd, IrradianceField& irradianceField, const Array<shared_ptr<Surface>>& surfaceArray, const Point3& cameraPosition);
+
+	/** Marks the resident bricks overlapping \a bounds for re-baking and every brick overlapping it
+		as uncached */
+	void invalidate(IrradianceField& irradianceField, const Sphere& bounds);
+
+	/** Binds the page table and the brick arrays as a PagedProbeVolume */
+	void setShaderArgs(UniformTable& args, const String& prefix, IrradianceField& irradianceField) const;
+
+	int residentBrickCount() const {
+		return m_layerOfBrick.size();
+	}
+};
@@ -1,4 +1,7 @@
 #include "RadianceCache.h"
+#include "Telemetry.h"
+#include "ResourceTracker.h"
+#include "ShaderCache.h"
 
 
 
@@ -77,13 +80,182 @@ bool RadianceCache::UpdateRadianceCacheState(shared_ptr<Camera> camera, Radiance
 void RadianceCache::onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray)
 {
 	UpdateRadianceCache(rd);	
+	traceRadianceProbes(rd, surfaceArray);
+
+	if (Telemetry::enabled() && notNull(NumRadianceProbe) && !ShaderWarmUp::active()) {
+		// Stalls on the marking passes, so only while someone is looking
+		Telemetry::set("radianceCache.probesMarked", NumRadianceProbe->readTexel(0, 0).r);
+		Telemetry::add("transfer.downloadBytes", double(NumRadianceProbe->format()->openGLBitsPerPixel / 8));
+	}
+}
+
+bool RadianceCache::warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray)
+{
+	if (isNull(activeCamera) || (m_views.size() == 0)) {
+		return false;
+	}
+
+	// The marking pass decodes the G-buffer of the main view
+	const String& key = format("%d|%d", int(m_gbufferProfile), int(isNull(m_views[0]->gbuffer->texture(GBuffer::Field::WS_POSITION))));
+	if (key == m_warmShadersKey) {
+		return false;
+	}
+	m_warmShadersKey = key;
+
+	ShaderWarmUp::Scope warmUp;
+	onGraphics3D(rd, surfaceArray);
+	return true;
+}
+
+void RadianceCache::setShaderArgs(UniformTable& args, const String& prefix)
+{
+	alwaysAssertM(endsWith(prefix, "."), "Requires a struct prefix");
+
+	const Array<RadianceCacheClipmap>& clipmaps = radianceCacheState.clipmaps;
+	for (int i = 0; i < clipmaps.size(); ++i)
+	{
+		args.setArrayUniform(prefix + "worldPositionToProbeCoord", i, Vector4(clipmaps[i].WorldPositionToProbeCoordBias, clipmaps[i].WorldPositionToProbeCoordScale));
+	}
+	args.setUniform(prefix + "numClipmaps", clipmaps.size());
+	args.setUniform(prefix + "clipmapResolution", radianceCacheInputs.RadianceProbeClipmapResolution);
+	args.setUniform(prefix + "probeIndirectionTexture", m_radianceProbeIndirectionTexture, Sampler::buffer());
+
+	args.setUniform(prefix + "probeAtlas", m_radianceProbeAtlas, Sampler::video());
+	args.setUniform(prefix + "probeAtlasWidth", m_radianceProbeAtlas->width());
+	args.setUniform(prefix + "probeAtlasHeight", m_radianceProbeAtlas->height());
+	args.setUniform(prefix + "probeSideLength", radianceCacheInputs.RadianceProbeResolution);
 }
 
+void RadianceCache::traceRadianceProbes(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray)
+{
+	const shared_ptr<IrradianceField>& irradianceField = m_irradianceField.lock();
+	if (isNull(irradianceField) || isNull(irradianceField->scene())) {
+		return;
+	}
+
+	BEGIN_PROFILER_EVENT("traceRadianceProbes");
+
+	const int rayDimX = radianceCacheInputs.NumRaysPerRadianceProbe;
+	const int rayDimY = radianceCacheInputs.MaxNumRadianceProbes;
+	const int probeSide = radianceCacheInputs.RadianceProbeResolution;
+
+	if (isNull(m_radianceRayOrigins) ||
+		m_radianceRayOrigins->width() != rayDimX ||
+		m_radianceRayOrigins->height() != rayDimY)
+	{
+		m_radianceRayOrigins = ResourceTracker::createTexture("RadianceCache", "RadianceCache::m_radianceRayOrigins", rayDimX, rayDimY, ImageFormat::RGBA32F());
+		m_radianceRayDirections = ResourceTracker::createTexture("RadianceCache", "RadianceCache::m_radianceRayDirections", rayDimX, rayDimY, ImageFormat::RGBA32F());
+		m_radianceRaysFB = Framebuffer::create(m_radianceRayOrigins, m_radianceRayDirections);
+		m_radianceRaysShadedFB = Framebuffer::create(ResourceTracker::createTexture("RadianceCache", "RadianceCache::m_radianceRaysShadedFB", rayDimX, rayDimY, ImageFormat::RGB32F()));
+
+		const GBuffer::Specification& gbufferRTSpec = GBufferProfile::raySpecification(m_gbufferProfile);
+
+		m_radianceRaysGBuffer = GBuffer::create(gbufferRTSpec, "RadianceCache::m_radianceRaysGBuffer");
+		m_radianceRaysGBuffer->setSpecification(gbufferRTSpec);
+		m_radianceRaysGBuffer->resize(rayDimX, rayDimY);
+		ResourceTracker::trackGBuffer("RadianceCache", m_radianceRaysGBuffer);
+	}
+
+	if (isNull(m_radianceProbeAtlas))
+	{
+		// 1-pixel of padding surrounding each probe, 1-pixel padding surrounding entire texture for alignment.
+		const int probesPerRow = 64;
+		const int atlasWidth = (probeSide + 2) * probesPerRow + 2;
+		const int atlasHeight = (probeSide + 2) * iCeil(rayDimY / float(probesPerRow)) + 2;
+
+		m_radianceProbeAtlas = ResourceTracker::createTexture("RadianceCache", "RadianceCache::m_radianceProbeAtlas", atlasWidth, atlasHeight, ImageFormat::RGB16F(), Texture::DIM_2D, false, 1);
+		m_radianceProbeAtlasFB = Framebuffer::create(m_radianceProbeAtlas);
+		m_radianceProbeAtlasFB->set(Framebuffer::DEPTH, ResourceTracker::createTexture("RadianceCache", "RadianceCache::radianceAtlasStencil", atlasWidth, atlasHeight, ImageFormat::DEPTH32()));
+
+		// Write 1 outside probe octahedron
+		rd->push2D(m_radianceProbeAtlasFB); {
+			rd->setColorClearValue(Color4(0, 0, 0, 0));
+			rd->setDepthWrite(true);
+			rd->clear();
+			Args args;
+			args.setUniform("probeSideLength", probeSide);
+			args.setRect(rd->viewport());
+			LAUNCH_SHADER("shaders/IrradianceField_WriteOnesToProbeBorders.pix", args);
+		} rd->pop2D();
+	}
+
+	rd->push2D(m_radianceRaysFB); {
+		Args args;
+		args.setMacro("RAYS_PER_PROBE", rayDimX);
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+		args.setUniform("radianceProbeWorldPosition", RadianceProbeWorldPosition, Sampler::buffer());
+		args.setUniform("numRadianceProbe", NumRadianceProbe, Sampler::buffer());
+		for (int i = 0; i < radianceCacheState.clipmaps.size(); ++i)
+		{
+			args.setArrayUniform("probeTMin", i, radianceCacheState.clipmaps[i].ProbeTMin);
+		}
+		args.setUniform("randomOrientation", Matrix3::fromAxisAngle(Vector3::random(), Random::common().uniform(0.f, 2 * pif())));
+
+		LAUNCH_SHADER("shaders/RadianceCache_GenerateRays.pix", args);
+	} rd->pop2D();
+
+	// Single bounce: the screen-space indirect pass has nothing meaningful to say about off-screen hits
+	m_radianceRaysGBuffer->prepare(rd, 0.0f, 0.0f, Vector2int16(0, 0), Vector2int16(0, 0));
+	irradianceField->sampleAndShadeArbitraryRays
+		(rd,
+		surfaceArray,
+		m_radianceRaysShadedFB,
+		irradianceField->scene()->lightingEnvironment(),
+		m_radianceRayOrigins,
+		m_radianceRayDirections,
+		nullptr,
+		true,
+		m_radianceRaysGBuffer,
+		TriTree::DO_NOT_CULL_BACKFACES,
+		"radianceCache");
+
+	// The gather re-packs the atlas slots every frame, so each probe is rewritten in full (no hysteresis)
+	rd->push2D(m_radianceProbeAtlasFB); {
+		rd->setBlendFunc(RenderDevice::BLEND_SRC_ALPHA, RenderDevice::BLEND_ONE_MINUS_SRC_ALPHA);
+		// Set the depth test to discard the border pixels
+		rd->setDepthTest(RenderDevice::DepthTest::DEPTH_GREATER);
+		Args args;
+
+		args.setMacro("RAYS_PER_PROBE", rayDimX);
+		args.setMacro("OUTPUT_IRRADIANCE", true);
+		args.setMacro("SHORT_RANGE_TRACE", false);
+		// Uniform ray directions, see RadianceCache_GenerateRays.pix
+		args.setMacro("RAY_PDF", false);
+		args.setUniform("hysteresis", 0.0f);
+		irradianceField->probeInvalidation()->setShaderArgs(args, "probeInvalidation.", false);
+		args.setUniform("invalidatedProbesOnly", false);
+		args.setUniform("depthSharpness", 1.0f);
+		args.setUniform("fullTextureWidth", m_radianceProbeAtlasFB->width());
+		args.setUniform("fullTextureHeight", m_radianceProbeAtlasFB->height());
+		args.setUniform("probeSideLength", probeSide);
+		args.setUniform("maxDistance", radianceCacheInputs.ClipmapWorldExtent);
+		// One atlas slot per gathered probe, slot i reads ray row i
+		args.setUniform("probeRowOffset", 0);
+		args.setUniform("probeRowCount", m_radianceRayOrigins->height());
+		args.setRect(ShaderWarmUp::rect(rd, rd->viewport()));
+
+		m_radianceRaysGBuffer->texture(GBuffer::Field::WS_POSITION)->setShaderArgs(args, "rayHitLocations.", Sampler::buffer());
+		m_radianceRaysGBuffer->texture(GBuffer::Field::WS_NORMAL)->setShaderArgs(args, "rayHitNormals.", Sampler::buffer());
+		m_radianceRayOrigins->setShaderArgs(args, "rayOrigins.", Sampler::buffer());
+		m_radianceRayDirections->setShaderArgs(args, "rayDirections.", Sampler::buffer());
+		m_radianceRaysShadedFB->texture(0)->setShaderArgs(args, "rayHitRadiance.", Sampler::buffer());
+
+		LAUNCH_SHADER("shaders/IrradianceField_UpdateIrradianceProbe.pix", args);
+	} rd->pop2D();
+
+	if (!ShaderWarmUp::active()) {
+		m_hasRadiance = true;
+	}
+
+	END_PROFILER_EVENT();
+}
+
+/** CPU reference for ProbeDebugRenderer. Reads the probe list back, so only call it while debugging. */
 void RadianceCache::debugDraw() {
 	shared_ptr<Image> radianceProbeWSPositionImg = RadianceProbeWorldPosition->toImage(ImageFormat::RGB32F());
 	Color4 c = NumRadianceProbe->readTexel(0,0);
 
-	int count = c.r;
+	int count = min(int(c.r), RadianceProbeWorldPosition->width());
 	const float radius = 0.015f;
 	for (int i = 0; i < count; ++i)
 	{
@@ -96,13 +268,11 @@ void RadianceCache::debugDraw() {
 	}
 }
 
-void RadianceCache::setupInputs(shared_ptr<Camera> active_camera, 
-	shared_ptr<Texture> screenProbeWSAdaptivePositionTexture, 
-	shared_ptr<Texture> screenProbeSSAdaptivePositionTexture, 
-	shared_ptr<Texture> numAdaptiveScreenProbesTexture,
-	shared_ptr<GBuffer> gbuffer)
+void RadianceCache::setupInputs(const Array<shared_ptr<ScreenProbeView>>& views)
 {
-	activeCamera = active_camera;
+	alwaysAssertM(views.size() > 0, "RadianceCache: requires a view");
+	// The clipmaps follow the main view
+	activeCamera = views[0]->camera;
 	int numMipMaps = 1;
 	const int MaxClipmaps = 6;
 	radianceCacheInputs.ReprojectionRadiusScale = 1.5f;
@@ -119,12 +289,11 @@ void RadianceCache::setupInputs(shared_ptr<Camera> active_camera,
 	radianceCacheInputs.OcclusionProbeResolution = 16;
 	radianceCacheInputs.NumProbesToTraceBudget = 200;
 	radianceCacheInputs.RadianceCacheStats = 0;
+	radianceCacheInputs.MaxNumRadianceProbes = 2048;
+	radianceCacheInputs.NumRaysPerRadianceProbe = 32;
 	radianceCacheInputs.InvClipmapFadeSize = 1.0f / clamp(1.f, .001f, 16.0f);
 	
-	AdaptiveProbeWSPosition = screenProbeWSAdaptivePositionTexture;
-	AdaptiveProbeSSPosition = screenProbeSSAdaptivePositionTexture;
-	AdaptiveProbeNum = numAdaptiveScreenProbesTexture;
-	m_gbuffer = gbuffer;
+	m_views = views;
 }
 
 void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
@@ -141,22 +310,14 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 
 	if (m_finalRadianceAtlas) {}
 	else {
-		GBuffer::Specification gbufferRTSpec;
-		gbufferRTSpec.encoding[GBuffer::Field::LAMBERTIAN].format = ImageFormat::RGBA32F();
-		gbufferRTSpec.encoding[GBuffer::Field::GLOSSY].format = ImageFormat::RGBA32F();
-		gbufferRTSpec.encoding[GBuffer::Field::EMISSIVE].format = ImageFormat::RGBA32F();
-		gbufferRTSpec.encoding[GBuffer::Field::TRANSMISSIVE].format = ImageFormat::RGBA32F();
-		gbufferRTSpec.encoding[GBuffer::Field::WS_POSITION].format = ImageFormat::RGBA32F();
-		gbufferRTSpec.encoding[GBuffer::Field::WS_NORMAL] = Texture::Encoding(ImageFormat::RGBA32F(), FrameName::CAMERA, 1.0f, 0.0f);
-		gbufferRTSpec.encoding[GBuffer::Field::DEPTH_AND_STENCIL].format = nullptr;
-		gbufferRTSpec.encoding[GBuffer::Field::CS_NORMAL] = nullptr;
-		gbufferRTSpec.encoding[GBuffer::Field::CS_POSITION] = nullptr;
+		const GBuffer::Specification& gbufferRTSpec = GBufferProfile::raySpecification(m_gbufferProfile);
 
 		Vector2int32 extent = m_specification.finalRadianceAtlasExtent;
 
 		m_finalRadianceAtlas = GBuffer::create(gbufferRTSpec, "RadianceCache::m_radianceCacheFinalGBuffer");
 		m_finalRadianceAtlas->setSpecification(gbufferRTSpec);
 		m_finalRadianceAtlas->resize(extent.x, extent.y);
+		ResourceTracker::trackGBuffer("RadianceCache", m_finalRadianceAtlas);
 	}
 	if (radianceCacheInputs.CalculateIrradiance) {
 		//radiance irradiance occlusion
@@ -168,7 +329,8 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 		float fraction = 0.5;
 
 		if(!m_radianceProbeIndirectionTexture)
-			m_radianceProbeIndirectionTexture = Texture::createEmpty(
+			m_radianceProbeIndirectionTexture = ResourceTracker::createTexture(
+				"RadianceCache",
 				"RadianceCache::m_radianceProbeIndirect",
 				RadianceProbeIndirectionTextureSize.x,
 				RadianceProbeIndirectionTextureSize.y,
@@ -178,7 +340,7 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 				RadianceProbeIndirectionTextureSize.z,
 				1);
 		if(!testRadianceIndirect)
-			testRadianceIndirect = Texture::createEmpty("RadianceCache::testRadianceProbeIndirect",
+			testRadianceIndirect = ResourceTracker::createTexture("RadianceCache", "RadianceCache::testRadianceProbeIndirect",
 				RadianceProbeIndirectionTextureSize.x,
 				RadianceProbeIndirectionTextureSize.y * RadianceProbeIndirectionTextureSize.z,
 				ImageFormat::R32UI(),
@@ -192,7 +354,7 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			Vector3int32 extent(m_radianceProbeIndirectionTexture->width(), m_radianceProbeIndirectionTexture->height(), m_radianceProbeIndirectionTexture->depth());
 			Vector3int32 groupsize(4, 4, 4); //groupsize = 4
 			args.setComputeGroupSize(groupsize);
-			args.setComputeGridDim(extent / groupsize);
+			args.setComputeGridDim(ShaderWarmUp::gridDim(extent / groupsize));
 			args.setImageUniform("RWRadianceProbeIndirectionTexture", m_radianceProbeIndirectionTexture, Access::READ_WRITE, false);
 			LAUNCH_SHADER("shaders/WorldSpaceProbe_ClearProbeIndirect.glc", args);
 		}
@@ -209,7 +371,8 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			world2probeData[i] = Vector4(Clipmaps[i].WorldPositionToProbeCoordBias, Clipmaps[i].WorldPositionToProbeCoordScale);
 			probe2worldData[i] = Vector4(Clipmaps[i].ProbeCoordToWorldCenterBias, Clipmaps[i].ProbeCoordToWorldCenterScale);
 		}
-		//mark used probes
+		//mark used probes, for the screen probes of every view
+		for (const shared_ptr<ScreenProbeView>& view : m_views)
 		{
 			/*AdaptiveProbeWSPosition = Texture::createEmpty("AdaptiveProbeWsPosition", rd->viewport().width() / ScreenProbeDownsampleFactor, rd->viewport().height() / ScreenProbeDownsampleFactor * fraction, ImageFormat::RGB32F());
 
@@ -217,23 +380,24 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 
 			AdaptiveProbeNum = Texture::createEmpty("NumAdaptiveScreenProbes", 1, 1, ImageFormat::RGB32F());*/
 
-			shared_ptr<GLPixelTransferBuffer> adaptiveProbeWSPosition = AdaptiveProbeWSPosition->toPixelTransferBuffer();
-			shared_ptr<GLPixelTransferBuffer> adaptiveProbeSSPosition = AdaptiveProbeSSPosition->toPixelTransferBuffer();
-			shared_ptr<GLPixelTransferBuffer> adaptiveProbeNum = AdaptiveProbeNum->toPixelTransferBuffer();
-			shared_ptr<GLPixelTransferBuffer> worldPositionToRadianceProbeCoordForMark = GLPixelTransferBuffer::create(ClipmapCount, 1, ImageFormat::RGBA32F(), world2probeData.getCArray());
-			shared_ptr<GLPixelTransferBuffer> radianceProbeCoordToWorldPosition = GLPixelTransferBuffer::create(ClipmapCount, 1, ImageFormat::RGBA32F(), probe2worldData.getCArray());
-
-
-
-			adaptiveProbeWSPosition->bindAsShaderStorageBuffer(0);
-			adaptiveProbeSSPosition->bindAsShaderStorageBuffer(1);
-			adaptiveProbeNum->bindAsShaderStorageBuffer(2);
-			worldPositionToRadianceProbeCoordForMark->bindAsShaderStorageBuffer(3);
-			radianceProbeCoordToWorldPosition->bindAsShaderStorageBuffer(4);
+			// The readbacks stall on the placement, and a warm-up dispatches nothing that would read them
+			if (!ShaderWarmUp::active()) {
+				shared_ptr<GLPixelTransferBuffer> adaptiveProbeWSPosition = ResourceTracker::readback("RadianceCache", view->screenProbeWSAdaptivePositionTexture);
+				shared_ptr<GLPixelTransferBuffer> adaptiveProbeSSPosition = ResourceTracker::readback("RadianceCache", view->screenProbeSSAdaptivePositionTexture);
+				shared_ptr<GLPixelTransferBuffer> adaptiveProbeNum = ResourceTracker::readback("RadianceCache", view->numAdaptiveScreenProbesTexture);
+				shared_ptr<GLPixelTransferBuffer> worldPositionToRadianceProbeCoordForMark = ResourceTracker::createBuffer("RadianceCache", "worldPositionToRadianceProbeCoordForMark", ClipmapCount, 1, ImageFormat::RGBA32F(), world2probeData.getCArray());
+				shared_ptr<GLPixelTransferBuffer> radianceProbeCoordToWorldPosition = ResourceTracker::createBuffer("RadianceCache", "radianceProbeCoordToWorldPosition", ClipmapCount, 1, ImageFormat::RGBA32F(), probe2worldData.getCArray());
+
+				adaptiveProbeWSPosition->bindAsShaderStorageBuffer(0);
+				adaptiveProbeSSPosition->bindAsShaderStorageBuffer(1);
+				adaptiveProbeNum->bindAsShaderStorageBuffer(2);
+				worldPositionToRadianceProbeCoordForMark->bindAsShaderStorageBuffer(3);
+				radianceProbeCoordToWorldPosition->bindAsShaderStorageBuffer(4);
+			}
 
 
 			Vector2int32 sceneTextureExtent(2048, 2048);
-			Vector2int32 ScreenProbeViewSize = Vector2int32(iCeil(rd->viewport().extent().x / ScreenProbeDownsampleFactor), iCeil(rd->viewport().extent().y / ScreenProbeDownsampleFactor));
+			Vector2int32 ScreenProbeViewSize = Vector2int32(iCeil(view->width() / ScreenProbeDownsampleFactor), iCeil(view->height() / ScreenProbeDownsampleFactor));
 			Vector2int32 ScreenProbeAtlasViewSize = ScreenProbeViewSize;
 			ScreenProbeAtlasViewSize.y += ScreenProbeViewSize.y * fraction; //ScreenProbeGatherAdaptiveProbeAllocationFraction
 
@@ -245,7 +409,7 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			Args args;
 			Vector3int32 groupSize(16, 16, 1);
 			args.setComputeGroupSize(groupSize);
-			args.setComputeGridDim(Vector3int32(ScreenProbeAtlasViewSize, 1) / groupSize);
+			args.setComputeGridDim(ShaderWarmUp::gridDim(Vector3int32(ScreenProbeAtlasViewSize, 1) / groupSize));
 			args.setImageUniform("RadianceProbeIndirectionTexture", m_radianceProbeIndirectionTexture, Access::READ_WRITE, false);
 			args.setImageUniform("testRadianceProbeIndirectionTexture", testRadianceIndirect, Access::READ_WRITE, false);
 			args.setUniform("ScreenProbeAtlasViewSize", ScreenProbeAtlasViewSize);
@@ -258,9 +422,17 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			args.setUniform("RadianceProbeClipmapResolutionForMark", radianceCacheInputs.RadianceProbeClipmapResolution);
 			args.setUniform("InvClipmapFadeSizeForMark", radianceCacheInputs.InvClipmapFadeSize);
 
-			args.setUniform("ws_positionTexture", m_gbuffer->texture(GBuffer::Field::WS_POSITION), Sampler::buffer());
-			args.setUniform("depthTexture", m_gbuffer->texture(GBuffer::Field::DEPTH_AND_STENCIL), Sampler::buffer());
-			args.setUniform("ws_normalTexture", m_gbuffer->texture(GBuffer::Field::WS_NORMAL), Sampler::buffer());
+			// Short-range screen probe rays end up to screenProbeTraceDistance() away from their probe,
+			// so the cells around the probe within that distance must be traced as well
+			int markDilationInCells = 0;
+			const shared_ptr<IrradianceField>& irradianceField = m_irradianceField.lock();
+			if (notNull(irradianceField) && (irradianceField->screenProbeTraceDistance() < finf()) && (ClipmapCount > 0)) {
+				markDilationInCells = iCeil(irradianceField->screenProbeTraceDistance() * Clipmaps[0].WorldPositionToProbeCoordScale);
+			}
+			args.setUniform("MarkDilationInCells", markDilationInCells);
+
+			// Runs before this frame's G-buffer pass, so the G-buffer still holds last frame's view
+			GBufferProfile::setDecodeArgs(args, view->gbuffer, view->camera->previousFrame());
 			/*
 			uniform ivec2 ScreenProbeAtlasViewSize;
 			uniform ivec2 ScreenProbeViewSize;
@@ -274,9 +446,7 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			uniform float InvClipmapFadeSizeForMark;
 
 			// Texture
-			uniform sampler2D   ws_positionTexture;
-			uniform sampler2D   depthTexture;
-			uniform sampler2D   ws_normalTexture;
+			#include "GBufferDecode.glsl"
 
 			*/
 
@@ -284,11 +454,11 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 		}
 
 		{
-			shared_ptr<GLPixelTransferBuffer>& worldProbePosition = GLPixelTransferBuffer::create(2048, 1, ImageFormat::RGBA32F());
+			shared_ptr<GLPixelTransferBuffer>& worldProbePosition = ResourceTracker::createBuffer("RadianceCache", "worldProbePosition", radianceCacheInputs.MaxNumRadianceProbes, 1, ImageFormat::RGBA32F());
 			//shared_ptr<GLPixelTransferBuffer>& numWorldProbe = GLPixelTransferBuffer::create(1, 1, ImageFormat::RGB32I());
 
-			shared_ptr<GLPixelTransferBuffer>& worldPositionToRadianceProbeCoordForMark = GLPixelTransferBuffer::create(ClipmapCount, 1, ImageFormat::RGBA32F(), world2probeData.getCArray());
-			shared_ptr<GLPixelTransferBuffer>& radianceProbeCoordToWorldPosition = GLPixelTransferBuffer::create(ClipmapCount, 1, ImageFormat::RGBA32F(), probe2worldData.getCArray());
+			shared_ptr<GLPixelTransferBuffer>& worldPositionToRadianceProbeCoordForMark = ResourceTracker::createBuffer("RadianceCache", "worldPositionToRadianceProbeCoordForMark", ClipmapCount, 1, ImageFormat::RGBA32F(), world2probeData.getCArray());
+			shared_ptr<GLPixelTransferBuffer>& radianceProbeCoordToWorldPosition = ResourceTracker::createBuffer("RadianceCache", "radianceProbeCoordToWorldPosition", ClipmapCount, 1, ImageFormat::RGBA32F(), probe2worldData.getCArray());
 
 			/*
 			layout( local_size_variable ) in;
@@ -304,28 +474,35 @@ void RadianceCache::UpdateRadianceCache(RenderDevice* rd) {
 			uniform int clipmapResolution;
 			*/
 			if (!RadianceProbeWorldPosition) {
-				RadianceProbeWorldPosition = Texture::createEmpty("RadianceCache::RadianceProbeWorldPosition", 2048, 1, ImageFormat::RGBA32F());
+				RadianceProbeWorldPosition = ResourceTracker::createTexture("RadianceCache", "RadianceCache::RadianceProbeWorldPosition", radianceCacheInputs.MaxNumRadianceProbes, 1, ImageFormat::RGBA32F());
 
 			}
 			if (!NumRadianceProbe) {
-				NumRadianceProbe = Texture::createEmpty("RadianceCache::NumRadianceProbe", 1, 1, ImageFormat::R32UI());
+				NumRadianceProbe = ResourceTracker::createTexture("RadianceCache", "RadianceCache::NumRadianceProbe", 1, 1, ImageFormat::R32UI());
+			}
+			// While warming up, the probes gathered this frame stay in place
+			if (!ShaderWarmUp::active()) {
+				NumRadianceProbe->clear();
+				worldProbePosition->bindAsShaderStorageBuffer(0);
+				worldPositionToRadianceProbeCoordForMark->bindAsShaderStorageBuffer(2);
+				radianceProbeCoordToWorldPosition->bindAsShaderStorageBuffer(3);
 			}
-			worldProbePosition->bindAsShaderStorageBuffer(0);
-			worldPositionToRadianceProbeCoordForMark->bindAsShaderStorageBuffer(2);
-			radianceProbeCoordToWorldPosition->bindAsShaderStorageBuffer(3);
 			//numWorldProbe->bindAsShaderStorageBuffer(4);
 			Args args;
 			Vector3int32 groupSize(4,4,4);
 			Vector3int32 extent(m_radianceProbeIndirectionTexture->width(), m_radianceProbeIndirectionTexture->height(), m_radianceProbeIndirectionTexture->depth());
 			args.setComputeGroupSize(groupSize);
-			args.setComputeGridDim(extent / groupSize);
+			args.setComputeGridDim(ShaderWarmUp::gridDim(extent / groupSize));
 			args.setUniform("probeCount", 0);
 			args.setUniform("clipmapResolution", radianceCacheInputs.RadianceProbeClipmapResolution);
+			args.setUniform("maxProbeCount", uint32(radianceCacheInputs.MaxNumRadianceProbes));
 			args.setImageUniform("RadianceProbeIndirectionTexture", m_radianceProbeIndirectionTexture, Access::READ_WRITE, false);
 			args.setImageUniform("numWorldSpacePosition", NumRadianceProbe, Access::READ_WRITE, false);
 			LAUNCH_SHADER("shaders/WorldSpaceProbe_Gather.glc", args);
 			
-			RadianceProbeWorldPosition->update(worldProbePosition);
+			if (!ShaderWarmUp::active()) {
+				RadianceProbeWorldPosition->update(worldProbePosition);
+			}
 			//NumRadianceProbe->update(numWorldProbe);
 		}
 
@@ -1,5 +1,7 @@
 #pragma once
 #include <G3D/G3D.h>
+#include "IrradianceField.h"
+
 class RadianceCacheClipmap {
 public:
 	/** World space bounds. */
@@ -37,6 +39,9 @@ struct RadianceCacheInputs {
 	float OcclusionProbeResolution;
 	int NumProbesToTraceBudget;
 	int RadianceCacheStats;
+	/** Capacity of RadianceProbeWorldPosition and of the radiance probe atlas. */
+	int MaxNumRadianceProbes;
+	int NumRaysPerRadianceProbe;
 };
 
 struct RadianceCacheState {
@@ -61,27 +66,81 @@ protected:
 
 	shared_ptr<GBuffer> m_finalRadianceAtlas;
 
-	shared_ptr<GBuffer> m_gbuffer;
+	/** Layout of m_radianceRaysGBuffer and m_finalRadianceAtlas */
+	GBufferProfile::Value m_gbufferProfile = GBufferProfile::FULL_PRECISION;
+
 	shared_ptr<Texture> m_radianceProbeIndirectionTexture;
 
 	//mark
-	shared_ptr<Texture> AdaptiveProbeWSPosition;
-	shared_ptr<Texture> AdaptiveProbeSSPosition;
-	shared_ptr<Texture> AdaptiveProbeNum;
+	/** Every view marks the probes its screen probes need. The first one centers the clipmaps. */
+	Array<shared_ptr<ScreenProbeView>> m_views;
 	shared_ptr<Texture> WorldPositionToRadianceProbeCoordForMark;
 	shared_ptr<Texture> RadianceProbeCoordToWorldPosition;
 	shared_ptr<Texture> NumRadianceProbe;
 	shared_ptr<Texture> RadianceProbeWorldPosition;
 	shared_ptr<Texture> testRadianceIndirect;
+
+	/** Tracer and scene used to shade the radiance probes. Weak because the field holds this cache. */
+	weak_ptr<IrradianceField> m_irradianceField;
+
+	/** One row per probe gathered into RadianceProbeWorldPosition, one column per ray */
+	shared_ptr<Texture> m_radianceRayOrigins;
+	shared_ptr<Texture> m_radianceRayDirections;
+	shared_ptr<Framebuffer> m_radianceRaysFB;
+	shared_ptr<GBuffer> m_radianceRaysGBuffer;
+	shared_ptr<Framebuffer> m_radianceRaysShadedFB;
+
+	/** Octahedral radiance of every gathered probe, indexed by the slot the gather pass
+		writes into m_radianceProbeIndirectionTexture. Same layout as the irradiance probe atlas. */
+	shared_ptr<Texture> m_radianceProbeAtlas;
+	shared_ptr<Framebuffer> m_radianceProbeAtlasFB;
+
+	/** Set once traceRadianceProbes() has written the atlas, which warmUpShaders() allocates earlier */
+	bool m_hasRadiance = false;
+
+	/** Configuration the warm variants were compiled for, see warmUpShaders() */
+	String m_warmShadersKey;
+
+	/** Traces the probes gathered this frame and rewrites their atlas entries. */
+	void traceRadianceProbes(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray);
 public:
 	bool UpdateRadianceCacheState(shared_ptr<Camera> camera, RadianceCacheInputs& input, RadianceCacheState& cache);
 	void UpdateRadianceCache(RenderDevice* rd);
 	virtual void onGraphics3D(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray);
+
+	/** Compiles the programs of every pass of onGraphics3D() by launching them under a
+		ShaderWarmUp::Scope, so that the first frame with indirect light does not. Requires
+		setupInputs(). Returns false without launching anything if nothing changed since the
+		last call. */
+	bool warmUpShaders(RenderDevice* rd, const Array<shared_ptr<Surface>>& surfaceArray);
 	void debugDraw();
 	shared_ptr<RadianceCache> create();
-	void setupInputs(shared_ptr<Camera> active_camera,
-		shared_ptr<Texture> screenProbeWSAdaptivePositionTexture,
-		shared_ptr<Texture> screenProbeSSAdaptivePositionTexture,
-		shared_ptr<Texture> numAdaptiveScreenProbesTexture,
-		shared_ptr<GBuffer> gbuffer);
+	void setupInputs(const Array<shared_ptr<ScreenProbeView>>& views);
+
+	void setIrradianceField(const shared_ptr<IrradianceField>& irradianceField) {
+		m_irradianceField = irradianceField;
+	}
+
+	/** The ray buffers are reallocated on the next update */
+	void setGBufferProfile(GBufferProfile::Value profile) {
+		if (profile != m_gbufferProfile) {
+			m_gbufferProfile = profile;
+			m_radianceRayOrigins.reset();
+			m_finalRadianceAtlas.reset();
+			m_warmShadersKey = "";
+		}
+	}
+
+	/** True once the probe atlas has been traced, i.e. setShaderArgs() binds meaningful data. */
+	bool hasRadiance() const {
+		return m_hasRadiance && (radianceCacheState.clipmaps.size() > 0);
+	}
+
+	/** Distance from which the radiance probes of the finest clipmap start their rays. */
+	float probeTMin() const {
+		return radianceCacheState.clipmaps[0].ProbeTMin;
+	}
+
+	/** Binds the clipmaps, indirection texture and probe atlas to a RadianceCacheHelpers.glsl RadianceCache struct. */
+	void setShaderArgs(UniformTable& args, const String& prefix);
 };
@@ -0,0 +1,186 @@
+#include "RenderGraph.h"
+#include "ResourceTracker.h"
+
+size_t RenderGraph::TextureDesc::sizeInBytes() const
+{
+	const size_t baseLevel = size_t(width) * size_t(height) * size_t(format->openGLBitsPerPixel) / 8;
+	// A full mip chain adds a third
+	return generateMipMaps ? (baseLevel * 4) / 3 : baseLevel;
+}
+
+void RenderGraph::reset()
+{
+	m_resources.fastClear();
+	m_passes.fastClear();
+}
+
+RenderGraph::Handle RenderGraph::createTexture(const TextureDesc& desc)
+{
+	alwaysAssertM(notNull(desc.format) && (desc.width > 0) && (desc.height > 0), "RenderGraph: invalid texture description for " + desc.name);
+
+	Resource& r = m_resources.next();
+	r.desc = desc;
+	return m_resources.size() - 1;
+}
+
+RenderGraph::Handle RenderGraph::importTexture(const String& name, const shared_ptr<Texture>& texture, bool output)
+{
+	Resource& r = m_resources.next();
+	r.desc.name = name;
+	r.imported = true;
+	r.output = output;
+	r.texture = texture;
+	return m_resources.size() - 1;
+}
+
+RenderGraph::Handle RenderGraph::importFramebuffer(const String& name, const shared_ptr<Framebuffer>& framebuffer, bool output)
+{
+	const Handle h = importTexture(name, framebuffer->texture(0), output);
+	m_resources[h].framebuffer = framebuffer;
+	return h;
+}
+
+RenderGraph::Pass& RenderGraph::addPass(const String& name, const std::function<void(RenderDevice*)>& execute)
+{
+	const shared_ptr<Pass> pass = std::make_shared<Pass>();
+	pass->m_name = name;
+	pass->m_execute = execute;
+	m_passes.append(pass);
+	return *pass;
+}
+
+const shared_ptr<Texture>& RenderGraph::texture(Handle h) const
+{
+	const Resource& r = m_resources[h];
+	debugAssertM(notNull(r.texture), "RenderGraph: " + r.desc.name + " is not allocated outside of the passes that use it");
+	return r.texture;
+}
+
+const shared_ptr<Framebuffer>& RenderGraph::framebuffer(Handle h) const
+{
+	const Resource& r = m_resources[h];
+	debugAssertM(notNull(r.framebuffer), "RenderGraph: " + r.desc.name + " has no framebuffer");
+	return r.framebuffer;
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walk backwards: a pass is live if it has side effects, writes an output
+	// texture or writes something a later live pass reads
+	Array<bool> needed;
+	needed.resize(m_resources.size());
+	needed.setAll(false);
+
+	m_culledPassCount = 0;
+	for (int p = m_passes.size() - 1; p >= 0; --p)
+	{
+		Pass& pass = *m_passes[p];
+		bool live = pass.m_sideEffects;
+		for (const Handle h : pass.m_writes) {
+			live = live || m_resources[h].output || needed[h];
+		}
+
+		pass.m_culled = !live;
+		if (live) {
+			for (const Handle h : pass.m_reads) {
+				needed[h] = true;
+			}
+		} else {
+			++m_culledPassCount;
+		}
+	}
+}
+
+int RenderGraph::acquirePooledTexture(const TextureDesc& desc, int firstPass, int lastPass)
+{
+	for (int i = 0; i < m_pool.size(); ++i)
+	{
+		PooledTexture& pooled = m_pool[i];
+		if (pooled.desc.compatible(desc) && (!pooled.usedThisFrame || (pooled.busyUntil < firstPass)))
+		{
+			pooled.usedThisFrame = true;
+			pooled.busyUntil = lastPass;
+			return i;
+		}
+	}
+
+	PooledTexture& pooled = m_pool.next();
+	pooled.desc = desc;
+	pooled.framebuffer = Framebuffer::create(ResourceTracker::createTexture("RenderGraph", desc.name, desc.width, desc.height, desc.format, Texture::DIM_2D, desc.generateMipMaps));
+	pooled.usedThisFrame = true;
+	pooled.busyUntil = lastPass;
+	return m_pool.size() - 1;
+}
+
+void RenderGraph::allocateTransients()
+{
+	for (PooledTexture& pooled : m_pool) {
+		pooled.usedThisFrame = false;
+		pooled.busyUntil = -1;
+	}
+
+	// Lifetimes over the surviving passes
+	for (int p = 0; p < m_passes.size(); ++p)
+	{
+		const Pass& pass = *m_passes[p];
+		if (pass.m_culled) {
+			continue;
+		}
+		for (const Array<Handle>* handles : { &pass.m_reads, &pass.m_writes }) {
+			for (const Handle h : *handles) {
+				Resource& r = m_resources[h];
+				if (r.firstPass < 0) {
+					r.firstPass = p;
+				}
+				r.lastPass = max(r.lastPass, p);
+			}
+		}
+	}
+
+	// Resources are declared before the passes that use them, but their lifetimes start at
+	// first use, so hand out the pool in first-use order
+	Array<Handle> transients;
+	for (int h = 0; h < m_resources.size(); ++h) {
+		if (!m_resources[h].imported && (m_resources[h].firstPass >= 0)) {
+			transients.append(h);
+		}
+	}
+	std::stable_sort(transients.begin(), transients.end(), [this](Handle a, Handle b) { return m_resources[a].firstPass < m_resources[b].firstPass; });
+
+	m_unaliasedTransientBytes = 0;
+	for (const Handle h : transients)
+	{
+		Resource& r = m_resources[h];
+		r.framebuffer = m_pool[acquirePooledTexture(r.desc, r.firstPass, r.lastPass)].framebuffer;
+		r.texture = r.framebuffer->texture(0);
+		m_unaliasedTransientBytes += r.desc.sizeInBytes();
+	}
+
+	// Release whatever last frame needed and this frame does not, e.g. after a resize
+	m_peakTransientBytes = 0;
+	for (int i = 0; i < m_pool.size(); ++i)
+	{
+		if (m_pool[i].usedThisFrame) {
+			m_peakTransientBytes += m_pool[i].desc.sizeInBytes();
+		} else {
+			m_pool.fastRemove(i);
+			--i;
+		}
+	}
+}
+
+void RenderGraph::execute(RenderDevice* rd)
+{
+	cullPasses();
+	allocateTransients();
+
+	for (const shared_ptr<Pass>& pass : m_passes)
+	{
+		if (pass->m_culled) {
+			continue;
+		}
+		BEGIN_PROFILER_EVENT(pass->m_name);
+		pass->m_execute(rd);
+		END_PROFILER_EVENT();
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <G3D/G3D.h>
+#include <functional>
+#include <algorithm>
+
+/** Per-frame list of GPU passes with declared texture reads and writes.
+
+	The graph is rebuilt every frame: declare textures with createTexture() or importTexture(),
+	add passes in execution order, then call execute(). Passes whose outputs are never read by a
+	live pass are culled; imported textures are outputs unless imported as intermediates. Transient textures are only valid between their first and last use,
+	so textures with the same description and non-overlapping lifetimes share one allocation.
+	The backing textures are kept in a pool from frame to frame and released once unused. */
+class RenderGraph : public ReferenceCountedObject
+{
+public:
+	/** Index of a texture declared this frame */
+	typedef int Handle;
+	static const Handle NONE = -1;
+
+	class TextureDesc
+	{
+	public:
+		String              name;
+		int                 width = 0;
+		int                 height = 0;
+		const ImageFormat*  format = nullptr;
+		bool                generateMipMaps = false;
+
+		TextureDesc() {}
+		TextureDesc(const String& name, int width, int height, const ImageFormat* format, bool generateMipMaps = false) :
+			name(name), width(width), height(height), format(format), generateMipMaps(generateMipMaps) {}
+
+		/** Textures with the same description may alias */
+		bool compatible(const TextureDesc& other) const {
+			return (width == other.width) && (height == other.height) && (format == other.format) && (generateMipMaps == other.generateMipMaps);
+		}
+
+		size_t sizeInBytes() const;
+	};
+
+	class Pass
+	{
+	protected:
+		friend class RenderGraph;
+
+		String                              m_name;
+		std::function<void(RenderDevice*)>  m_execute;
+		Array<Handle>                       m_reads;
+		Array<Handle>                       m_writes;
+		bool                                m_sideEffects = false;
+		bool                                m_culled = false;
+
+	public:
+		Pass& read(Handle h) { m_reads.append(h); return *this; }
+		Pass& write(Handle h) { m_writes.append(h); return *this; }
+
+		/** Never culled, e.g. writes the current framebuffer or reads data back to the CPU */
+		Pass& setSideEffects() { m_sideEffects = true; return *this; }
+	};
+
+protected:
+	class Resource
+	{
+	public:
+		TextureDesc                         desc;
+		bool                                imported = false;
+		/** Writes keep the pass alive */
+		bool                                output = false;
+		shared_ptr<Framebuffer>             framebuffer;
+		shared_ptr<Texture>                 texture;
+		int                                 firstPass = -1;
+		int                                 lastPass = -1;
+	};
+
+	class PooledTexture
+	{
+	public:
+		TextureDesc                         desc;
+		shared_ptr<Framebuffer>             framebuffer;
+		bool                                usedThisFrame = false;
+		/** Pass index after which the texture may be handed to another resource */
+		int                                 busyUntil = -1;
+	};
+
+	Array<Resource>                         m_resources;
+	Array<shared_ptr<Pass>>                 m_passes;
+	Array<PooledTexture>                    m_pool;
+
+	size_t                                  m_peakTransientBytes = 0;
+	size_t                                  m_unaliasedTransientBytes = 0;
+	int                                     m_culledPassCount = 0;
+
+	RenderGraph() {}
+
+	void cullPasses();
+	void allocateTransients();
+	int acquirePooledTexture(const TextureDesc& desc, int firstPass, int lastPass);
+
+public:
+	static shared_ptr<RenderGraph> create() {
+		return createShared<RenderGraph>();
+	}
+
+	/** Drops last frame's passes and handles. Pooled textures are kept for reuse. */
+	void reset();
+
+	Handle createTexture(const TextureDesc& desc);
+
+	/** Persistent texture owned by the caller. Writes to it count as outputs of the graph unless
+		\a output is false, e.g. for a buffer that is kept across frames only to avoid reallocating it
+		but carries nothing from one frame to the next. Imported textures never alias. */
+	Handle importTexture(const String& name, const shared_ptr<Texture>& texture, bool output = true);
+	Handle importFramebuffer(const String& name, const shared_ptr<Framebuffer>& framebuffer, bool output = true);
+
+	/** Passes run in the order they are added. The returned reference stays valid until reset(). */
+	Pass& addPass(const String& name, const std::function<void(RenderDevice*)>& execute);
+
+	/** Only valid while executing a pass that declared \a h */
+	const shared_ptr<Texture>& texture(Handle h) const;
+	/** Framebuffer with texture(h) bound to COLOR0, or the imported framebuffer */
+	const shared_ptr<Framebuffer>& framebuffer(Handle h) const;
+
+	/** Culls, assigns pooled textures and runs the surviving passes inside profiler events */
+	void execute(RenderDevice* rd);
+
+	/** Memory held by the transient texture pool after the last execute() */
+	size_t peakTransientBytes() const { return m_peakTransientBytes; }
+
+	/** What the transient textures of the last execute() would take without aliasing */
+	size_t unaliasedTransientBytes() const { return m_unaliasedTransientBytes; }
+
+	int culledPassCount() const { return m_culledPassCount; }
+};
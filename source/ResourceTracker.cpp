@@ -0,0 +1,243 @@
+#include "ResourceTracker.h"
+#include "Telemetry.h"
+#include <algorithm>
+
+ResourceTracker& ResourceTracker::instance()
+{
+	static ResourceTracker tracker;
+	return tracker;
+}
+
+ResourceTracker::OwnerState& ResourceTracker::owner(const String& name)
+{
+	bool created = false;
+	OwnerState& state = m_owners.getCreate(name, created);
+	if (created) {
+		m_ownerNames.append(name);
+	}
+	return state;
+}
+
+void ResourceTracker::sweep()
+{
+	for (int i = 0; i < m_records.size(); ++i) {
+		if (m_records[i].resource.expired()) {
+			m_records.fastRemove(i);
+			--i;
+		}
+	}
+}
+
+void ResourceTracker::record(const String& ownerName, const String& name, const ImageFormat* format, int width, int height, int depth, size_t bytes, bool host, const weak_ptr<void>& resource)
+{
+	// Released resources must not count toward the peak, but the one being replaced still
+	// exists at this point, which is also true on the GPU
+	sweep();
+
+	Record& r = m_records.next();
+	r.owner = ownerName;
+	r.name = name;
+	r.format = format;
+	r.width = width;
+	r.height = height;
+	r.depth = depth;
+	r.bytes = bytes;
+	r.host = host;
+	r.resource = resource;
+
+	OwnerState& state = owner(ownerName);
+	++state.allocationsThisFrame;
+	state.bytesAllocatedThisFrame += bytes;
+
+	size_t current = 0;
+	for (const Record& other : m_records) {
+		if (other.owner == ownerName) {
+			current += other.bytes;
+		}
+	}
+	state.peakBytes = max(state.peakBytes, current);
+
+	ChurnState& churn = m_churn.getCreate(ownerName + "::" + name);
+	if (churn.lastFrame == m_frame - 1) {
+		++churn.streak;
+	} else if (churn.lastFrame != m_frame) {
+		churn.streak = 1;
+	}
+	churn.lastFrame = m_frame;
+
+	if ((churn.streak >= churnFrames) && !churn.flagged) {
+		churn.flagged = true;
+		m_flagged.append(ownerName + "::" + name);
+		logPrintf("ResourceTracker: %s::%s (%dx%dx%d %s, %.2f MB) is reallocated every frame\n",
+			ownerName.c_str(), name.c_str(), width, height, depth, notNull(format) ? format->name().c_str() : "?", double(bytes) / 1e6);
+	}
+}
+
+shared_ptr<Texture> ResourceTracker::createTexture
+(const String&          owner,
+ const String&          name,
+ int                    width,
+ int                    height,
+ const ImageFormat*     format,
+ Texture::Dimension     dimension,
+ bool                   generateMipMaps,
+ int                    depth,
+ int                    numSamples)
+{
+	const shared_ptr<Texture>& texture = Texture::createEmpty(name, width, height, format, dimension, generateMipMaps, depth, numSamples);
+
+	size_t bytes = size_t(width) * size_t(height) * size_t(depth) * size_t(numSamples) * size_t(format->openGLBitsPerPixel) / 8;
+	if (generateMipMaps) {
+		// A full 2D mip chain adds a third
+		bytes = (bytes * 4) / 3;
+	}
+	instance().record(owner, name, format, width, height, depth, bytes, false, texture);
+	return texture;
+}
+
+shared_ptr<GLPixelTransferBuffer> ResourceTracker::createBuffer
+(const String&          owner,
+ const String&          name,
+ int                    width,
+ int                    height,
+ const ImageFormat*     format,
+ const void*            data)
+{
+	const shared_ptr<GLPixelTransferBuffer>& buffer = GLPixelTransferBuffer::create(width, height, format, data);
+	instance().record(owner, name, format, width, height, 1, buffer->size(), true, buffer);
+	return buffer;
+}
+
+shared_ptr<GLPixelTransferBuffer> ResourceTracker::readback(const String& owner, const shared_ptr<Texture>& texture)
+{
+	const shared_ptr<GLPixelTransferBuffer>& buffer = texture->toPixelTransferBuffer();
+	instance().record(owner, texture->name() + " readback", texture->format(), texture->width(), texture->height(), texture->depth(), buffer->size(), true, buffer);
+	return buffer;
+}
+
+void ResourceTracker::track(const String& owner, const shared_ptr<Texture>& texture)
+{
+	if (isNull(texture)) {
+		return;
+	}
+
+	ResourceTracker& t = instance();
+	for (const Record& r : t.m_records) {
+		if (r.resource.lock() == texture) {
+			// Already recorded
+			return;
+		}
+	}
+
+	size_t bytes = size_t(texture->width()) * size_t(texture->height()) * size_t(texture->depth()) * size_t(texture->format()->openGLBitsPerPixel) / 8;
+	if (texture->numMipMapLevels() > 1) {
+		bytes = (bytes * 4) / 3;
+	}
+	t.record(owner, texture->name(), texture->format(), texture->width(), texture->height(), texture->depth(), bytes, false, texture);
+}
+
+void ResourceTracker::trackGBuffer(const String& owner, const shared_ptr<GBuffer>& gbuffer)
+{
+	for (int f = 0; f < GBuffer::Field::COUNT; ++f) {
+		track(owner, gbuffer->texture(GBuffer::Field::Value(f)));
+	}
+}
+
+void ResourceTracker::endFrame()
+{
+	ResourceTracker& t = instance();
+	t.sweep();
+
+	Array<Usage> usage;
+	getUsage(usage);
+
+	for (const String& name : t.m_ownerNames)
+	{
+		OwnerState& state = t.m_owners[name];
+		state.allocationsLastFrame = state.allocationsThisFrame;
+		state.bytesAllocatedLastFrame = state.bytesAllocatedThisFrame;
+		state.allocationsThisFrame = 0;
+		state.bytesAllocatedThisFrame = 0;
+	}
+
+	for (const Usage& u : usage) {
+		Telemetry::set("memory." + u.owner + ".gpuBytes", double(u.gpuBytes));
+		Telemetry::set("memory." + u.owner + ".hostBytes", double(u.hostBytes));
+		Telemetry::set("memory." + u.owner + ".allocations", double(t.m_owners[u.owner].allocationsLastFrame));
+	}
+
+	++t.m_frame;
+}
+
+void ResourceTracker::getUsage(Array<Usage>& usage)
+{
+	const ResourceTracker& t = instance();
+	usage.fastClear();
+
+	for (const String& name : t.m_ownerNames)
+	{
+		const OwnerState& state = t.m_owners[name];
+		Usage& u = usage.next();
+		u.owner = name;
+		u.peakBytes = state.peakBytes;
+		u.allocationsLastFrame = state.allocationsLastFrame;
+		u.bytesAllocatedLastFrame = state.bytesAllocatedLastFrame;
+
+		for (const Record& r : t.m_records)
+		{
+			if ((r.owner != name) || r.resource.expired()) {
+				continue;
+			}
+			++u.liveCount;
+			if (r.host) {
+				u.hostBytes += r.bytes;
+			} else {
+				u.gpuBytes += r.bytes;
+			}
+		}
+	}
+}
+
+void ResourceTracker::printUsage()
+{
+	Array<Usage> usage;
+	getUsage(usage);
+
+	size_t gpuTotal = 0, hostTotal = 0;
+	screenPrintf("GI memory (MB): GPU / host / peak, allocations last frame");
+	for (const Usage& u : usage) {
+		screenPrintf("  %-20s %8.2f %8.2f %8.2f   %d (%.2f MB)", u.owner.c_str(),
+			double(u.gpuBytes) / 1e6, double(u.hostBytes) / 1e6, double(u.peakBytes) / 1e6,
+			u.allocationsLastFrame, double(u.bytesAllocatedLastFrame) / 1e6);
+		gpuTotal += u.gpuBytes;
+		hostTotal += u.hostBytes;
+	}
+	screenPrintf("  %-20s %8.2f %8.2f", "Total", double(gpuTotal) / 1e6, double(hostTotal) / 1e6);
+
+	const ResourceTracker& t = instance();
+	for (const String& key : t.m_flagged) {
+		// Only while the churn continues
+		if (t.m_churn[key].lastFrame >= t.m_frame - 1) {
+			screenPrintf("  reallocated every frame: %s", key.c_str());
+		}
+	}
+}
+
+void ResourceTracker::logResources()
+{
+	ResourceTracker& t = instance();
+	t.sweep();
+
+	Array<const Record*> sorted;
+	for (const Record& r : t.m_records) {
+		sorted.append(&r);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Record* a, const Record* b) { return a->bytes > b->bytes; });
+
+	logPrintf("ResourceTracker: %d live GI resources\n", sorted.size());
+	for (const Record* r : sorted) {
+		logPrintf("    %-16s %-44s %5dx%-5dx%-3d %-10s %-4s %10.3f MB\n", r->owner.c_str(), r->name.c_str(),
+			r->width, r->height, r->depth, notNull(r->format) ? r->format->name().c_str() : "?",
+			r->host ? "host" : "GPU", double(r->bytes) / 1e6);
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Accounting for the textures and pixel transfer buffers allocated by the GI modules.
+
+	Allocate through createTexture() and createBuffer() (or register G3D-owned textures with
+	track()) and every resource is recorded with its owner, name, format and size. The tracker only
+	holds weak references, so a resource stops counting once its last shared_ptr is released.
+	Textures count as GPU memory. Pixel transfer buffers are mapped into the address space of the
+	process and count as host memory.
+
+	A resource that is recreated on churnFrames consecutive frames is flagged as churn and
+	reported once in the log. */
+class ResourceTracker
+{
+public:
+	/** Totals for one owner, e.g. "IrradianceField" */
+	class Usage
+	{
+	public:
+		String      owner;
+		int         liveCount = 0;
+		size_t      gpuBytes = 0;
+		size_t      hostBytes = 0;
+		/** Highest gpuBytes + hostBytes seen at any allocation */
+		size_t      peakBytes = 0;
+		int         allocationsLastFrame = 0;
+		size_t      bytesAllocatedLastFrame = 0;
+	};
+
+	static const int churnFrames = 8;
+
+protected:
+	class Record
+	{
+	public:
+		String              owner;
+		String              name;
+		const ImageFormat*  format = nullptr;
+		int                 width = 0;
+		int                 height = 0;
+		int                 depth = 1;
+		size_t              bytes = 0;
+		bool                host = false;
+		weak_ptr<void>      resource;
+	};
+
+	class OwnerState
+	{
+	public:
+		size_t      peakBytes = 0;
+		int         allocationsThisFrame = 0;
+		size_t      bytesAllocatedThisFrame = 0;
+		int         allocationsLastFrame = 0;
+		size_t      bytesAllocatedLastFrame = 0;
+	};
+
+	class ChurnState
+	{
+	public:
+		int         lastFrame = -2;
+		int         streak = 0;
+		bool        flagged = false;
+	};
+
+	ResourceTracker() {}
+
+	static ResourceTracker& instance();
+
+	int                         m_frame = 0;
+	Array<Record>               m_records;
+	Table<String, OwnerState>   m_owners;
+	/** Registration order, for a stable report layout */
+	Array<String>               m_ownerNames;
+	/** Keyed by owner::name */
+	Table<String, ChurnState>   m_churn;
+	Array<String>               m_flagged;
+
+	/** Drops the records of released resources */
+	void sweep();
+	OwnerState& owner(const String& name);
+	void record(const String& owner, const String& name, const ImageFormat* format, int width, int height, int depth, size_t bytes, bool host, const weak_ptr<void>& resource);
+
+public:
+	/** Texture::createEmpty() with accounting */
+	static shared_ptr<Texture> createTexture
+	(const String&          owner,
+	 const String&          name,
+	 int                    width,
+	 int                    height,
+	 const ImageFormat*     format,
+	 Texture::Dimension     dimension       = Texture::DIM_2D,
+	 bool                   generateMipMaps = false,
+	 int                    depth           = 1,
+	 int                    numSamples      = 1);
+
+	/** GLPixelTransferBuffer::create() with accounting */
+	static shared_ptr<GLPixelTransferBuffer> createBuffer
+	(const String&          owner,
+	 const String&          name,
+	 int                    width,
+	 int                    height,
+	 const ImageFormat*     format,
+	 const void*            data = nullptr);
+
+	/** Texture::toPixelTransferBuffer() with accounting */
+	static shared_ptr<GLPixelTransferBuffer> readback(const String& owner, const shared_ptr<Texture>& texture);
+
+	/** Records a texture allocated elsewhere, e.g. by GBuffer::resize() */
+	static void track(const String& owner, const shared_ptr<Texture>& texture);
+
+	/** Tracks every allocated field of \a gbuffer */
+	static void trackGBuffer(const String& owner, const shared_ptr<GBuffer>& gbuffer);
+
+	/** Closes the allocation counters of the frame and publishes memory.<owner>.* to Telemetry.
+		Call once per frame before Telemetry::endFrame(). */
+	static void endFrame();
+
+	static void getUsage(Array<Usage>& usage);
+
+	/** Writes getUsage() and the churn flags to the screen with screenPrintf */
+	static void printUsage();
+
+	/** Writes every live resource, largest first, to the log */
+	static void logResources();
+};
@@ -0,0 +1,159 @@
+#include "ScreenProbeView.h"
+#include "GBufferProfile.h"
+#include "ResourceTracker.h"
+#include "ShaderCache.h"
+
+void ScreenProbeView::adaptivePlacement()
+{
+	int placementDownsampleFactor = 16;
+	const int screenProbeDownsampleFactor = placementDownsampleFactor;
+	uniformPlacement(placementDownsampleFactor);
+
+	const int minDownsampleFactor = 4;
+
+	const int tileWidth = width() / placementDownsampleFactor;
+	const int tileHeight = height() / placementDownsampleFactor;
+	const int adaptiveHeight = int(tileHeight * maxAdaptiveFactor);
+
+	// While warming up, the passes run on the textures of the last placement and write nothing
+	const bool warmUp = ShaderWarmUp::active();
+
+	// RW Buffer
+	shared_ptr<GLPixelTransferBuffer> adaptiveProbeWSPosBuffer, adaptiveProbeSSPosBuffer, screenTileAdaptiveProbeHeaderBuffer, screenTileAdaptiveProbeIndicesBuffer, numAdaptiveScreenProbesBuffer;
+	if (!warmUp) {
+		// World position
+		screenProbeWSAdaptivePositionTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("AdaptiveProbeWsPosition"), tileWidth, adaptiveHeight, ImageFormat::RGBA32F());
+		adaptiveProbeWSPosBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("adaptiveProbeWSPosBuffer"), tileWidth, adaptiveHeight, ImageFormat::RGBA32F());
+		// Screen position
+		screenProbeSSAdaptivePositionTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("AdaptiveProbeSsPosition"), tileWidth, adaptiveHeight, ImageFormat::RGBA32F());
+		adaptiveProbeSSPosBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("adaptiveProbeSSPosBuffer"), tileWidth, adaptiveHeight, ImageFormat::RGBA32F());
+		// Header
+		screenTileAdaptiveProbeHeaderTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("ScreenTileAdaptiveProbeHeader"), tileWidth, tileHeight, ImageFormat::R32UI());
+		screenTileAdaptiveProbeHeaderBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("screenTileAdaptiveProbeHeaderBuffer"), tileWidth, tileHeight, ImageFormat::R32UI());
+		// Index
+		screenTileAdaptiveProbeIndicesTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("ScreenTileAdaptiveProbeIndices"), width(), height(), ImageFormat::R32UI());
+		screenTileAdaptiveProbeIndicesBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("screenTileAdaptiveProbeIndicesBuffer"), width(), height(), ImageFormat::R32UI());
+		// Num
+		numAdaptiveScreenProbesTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("NumAdaptiveScreenProbes"), 1, 1, ImageFormat::R32UI());
+		numAdaptiveScreenProbesBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("numAdaptiveScreenProbesBuffer"), 1, 1, ImageFormat::R32UI());
+		// Tile table
+		screenTileTableTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("ScreenTileTable"), width() / screenProbeDownsampleFactor * ScreenTileTableStride, height() / screenProbeDownsampleFactor, ImageFormat::RGBA32F());
+		// The first level only sees the uniform probes
+		screenTileAdaptiveProbeHeaderTexture->clear();
+	}
+
+	do {
+		// Each level tests its candidates against the probes placed by the previous levels
+		buildScreenTileTable(screenProbeDownsampleFactor);
+
+		placementDownsampleFactor /= 2;
+		Args args;
+
+		// GroupSize & GroupNum
+		const Vector3int32 blockSize(16, 16, 1);
+		args.setComputeGridDim(ShaderWarmUp::gridDim(Vector3int32(iCeil(width() / (float(blockSize.x) * placementDownsampleFactor)),
+			iCeil(height() / (float(blockSize.y) * placementDownsampleFactor)), 1)));
+		args.setComputeGroupSize(blockSize);
+
+		if (!warmUp) {
+			adaptiveProbeWSPosBuffer->bindAsShaderStorageBuffer(0);
+			adaptiveProbeSSPosBuffer->bindAsShaderStorageBuffer(1);
+			screenTileAdaptiveProbeHeaderBuffer->bindAsShaderStorageBuffer(2);
+			screenTileAdaptiveProbeIndicesBuffer->bindAsShaderStorageBuffer(3);
+			numAdaptiveScreenProbesBuffer->bindAsShaderStorageBuffer(4);
+		}
+
+		args.setUniform("placementDownsampleFactor", placementDownsampleFactor);
+		args.setUniform("screenProbeDownsampleFactor", screenProbeDownsampleFactor);
+		args.setUniform("viewport_width", (float)width());
+		args.setUniform("viewport_height", (float)height());
+		GBufferProfile::setDecodeArgs(args, gbuffer, camera->previousFrame());
+		args.setUniform("screenTileTable", screenTileTableTexture, Sampler::buffer());
+
+		LAUNCH_SHADER("shaders/ScreenProbeAdaptivePlacement.glc", args);
+
+		if (!warmUp) {
+			screenProbeWSAdaptivePositionTexture->update(adaptiveProbeWSPosBuffer);
+			screenProbeSSAdaptivePositionTexture->update(adaptiveProbeSSPosBuffer);
+			screenTileAdaptiveProbeHeaderTexture->update(screenTileAdaptiveProbeHeaderBuffer);
+			screenTileAdaptiveProbeIndicesTexture->update(screenTileAdaptiveProbeIndicesBuffer);
+			numAdaptiveScreenProbesTexture->update(numAdaptiveScreenProbesBuffer);
+		}
+
+	} while (placementDownsampleFactor > minDownsampleFactor);
+
+	// Final table for the indirect gather
+	buildScreenTileTable(screenProbeDownsampleFactor);
+}
+
+void ScreenProbeView::uniformPlacement(int downsampleFactor)
+{
+	Args args;
+
+	// GroupSize & GroupNum
+	const Vector3int32 blockSize(16, 16, 1);
+	args.setComputeGridDim(ShaderWarmUp::gridDim(Vector3int32(iCeil(width() / (float(blockSize.x) * downsampleFactor)),
+		iCeil(height() / (float(blockSize.y) * downsampleFactor)), 1)));
+	args.setComputeGroupSize(blockSize);
+
+	// IO Variable
+	shared_ptr<GLPixelTransferBuffer> outputBuffer;
+	if (!ShaderWarmUp::active()) {
+		screenProbeWSUniformPositionTexture = ResourceTracker::createTexture("ScreenProbeView", resourceName("UniformProbeWsPosition"), width() / downsampleFactor, height() / downsampleFactor, ImageFormat::RGBA32F());
+		outputBuffer = ResourceTracker::createBuffer("ScreenProbeView", resourceName("uniformProbeWSPositionBuffer"), width() / downsampleFactor, height() / downsampleFactor, ImageFormat::RGBA32F());
+		outputBuffer->bindAsShaderStorageBuffer(0);
+	}
+	args.setUniform("placementDownsampleFactor", downsampleFactor);
+	args.setUniform("viewport_width", (float)width());
+	args.setUniform("viewport_height", (float)height());
+	// Placement runs before this frame's G-buffer pass, so the G-buffer still holds last frame's view
+	GBufferProfile::setDecodeArgs(args, gbuffer, camera->previousFrame());
+
+	// Run the uniform shader
+	LAUNCH_SHADER("shaders/ScreenProbeUniformPlacement.glc", args);
+
+	if (notNull(outputBuffer)) {
+		screenProbeWSUniformPositionTexture->update(outputBuffer);
+	}
+}
+
+void ScreenProbeView::buildScreenTileTable(int screenProbeDownsampleFactor)
+{
+	Args args;
+
+	// One invocation per screen tile
+	const Vector3int32 blockSize(8, 8, 1);
+	args.setComputeGridDim(ShaderWarmUp::gridDim(Vector3int32(iCeil(width() / (float(blockSize.x) * screenProbeDownsampleFactor)),
+		iCeil(height() / (float(blockSize.y) * screenProbeDownsampleFactor)), 1)));
+	args.setComputeGroupSize(blockSize);
+
+	args.setImageUniform("screenTileTable", screenTileTableTexture, Access::WRITE, false);
+	args.setUniform("screenProbeDownsampleFactor", screenProbeDownsampleFactor);
+	args.setUniform("viewport_width", (float)width());
+	args.setUniform("viewport_height", (float)height());
+	GBufferProfile::setDecodeArgs(args, gbuffer, camera->previousFrame());
+	args.setUniform("adaptiveProbeSSPosData", screenProbeSSAdaptivePositionTexture, Sampler::buffer());
+	args.setUniform("screenTileHeaderData", screenTileAdaptiveProbeHeaderTexture, Sampler::buffer());
+	args.setUniform("screenTileProbeIndex", screenTileAdaptiveProbeIndicesTexture, Sampler::buffer());
+
+	LAUNCH_SHADER("shaders/ScreenProbeTileTable_Build.glc", args);
+
+	// Placement and the gather read the table through samplers
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void ScreenProbeView::warmUpShaders()
+{
+	ShaderWarmUp::Scope warmUp;
+	adaptivePlacement();
+}
+
+void ScreenProbeView::clear()
+{
+	for (const shared_ptr<Texture>& texture : { screenProbeWSUniformPositionTexture, screenProbeWSAdaptivePositionTexture, screenProbeSSAdaptivePositionTexture,
+		screenTileAdaptiveProbeHeaderTexture, screenTileAdaptiveProbeIndicesTexture, numAdaptiveScreenProbesTexture }) {
+		if (notNull(texture)) {
+			texture->clear();
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <G3D/G3D.h>
+#include "RenderGraph.h"
+
+/** Everything that exists once per rendered view: the screen probes placed from its G-buffer,
+	the probe atlases they are integrated into and the indirect history of the GIRenderer.
+
+	The IrradianceField, the scene TriTree and the RadianceCache are shared. Every frame the
+	field traces the probes of all views as one ray batch, view i owning the rows
+	[rayRowOffset, rayRowOffset + probeCount()) of the ray textures.
+
+	Placement reads the G-buffer of the last frame rendered from this view, so a view takes part
+	only once hasGBuffer() is true. */
+class ScreenProbeView
+{
+public:
+	/** Per-tile interpolation candidates shared by placement and the indirect gather.
+		ScreenTileTableStride RGBA32F texels per screen tile, see ScreenProbeInterpolation.glsl */
+	static const int ScreenTileTableStride = 32;
+
+	String                      name;
+	shared_ptr<Camera>          camera;
+	shared_ptr<GBuffer>         gbuffer;
+
+	/** Adaptive probes are at most this fraction of the uniform probes */
+	float                       maxAdaptiveFactor = 0.5f;
+
+	shared_ptr<Texture>         screenProbeWSUniformPositionTexture;
+	shared_ptr<Texture>         screenProbeWSAdaptivePositionTexture;
+	shared_ptr<Texture>         screenProbeSSAdaptivePositionTexture;
+	shared_ptr<Texture>         screenTileAdaptiveProbeHeaderTexture;
+	shared_ptr<Texture>         screenTileAdaptiveProbeIndicesTexture;
+	shared_ptr<Texture>         numAdaptiveScreenProbesTexture;
+	shared_ptr<Texture>         screenTileTableTexture;
+
+	/** Camera change time the probes were last placed for */
+	RealTime                    lastPlacementTime = -1;
+
+	/** Read back from numAdaptiveScreenProbesTexture by the IrradianceField every frame */
+	int                         adaptiveProbeCount = 0;
+
+	/** First row of this view in the shared ray textures */
+	int                         rayRowOffset = 0;
+
+	/** Screen probe atlases, allocated by the IrradianceField. Null until the first update. */
+	shared_ptr<Texture>         irradianceProbes;
+	shared_ptr<Texture>         meanDistProbes;
+	shared_ptr<Framebuffer>     irradianceProbeFB;
+	shared_ptr<Framebuffer>     meanDistProbeFB;
+
+	/** Oct side lengths the atlases were allocated for */
+	int                         irradianceSide = 0;
+	int                         depthSide = 0;
+
+	/** If true, the next update overwrites the atlases instead of blending (hysteresis 0) */
+	bool                        firstFrame = true;
+
+	/** Ping-ponged by giHistoryIndex. COLOR0 = accumulated indirect (a = history length), COLOR1 = position, COLOR2 = normal */
+	shared_ptr<Framebuffer>     giHistoryFramebuffer[2];
+	int                         giHistoryIndex = 0;
+
+	/** False after a scene change, a resize or while accumulation is off */
+	bool                        giHistoryValid = false;
+
+	/** GIRenderer passes of this view. Per view, so that the transient pool of one view is not
+		released and reallocated by the views rendered between its frames. */
+	shared_ptr<RenderGraph>     giRenderGraph = RenderGraph::create();
+
+protected:
+
+	ScreenProbeView(const String& name, const shared_ptr<Camera>& camera, const shared_ptr<GBuffer>& gbuffer) :
+		name(name), camera(camera), gbuffer(gbuffer) {}
+
+	/** Name of a resource of this view for the ResourceTracker */
+	String resourceName(const String& resource) const {
+		return name + "::" + resource;
+	}
+
+	void uniformPlacement(int downsampleFactor);
+	void buildScreenTileTable(int screenProbeDownsampleFactor);
+
+public:
+
+	static shared_ptr<ScreenProbeView> create(const String& name, const shared_ptr<Camera>& camera, const shared_ptr<GBuffer>& gbuffer) {
+		return createShared<ScreenProbeView>(name, camera, gbuffer);
+	}
+
+	bool hasGBuffer() const {
+		return notNull(gbuffer) && notNull(gbuffer->camera()) && (gbuffer->width() > 0);
+	}
+
+	int width() const {
+		return gbuffer->width();
+	}
+
+	int height() const {
+		return gbuffer->height();
+	}
+
+	int uniformProbeCount() const {
+		return isNull(screenProbeWSUniformPositionTexture) ? 0 : screenProbeWSUniformPositionTexture->width() * screenProbeWSUniformPositionTexture->height();
+	}
+
+	/** Rows this view owns in the shared ray textures */
+	int probeCount() const {
+		return uniformProbeCount() + adaptiveProbeCount;
+	}
+
+	/** Places the uniform and then the adaptive screen probes from the G-buffer of the last frame
+		and builds the screen tile table read by the indirect gather */
+	void adaptivePlacement();
+
+	/** Compiles the placement and tile table programs for the current G-buffer layout by
+		launching them under a ShaderWarmUp::Scope. The placement of the last frame is kept.
+		Requires a previous adaptivePlacement(). */
+	void warmUpShaders();
+
+	/** Zeroes every placement texture */
+	void clear();
+};
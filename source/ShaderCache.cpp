@@ -0,0 +1,64 @@
+#include "ShaderCache.h"
+#include <stdlib.h>
+
+ShaderCache::Specification ShaderCache::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if ((arg == "--shader-cache-dir") && hasValue) {
+			s.directory = argv[++i];
+		} else if (arg == "--no-shader-cache") {
+			s.enabled = false;
+		}
+	}
+	return s;
+}
+
+static void setEnvironmentVariable(const char* name, const String& value)
+{
+#	ifdef _WIN32
+		_putenv_s(name, value.c_str());
+#	else
+		setenv(name, value.c_str(), 1);
+#	endif
+}
+
+void ShaderCache::configure(const Specification& specification)
+{
+	if (!specification.enabled) {
+		return;
+	}
+
+	if (!FileSystem::exists(specification.directory)) {
+		FileSystem::createDirectory(specification.directory);
+	}
+	const String& directory = FilePath::canonicalize(specification.directory);
+
+	// NVIDIA. The driver would otherwise evict entries that a later run still needs.
+	setEnvironmentVariable("__GL_SHADER_DISK_CACHE", "1");
+	setEnvironmentVariable("__GL_SHADER_DISK_CACHE_PATH", directory);
+	setEnvironmentVariable("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+	setEnvironmentVariable("__GL_SHADER_DISK_CACHE_SIZE", "4294967296");
+
+	// Mesa
+	setEnvironmentVariable("MESA_SHADER_CACHE_DIR", directory);
+	setEnvironmentVariable("MESA_SHADER_CACHE_MAX_SIZE", "4G");
+
+	logPrintf("ShaderCache: driver program cache in %s\n", directory.c_str());
+}
+
+bool ShaderWarmUp::s_active = false;
+
+Rect2D ShaderWarmUp::rect(RenderDevice* rd, const Rect2D& rect)
+{
+	if (s_active) {
+		rd->setColorWrite(false);
+		rd->setDepthWrite(false);
+		return Rect2D::xywh(0, 0, 1, 1);
+	}
+	return rect;
+}
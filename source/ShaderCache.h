@@ -0,0 +1,76 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Persistent cache of linked GPU programs, so that a restart does not recompile every GI pass.
+
+	G3D compiles and links the programs inside LAUNCH_SHADER and offers no hook to supply a
+	program binary, so the cache is the driver's own on-disk program cache, keyed by the driver
+	version and a hash of the preprocessed source. The NVIDIA and Mesa caches are on by default;
+	configure() moves them to Specification::directory, so that the cache travels with the
+	build, and lifts their size limits and eviction, which the GI variants of several scenes
+	exceed. It must run before the GL context is created, because the drivers read these
+	settings when they are loaded.
+
+	The cache only saves compile time on a later run. Moving the compiles of this run out of the
+	frames that first use a variant is ShaderWarmUp. */
+class ShaderCache
+{
+public:
+	class Specification
+	{
+	public:
+		bool        enabled = true;
+		String      directory = "shader-cache";
+
+		/** Reads --shader-cache-dir and --no-shader-cache */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+	/** Enables the NVIDIA and Mesa program caches in \a specification.directory. Leaves the
+		driver defaults alone when the specification is disabled. */
+	static void configure(const Specification& specification);
+};
+
+
+/** Launches GI passes only to compile their programs, so that LAUNCH_SHADER does not stall the
+	frame that first uses a variant.
+
+	While a Scope is alive, pixel passes that take their rectangle from rect() draw a single pixel
+	with color and depth writes disabled, and compute passes that take their grid from gridDim()
+	dispatch no work groups. LAUNCH_SHADER still compiles and links the variant that the bound
+	arguments select, but no texture or image is written. Callers skip the CPU work around their
+	launches, such as tracing and readbacks, and any state a real pass would advance, while
+	active().
+
+	App::warmUpShaders() runs every GI pass of a frame this way. */
+class ShaderWarmUp
+{
+protected:
+	static bool s_active;
+
+public:
+	class Scope
+	{
+		bool m_previous;
+	public:
+		Scope() : m_previous(s_active) {
+			s_active = true;
+		}
+		~Scope() {
+			s_active = m_previous;
+		}
+	};
+
+	static bool active() {
+		return s_active;
+	}
+
+	/** \a rect, or one pixel with color and depth writes disabled while active. Call between
+		push2D() and pop2D(), which restore the write masks. */
+	static Rect2D rect(RenderDevice* rd, const Rect2D& rect);
+
+	/** \a gridDim, or no work groups while active */
+	static Vector3int32 gridDim(const Vector3int32& gridDim) {
+		return s_active ? Vector3int32(0, 0, 0) : gridDim;
+	}
+};
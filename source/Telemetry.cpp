@@ -0,0 +1,274 @@
+#ifdef _WIN32
+// Before G3D, which pulls in windows.h
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#   pragma comment(lib, "ws2_32.lib")
+#else
+#   include <sys/socket.h>
+#   include <netinet/in.h>
+#   include <arpa/inet.h>
+#   include <unistd.h>
+#endif
+
+#include "Telemetry.h"
+#include <algorithm>
+
+Telemetry::Specification Telemetry::Specification::fromCommandLine(int argc, const char* argv[])
+{
+	Specification s;
+	for (int i = 1; i < argc; ++i)
+	{
+		const String arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if ((arg == "--telemetry-file") && hasValue) {
+			s.filename = argv[++i];
+		} else if ((arg == "--telemetry-port") && hasValue) {
+			s.udpPort = atoi(argv[++i]);
+		} else if ((arg == "--telemetry-window") && hasValue) {
+			s.windowFrames = atoi(argv[++i]);
+		}
+	}
+
+	alwaysAssertM((s.udpPort >= 0) && (s.udpPort < 65536), "Telemetry: invalid --telemetry-port");
+	alwaysAssertM(s.windowFrames > 0, "Telemetry: --telemetry-window must be positive");
+	return s;
+}
+
+Telemetry& Telemetry::instance()
+{
+	static Telemetry telemetry;
+	return telemetry;
+}
+
+Telemetry::~Telemetry()
+{
+	closeExports();
+}
+
+void Telemetry::closeExports()
+{
+	if (notNull(m_file)) {
+		fclose(m_file);
+		m_file = nullptr;
+	}
+
+	if (m_socket != -1) {
+#		ifdef _WIN32
+			closesocket(SOCKET(m_socket));
+			WSACleanup();
+#		else
+			close(int(m_socket));
+#		endif
+		m_socket = -1;
+	}
+}
+
+void Telemetry::openSocket()
+{
+#	ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			debugPrintf("Telemetry: WSAStartup failed, socket export disabled\n");
+			return;
+		}
+		const SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (s == INVALID_SOCKET) {
+			WSACleanup();
+		} else {
+			m_socket = intptr_t(s);
+		}
+#	else
+		m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+#	endif
+
+	if (m_socket == -1) {
+		debugPrintf("Telemetry: could not create a UDP socket, socket export disabled\n");
+	}
+}
+
+void Telemetry::configure(const Specification& specification)
+{
+	Telemetry& t = instance();
+	t.closeExports();
+	t.m_specification = specification;
+
+	if (!specification.filename.empty()) {
+		t.m_file = FileSystem::fopen(specification.filename.c_str(), "w");
+		alwaysAssertM(notNull(t.m_file), "Telemetry: could not open " + specification.filename);
+	}
+
+	if (specification.udpPort > 0) {
+		t.openSocket();
+	}
+
+	if (notNull(t.m_file) || (t.m_socket != -1)) {
+		setEnabled(true);
+	}
+}
+
+void Telemetry::setEnabled(bool b)
+{
+	instance().m_enabled = b;
+	if (b) {
+		Profiler::setEnabled(true);
+	}
+}
+
+Telemetry::Statistic& Telemetry::statistic(const String& name)
+{
+	bool created = false;
+	Statistic& s = m_statistics.getCreate(name, created);
+	if (created) {
+		m_names.append(name);
+	}
+	return s;
+}
+
+void Telemetry::add(const String& name, double value)
+{
+	Statistic& s = instance().statistic(name);
+	s.current = s.writtenThisFrame ? s.current + value : value;
+	s.writtenThisFrame = true;
+}
+
+void Telemetry::set(const String& name, double value)
+{
+	Statistic& s = instance().statistic(name);
+	s.current = value;
+	s.writtenThisFrame = true;
+}
+
+void Telemetry::collectProfilerEvents()
+{
+	Array<const Array<Profiler::Event>*> eventTrees;
+	Profiler::getEvents(eventTrees);
+	for (const Array<Profiler::Event>* tree : eventTrees)
+	{
+		for (const Profiler::Event& event : *tree) {
+			// Events with the same name, e.g. the two ray traces, are summed
+			add("gpuMs." + event.name(), event.gfxDuration() * 1000.0);
+		}
+	}
+}
+
+String Telemetry::frameToJSON() const
+{
+	String json = format("{\"frame\":%d,\"time\":%.3f,\"stats\":{", m_frame, System::time());
+	bool first = true;
+	for (const String& name : m_names)
+	{
+		const Statistic& s = m_statistics[name];
+		if (!s.writtenThisFrame) {
+			continue;
+		}
+
+		String key = name;
+		key = stringJoin(stringSplit(key, '\\'), "\\\\");
+		key = stringJoin(stringSplit(key, '"'), "\\\"");
+		json += format("%s\"%s\":%.9g", first ? "" : ",", key.c_str(), s.current);
+		first = false;
+	}
+	return json + "}}\n";
+}
+
+void Telemetry::exportFrame(const String& json)
+{
+	if (notNull(m_file)) {
+		fputs(json.c_str(), m_file);
+		// Dashboards tail the file while the app runs
+		fflush(m_file);
+	}
+
+	if (m_socket != -1)
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(uint16(m_specification.udpPort));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		// Fire and forget: a dropped datagram only loses one frame of a live view
+#		ifdef _WIN32
+			sendto(SOCKET(m_socket), json.c_str(), int(json.size()), 0, (const sockaddr*)&address, sizeof(address));
+#		else
+			sendto(int(m_socket), json.c_str(), json.size(), 0, (const sockaddr*)&address, sizeof(address));
+#		endif
+	}
+}
+
+void Telemetry::endFrame()
+{
+	Telemetry& t = instance();
+	if (!t.m_enabled) {
+		// Discard what the modules wrote so that enabling starts from a clean frame
+		for (const String& name : t.m_names) {
+			t.m_statistics[name].writtenThisFrame = false;
+		}
+		return;
+	}
+
+	t.collectProfilerEvents();
+
+	const int windowFrames = t.m_specification.windowFrames;
+	for (const String& name : t.m_names)
+	{
+		Statistic& s = t.m_statistics[name];
+		if (!s.writtenThisFrame) {
+			continue;
+		}
+
+		if (s.window.size() < windowFrames) {
+			s.window.append(s.current);
+		} else {
+			s.window[s.next] = s.current;
+		}
+		s.next = (s.next + 1) % windowFrames;
+	}
+
+	if (notNull(t.m_file) || (t.m_socket != -1)) {
+		t.exportFrame(t.frameToJSON());
+	}
+
+	for (const String& name : t.m_names) {
+		t.m_statistics[name].writtenThisFrame = false;
+	}
+	++t.m_frame;
+}
+
+void Telemetry::getSummaries(Array<Summary>& summaries)
+{
+	const Telemetry& t = instance();
+	summaries.fastClear();
+
+	Array<double> sorted;
+	for (const String& name : t.m_names)
+	{
+		const Statistic& s = t.m_statistics[name];
+		if (s.window.size() == 0) {
+			continue;
+		}
+
+		sorted = s.window;
+		std::sort(sorted.begin(), sorted.end());
+		const auto percentile = [&sorted](double p) { return sorted[iRound(p * double(sorted.size() - 1))]; };
+
+		Summary& summary = summaries.next();
+		summary.name = name;
+		summary.last = s.window[(s.next + s.window.size() - 1) % s.window.size()];
+		summary.p50 = percentile(0.50);
+		summary.p95 = percentile(0.95);
+		summary.p99 = percentile(0.99);
+	}
+}
+
+void Telemetry::printSummaries()
+{
+	Array<Summary> summaries;
+	getSummaries(summaries);
+
+	screenPrintf("GI telemetry over the last %d frames (last / p50 / p95 / p99)", instance().m_specification.windowFrames);
+	for (const Summary& s : summaries) {
+		screenPrintf("  %-44s %12.3f %12.3f %12.3f %12.3f", s.name.c_str(), s.last, s.p50, s.p95, s.p99);
+	}
+}
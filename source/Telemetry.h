@@ -0,0 +1,111 @@
+#pragma once
+#include <G3D/G3D.h>
+
+/** Per-frame GI statistics: ray counts, hit ratios, probe counts, trace and rebuild times,
+	GPU time per profiler event and bytes moved between the CPU and the GPU.
+
+	Like Profiler, this is a process-wide registry so that every GI module can write to it
+	without being handed a pointer. Values written during a frame are accumulated with add()
+	or replaced with set(), then endFrame() pushes them into a rolling window per statistic
+	and exports the frame.
+
+	Statistics that need a GPU readback to compute (hit ratios, marked radiance probes) are
+	only written while enabled(). Exported frames are one JSON object per line, e.g.
+	\code
+	{"frame":120,"time":2.013,"stats":{"irradianceField.rays":98304,...}}
+	\endcode
+	appended to --telemetry-file and/or sent as UDP datagrams to 127.0.0.1:--telemetry-port. */
+class Telemetry
+{
+public:
+	class Specification
+	{
+	public:
+		/** Empty disables file export */
+		String      filename;
+
+		/** 0 disables socket export */
+		int         udpPort = 0;
+
+		/** Frames kept per statistic for the percentiles */
+		int         windowFrames = 240;
+
+		/** Reads --telemetry-file, --telemetry-port and --telemetry-window */
+		static Specification fromCommandLine(int argc, const char* argv[]);
+	};
+
+	class Summary
+	{
+	public:
+		String      name;
+		double      last = 0;
+		double      p50 = 0;
+		double      p95 = 0;
+		double      p99 = 0;
+	};
+
+protected:
+	class Statistic
+	{
+	public:
+		/** Ring buffer of the last windowFrames values */
+		Array<double>   window;
+		int             next = 0;
+
+		double          current = 0;
+		bool            writtenThisFrame = false;
+	};
+
+	Telemetry() {}
+
+	static Telemetry& instance();
+
+	Specification               m_specification;
+	bool                        m_enabled = false;
+	int                         m_frame = 0;
+
+	Table<String, Statistic>    m_statistics;
+	/** Registration order, for a stable display and export layout */
+	Array<String>               m_names;
+
+	FILE*                       m_file = nullptr;
+	/** SOCKET on Windows, file descriptor elsewhere */
+	intptr_t                    m_socket = -1;
+
+	Statistic& statistic(const String& name);
+	void collectProfilerEvents();
+	String frameToJSON() const;
+	void exportFrame(const String& json);
+	void openSocket();
+	void closeExports();
+
+public:
+	~Telemetry();
+
+	/** Opens the export targets. Export implies enabled(). */
+	static void configure(const Specification& specification);
+
+	static bool enabled() {
+		return instance().m_enabled;
+	}
+
+	/** Also enables the Profiler, which provides the per-pass GPU times */
+	static void setEnabled(bool b);
+
+	/** Accumulates into this frame's value */
+	static void add(const String& name, double value);
+
+	/** Replaces this frame's value */
+	static void set(const String& name, double value);
+
+	/** Adds gpuMs.<event> for every profiler event of the last completed frame, pushes the values
+		written since the previous call into their windows and exports them. Call once per frame
+		after the profiler has resolved the frame, i.e. from onAfterSimulation. */
+	static void endFrame();
+
+	/** Last value and rolling percentiles of every statistic written at least once */
+	static void getSummaries(Array<Summary>& summaries);
+
+	/** Writes getSummaries() to the screen with screenPrintf */
+	static void printSummaries();
+};